@@ -59,6 +59,10 @@ extern "C" {
 #define FLASH_PAGE_1_ADDR			FLASH_START_ADDR
 #define FLASH_PAGE_0_ADDR			(FLASH_PAGE_1_ADDR + FLASH_PAGE_SIZE)
 
+//ble throughput, both grow the SoftDevice RAM, the stack falls back to the sdk_config defaults if it does not fit
+#define BLE_CONN_EVENT_LENGTH		8//1.25ms units, 10ms
+#define BLE_HVN_TX_QUEUE_SIZE		3//notifications the SoftDevice can hold
+
 //user config
 #define FW_VERSION_MAJOR		0x02
 #define FW_VERSION_MINOR		0x05
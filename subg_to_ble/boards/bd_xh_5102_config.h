@@ -61,6 +61,10 @@ extern "C" {
 #define FLASH_PAGE_1_ADDR			FLASH_START_ADDR
 #define FLASH_PAGE_0_ADDR			(FLASH_PAGE_1_ADDR + FLASH_PAGE_SIZE)
 
+//ble throughput, both grow the SoftDevice RAM, the stack falls back to the sdk_config defaults if it does not fit
+#define BLE_CONN_EVENT_LENGTH		24//1.25ms units, 30ms, the whole burst interval
+#define BLE_HVN_TX_QUEUE_SIZE		6//notifications the SoftDevice can hold
+
 //user config
 #define FW_VERSION_MAJOR		0x01
 #define FW_VERSION_MINOR		0x00
@@ -17,17 +17,15 @@
 #include "ble.h"
 #include "ble_ips.h"
 #include "ble_srv_common.h"
-#include "app_timer.h"
 #include "kit_log.h"
 
-#define BLE_TMR_TICK_ONE_MIN    60000
-
 #define BLE_UUID_DATA_CHAR 		0xE849               /**< The UUID of the Characteristic. */
 #define BLE_UUID_RES_CNT_CHAR 	0x7910               /**< The UUID of the Characteristic. */
 #define BLE_UUID_TMR_TICK_CHAR 	0x7910               /**< The UUID of the Characteristic. */
 #define BLE_UUID_CUS_NAME_CHAR 	0x2AF0               /**< The UUID of the Characteristic. */
 #define BLE_UUID_FW_VER_CHAR 	0x9DC9               /**< The UUID of the Characteristic. */
 #define BLE_UUID_LED_MODE_CHAR 	0x4241               /**< The UUID of the Characteristic. */
+#define BLE_UUID_DATA_NO_RSP_CHAR 	0x7340               /**< The UUID of the Characteristic. */
 
 #define IPS_BASE_UUID 			{{0x45, 0x38, 0x2A, 0x9C, 0x21, 0x69, 0x56, 0xB8, 0x97, 0x41, 0xc5, 0x99, 0x3B, 0x73, 0x35, 0x02}}//0235733b-99c5-4197-b856-69219c2a3845
 #define IPS_CHAR_DATA_UUID 		{{0x55, 0x91, 0xDA, 0xDA, 0x6A, 0x01, 0x7C, 0x86, 0xE2, 0x42, 0x28, 0x50, 0x49, 0xE8, 0x42, 0xC8}}//c842e849-5028-42e2-867c-016adada9155
@@ -36,6 +34,7 @@
 #define IPS_CHAR_CUS_NAME_UUID 	{{0x66, 0x9A, 0x0C, 0x20, 0x00, 0x08, 0x21, 0x8C, 0xE4, 0x11, 0x28, 0x1E, 0xF0, 0x2A, 0x3B, 0xD9}}//d93b2af0-1e28-11e4-8c21-0800200c9a66
 #define IPS_CHAR_FW_VER_UUID 	{{0xF2, 0x8C, 0x23, 0x4D, 0x10, 0x0A, 0x51, 0xA0, 0x95, 0x42, 0x91, 0x7C, 0xC9, 0x9D, 0xD9, 0x30}}//30d99dc9-7c91-4295-a051-0a104d238cf2
 #define IPS_CHAR_LED_MODE_UUID 	{{0x4E, 0xF1, 0x32, 0x67, 0xE1, 0xFC, 0x5F, 0xA2, 0x9C, 0x4F, 0xA7, 0xF1, 0x41, 0x42, 0xD8, 0xC6}}//c6d84241-f1a7-4f9c-a25f-fce16732f14e
+#define IPS_CHAR_DATA_NO_RSP_UUID 	{{0x45, 0x38, 0x2A, 0x9C, 0x21, 0x69, 0x56, 0xB8, 0x97, 0x41, 0xc5, 0x99, 0x40, 0x73, 0x35, 0x02}}//02357340-99c5-4197-b856-69219c2a3845, on the service base so it takes no extra vendor uuid slot
 
 #define DATA_CHAR_DESC_NAME 		"Data"
 #define RES_CNT_CHAR_DESC_NAME 		"Response Count"
@@ -43,13 +42,12 @@
 #define CUS_NAME_CHAR_DESC_NAME 	"Custom Name"
 #define FW_VER_CHAR_DESC_NAME		"Version"
 #define LED_MODE_CHAR_DESC_NAME		"LED Mode"
+#define DATA_NO_RSP_CHAR_DESC_NAME	"Data No Response"
 
 #define FW_VER_CHAR_VALUE		  	"ble_rfspy 2.0"
 
 #define TAG "IPS"
 
-APP_TIMER_DEF(timerTickTimer);
-
 /**@brief Function for setting security requirements of a characteristic.
  *
  * @param[in]  level   required security level.
@@ -170,7 +168,11 @@ static void on_connect(ble_ips_t * p_ips, ble_evt_t const * p_ble_evt)
     uint8_t                    cccd_value[2];
     ble_ips_client_context_t * p_client = NULL;
 	
-    p_ips->conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
+    // the first link keeps the service, later ones only get their CCCDs checked
+    if (p_ips->conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        p_ips->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    }
 
     err_code = blcm_link_ctx_get(p_ips->p_link_ctx_storage,
                                  p_ble_evt->evt.gap_evt.conn_handle,
@@ -223,8 +225,10 @@ static void on_connect(ble_ips_t * p_ips, ble_evt_t const * p_ble_evt)
  */
 static void on_disconnect(ble_ips_t * p_ips, ble_evt_t const * p_ble_evt)
 {
-    UNUSED_PARAMETER(p_ble_evt);
-    p_ips->conn_handle = BLE_CONN_HANDLE_INVALID;
+    if (p_ips->conn_handle == p_ble_evt->evt.gap_evt.conn_handle)
+    {
+        p_ips->conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
 }
 
 /**@brief Function for handling the @ref BLE_GATTS_EVT_WRITE event from the SoftDevice.
@@ -285,6 +289,12 @@ static void on_write(ble_ips_t * p_ips, ble_evt_t const * p_ble_evt)
                 p_client->is_tmr_tick_notification_enabled = false;
 				KIT_LOG(TAG, "Write: unsubscribe for timer tick.");
             }
+			
+			if (p_ips->data_handler != NULL)
+			{
+				evt.type = p_client->is_tmr_tick_notification_enabled ? BLE_IPS_EVT_TMR_TICK_ON : BLE_IPS_EVT_TMR_TICK_OFF;
+				p_ips->data_handler(&evt);
+			}
         }
     }
     else if ((p_evt_write->handle == p_ips->data_char_handles.value_handle) &&
@@ -310,6 +320,14 @@ static void on_write(ble_ips_t * p_ips, ble_evt_t const * p_ble_evt)
         evt.params.rx_data.p_data = p_evt_write->data;
         evt.params.rx_data.length = p_evt_write->len;
         p_ips->data_handler(&evt);
+    }
+	else if ((p_evt_write->handle == p_ips->data_no_rsp_char_handles.value_handle) &&
+             (p_ips->data_handler != NULL))
+    {
+        evt.type                  = BLE_IPS_EVT_DATA_NO_RSP_RX;
+        evt.params.rx_data.p_data = p_evt_write->data;
+        evt.params.rx_data.length = p_evt_write->len;
+        p_ips->data_handler(&evt);
     }
     else
     {
@@ -384,66 +402,63 @@ void ble_ips_on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
     }
 }
 
-static void ble_ips_timer_tick_handle(void *pContext)
+/* Quiet on success, the application sends it every tick period */
+uint32_t ble_ips_timer_tick_notify(ble_ips_t *p_ips)
 {
     ret_code_t 					err_code = NRF_SUCCESS;
     ble_gatts_hvx_params_t 		hvx_params;
     ble_ips_client_context_t 	*p_client;
-    ble_ips_t 					*p_ips = (ble_ips_t *)pContext;
     ble_gatts_value_t           gatts_value;
 	uint16_t 					hvx_len;
+	uint8_t 					timer_tick;
 	
-	p_ips->timer_tick = p_ips->timer_tick + 1;
-	if(p_ips->timer_tick >= 0xff)
+	// only taken when the notification is queued
+	timer_tick = p_ips->timer_tick + 1;
+	if(timer_tick >= 0xff)
 	{
-		p_ips->timer_tick = 0;
+		timer_tick = 0;
 	}
     blcm_link_ctx_get(p_ips->p_link_ctx_storage, p_ips->conn_handle, (void *) &p_client);
 	
     if ((p_ips->conn_handle == BLE_CONN_HANDLE_INVALID) || (p_client == NULL))
     {
-		KIT_LOG(TAG, "Timer tick, not connected!");
-        return;
+        return NRF_ERROR_NOT_FOUND;
     }
 
     if (!p_client->is_tmr_tick_notification_enabled)
     {
-		KIT_LOG(TAG, "Timer tick, not subscribed!");
-        return;
+        return NRF_ERROR_INVALID_STATE;
     }
 
 	//set timer tick gatt value for reading by client
-	// Initialize value struct.
 	memset(&gatts_value, 0, sizeof(gatts_value));
-	gatts_value.len 	= sizeof(p_ips->timer_tick);
+	gatts_value.len 	= sizeof(timer_tick);
 	gatts_value.offset	= 0;
-	gatts_value.p_value = &p_ips->timer_tick;
-	// Update database.
+	gatts_value.p_value = &timer_tick;
 	err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID,
 									  p_ips->tmr_tick_char_handles.value_handle,
 									  &gatts_value);
 	if (err_code != NRF_SUCCESS)
 	{
 		KIT_LOG(TAG, "Timer tick, set value err: 0x%02x!", err_code);
-        return;
+        return err_code;
 	}
 
     memset(&hvx_params, 0, sizeof(hvx_params));
 	
-	hvx_len 		  = sizeof(p_ips->timer_tick);
+	hvx_len 		  = sizeof(timer_tick);
     hvx_params.handle = p_ips->tmr_tick_char_handles.value_handle;
-    hvx_params.p_data = &p_ips->timer_tick;
+    hvx_params.p_data = &timer_tick;
     hvx_params.p_len  = &hvx_len;
     hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
 
     err_code = sd_ble_gatts_hvx(p_ips->conn_handle, &hvx_params);
-	
-	if (err_code != NRF_SUCCESS)
+	if (err_code == NRF_SUCCESS)
 	{
-		KIT_LOG(TAG, "Timer tick, notify failed: 0x%02x!", err_code);
-		return;
+		p_ips->timer_tick = timer_tick;
 	}
-	KIT_LOG(TAG, "Timer tick, notify OK: 0x%02x!", p_ips->timer_tick);
+	
+	return err_code;
 }
 
 uint32_t ble_ips_response_cnt_notify(ble_ips_t *p_ips) 
@@ -453,11 +468,13 @@ uint32_t ble_ips_response_cnt_notify(ble_ips_t *p_ips)
 	ble_ips_client_context_t * 	p_client;
     ble_gatts_value_t           gatts_value;
 	uint16_t 					hvx_len;
+	uint8_t 					response_count;
 	
-	p_ips->response_count = p_ips->response_count + 1;
-	if(p_ips->response_count >= 0xff)
+	// only taken when the notification is queued, a retry after NRF_ERROR_RESOURCES sends the same count
+	response_count = p_ips->response_count + 1;
+	if(response_count >= 0xff)
 	{
-		p_ips->response_count = 0;
+		response_count = 0;
 	}
 	blcm_link_ctx_get(p_ips->p_link_ctx_storage, p_ips->conn_handle, (void *) &p_client);
 	
@@ -476,9 +493,9 @@ uint32_t ble_ips_response_cnt_notify(ble_ips_t *p_ips)
 	//set response count gatt value for reading by client
 	// Initialize value struct.
 	memset(&gatts_value, 0, sizeof(gatts_value));
-	gatts_value.len 	= sizeof(p_ips->response_count);
+	gatts_value.len 	= sizeof(response_count);
 	gatts_value.offset	= 0;
-	gatts_value.p_value = &p_ips->response_count;
+	gatts_value.p_value = &response_count;
 	// Update database.
 	err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID,
 									  p_ips->res_cnt_char_handles.value_handle,
@@ -491,9 +508,9 @@ uint32_t ble_ips_response_cnt_notify(ble_ips_t *p_ips)
 
 	memset(&hvx_params, 0, sizeof(hvx_params));
 	
-	hvx_len = sizeof(p_ips->response_count);
+	hvx_len = sizeof(response_count);
 	hvx_params.handle = p_ips->res_cnt_char_handles.value_handle;
-	hvx_params.p_data = &p_ips->response_count;
+	hvx_params.p_data = &response_count;
 	hvx_params.p_len  = &hvx_len;
 	hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
 
@@ -504,6 +521,7 @@ uint32_t ble_ips_response_cnt_notify(ble_ips_t *p_ips)
 		KIT_LOG(TAG, "Resp cnt, notify failed: 0x%02x!", err_code);
 		return err_code;
 	}
+	p_ips->response_count = response_count;
 	KIT_LOG(TAG, "Respo cnt, notify OK: 0x%02x!", p_ips->response_count);
 
 	return err_code;
@@ -566,6 +584,7 @@ uint32_t ble_ips_init(ble_ips_t * p_ips, ble_ips_init_t const * p_ips_init, uint
     ble_uuid128_t         ips_char_cus_name_uuid 	= IPS_CHAR_CUS_NAME_UUID;
     ble_uuid128_t         ips_char_fw_ver_uuid 		= IPS_CHAR_FW_VER_UUID;
     ble_uuid128_t         ips_char_led_mode_uuid 	= IPS_CHAR_LED_MODE_UUID;
+    ble_uuid128_t         ips_char_data_no_rsp_uuid = IPS_CHAR_DATA_NO_RSP_UUID;
     ble_add_char_params_t add_char_params;
 	ble_add_char_user_desc_t add_char_user_desc;
 
@@ -746,9 +765,31 @@ uint32_t ble_ips_init(ble_ips_t * p_ips, ble_ips_init_t const * p_ips_init, uint
     {
         return err_code;
     }
+	
+	// Add the Data No Response Characteristic, [seq][command] without the write response round trip.
+    char data_no_rsp_desc[] = DATA_NO_RSP_CHAR_DESC_NAME;
+	uint8_t data_no_rsp_init_value = 0;
+	
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    memset(&add_char_user_desc, 0, sizeof(add_char_user_desc));
+	add_char_params.p_user_descr = &add_char_user_desc;
+    add_char_params.uuid                 = BLE_UUID_DATA_NO_RSP_CHAR;
+    add_char_params.max_len              = BLE_IPS_MAX_DATA_NO_RSP_CHAR_LEN;
+    add_char_params.init_len             = sizeof(uint8_t);
+    add_char_params.p_init_value         = &data_no_rsp_init_value;
+    add_char_params.is_var_len           = true;
+    add_char_params.char_props.write_wo_resp = 1;
+	add_char_params.write_access		 = SEC_OPEN;
+	add_char_user_desc.p_char_user_desc  = (uint8_t *)data_no_rsp_desc;
+	add_char_user_desc.size 			 = strlen(data_no_rsp_desc);
+	add_char_user_desc.max_size 		 = strlen(data_no_rsp_desc);
+	add_char_user_desc.read_access       = SEC_OPEN;
 
-	app_timer_create(&timerTickTimer, APP_TIMER_MODE_REPEATED, ble_ips_timer_tick_handle);
-	app_timer_start(timerTickTimer, APP_TIMER_TICKS(BLE_TMR_TICK_ONE_MIN), p_ips);
+    err_code = user_128bit_uuid_characteristic_add(p_ips->service_handle, &add_char_params, &p_ips->data_no_rsp_char_handles, &ips_char_data_no_rsp_uuid);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
 
 	return NRF_SUCCESS;
 }
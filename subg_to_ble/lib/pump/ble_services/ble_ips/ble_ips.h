@@ -73,6 +73,7 @@ extern "C" {
 #define BLE_IPS_MAX_TMR_TICK_CHAR_LEN   (1 > BLE_IPS_MAX_DATA_LEN ? BLE_IPS_MAX_DATA_LEN : 1)	 /**< Maximum length of the RX Characteristic (in bytes). */
 #define BLE_IPS_MAX_CUS_NAME_CHAR_LEN   (30 > BLE_IPS_MAX_DATA_LEN ? BLE_IPS_MAX_DATA_LEN : 30)	 /**< Maximum length of the RX Characteristic (in bytes). */
 #define BLE_IPS_MAX_LED_MODE_CHAR_LEN   (1 > BLE_IPS_MAX_DATA_LEN ? BLE_IPS_MAX_DATA_LEN : 1)	 /**< Maximum length of the RX Characteristic (in bytes). */
+#define BLE_IPS_MAX_DATA_NO_RSP_CHAR_LEN (BLE_IPS_MAX_DATA_CHAR_LEN + 1)						 /**< Maximum length of the Data No Response Characteristic, sequence number plus command. */
 
 /**@brief   Nordic UART Service event types. */
 typedef enum
@@ -80,6 +81,9 @@ typedef enum
     BLE_IPS_EVT_DATA_RX,      					/**< Data received. */
 	BLE_IPS_EVT_CUS_NAME_RX,					/**< Data received. */
 	BLE_IPS_EVT_LED_MODE_RX,					/**< Data received. */
+	BLE_IPS_EVT_DATA_NO_RSP_RX,					/**< Command received by write without response, the first byte is a sequence number. */
+	BLE_IPS_EVT_TMR_TICK_ON,					/**< Timer tick notification enabled by the peer. */
+	BLE_IPS_EVT_TMR_TICK_OFF,					/**< Timer tick notification disabled by the peer. */
 } ble_ips_evt_type_t;
 
 
@@ -159,6 +163,7 @@ struct ble_ips_s
     ble_gatts_char_handles_t        cus_name_char_handles;  /**< Handles related to the TX characteristic (as provided by the SoftDevice). */
     ble_gatts_char_handles_t        fw_ver_char_handles;    /**< Handles related to the RX characteristic (as provided by the SoftDevice). */
     ble_gatts_char_handles_t        led_mode_char_handles;  /**< Handles related to the TX characteristic (as provided by the SoftDevice). */
+    ble_gatts_char_handles_t        data_no_rsp_char_handles; /**< Handles related to the data no response characteristic (as provided by the SoftDevice). */
     blcm_link_ctx_storage_t * const p_link_ctx_storage; 	/**< Pointer to link context storage with handles of all current connections and its context. */
     ble_ips_data_handler_t          data_handler;       	/**< Event handler to be called for handling received data. */
 };
@@ -206,6 +211,8 @@ uint32_t ble_ips_data_send(uint8_t *buf, int count, ble_ips_t *p_ips);
 
 uint32_t ble_ips_response_cnt_notify(ble_ips_t *p_ips);
 
+uint32_t ble_ips_timer_tick_notify(ble_ips_t *p_ips);
+
 #ifdef __cplusplus
 }
 #endif
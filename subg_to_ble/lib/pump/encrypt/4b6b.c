@@ -1,101 +1,140 @@
 #include <stdint.h>
 
-// Bit-field extraction macros, for uint8_t values only.
+#include "4b6b.h"
 
-#define HI(n, x)  ((x) >> (8 - (n)))
-#define LO(n, x)  ((x) & ((1 << (n)) - 1))
+// Each byte maps to two 6-bit symbols, high nibble first, packed into 12 bits.
+// Two lookups give the 24 bits of 3 output bytes.
 
-static const uint8_t encode_4b[16] = 
+static const uint16_t encode_8b[256] = 
 {
-	0x15, 0x31, 0x32, 0x23,
-	0x34, 0x25, 0x26, 0x16,
-	0x1A, 0x19, 0x2A, 0x0B,
-	0x2C, 0x0D, 0x0E, 0x1C,
+	0x555, 0x571, 0x572, 0x563, 0x574, 0x565, 0x566, 0x556,
+	0x55A, 0x559, 0x56A, 0x54B, 0x56C, 0x54D, 0x54E, 0x55C,
+	0xC55, 0xC71, 0xC72, 0xC63, 0xC74, 0xC65, 0xC66, 0xC56,
+	0xC5A, 0xC59, 0xC6A, 0xC4B, 0xC6C, 0xC4D, 0xC4E, 0xC5C,
+	0xC95, 0xCB1, 0xCB2, 0xCA3, 0xCB4, 0xCA5, 0xCA6, 0xC96,
+	0xC9A, 0xC99, 0xCAA, 0xC8B, 0xCAC, 0xC8D, 0xC8E, 0xC9C,
+	0x8D5, 0x8F1, 0x8F2, 0x8E3, 0x8F4, 0x8E5, 0x8E6, 0x8D6,
+	0x8DA, 0x8D9, 0x8EA, 0x8CB, 0x8EC, 0x8CD, 0x8CE, 0x8DC,
+	0xD15, 0xD31, 0xD32, 0xD23, 0xD34, 0xD25, 0xD26, 0xD16,
+	0xD1A, 0xD19, 0xD2A, 0xD0B, 0xD2C, 0xD0D, 0xD0E, 0xD1C,
+	0x955, 0x971, 0x972, 0x963, 0x974, 0x965, 0x966, 0x956,
+	0x95A, 0x959, 0x96A, 0x94B, 0x96C, 0x94D, 0x94E, 0x95C,
+	0x995, 0x9B1, 0x9B2, 0x9A3, 0x9B4, 0x9A5, 0x9A6, 0x996,
+	0x99A, 0x999, 0x9AA, 0x98B, 0x9AC, 0x98D, 0x98E, 0x99C,
+	0x595, 0x5B1, 0x5B2, 0x5A3, 0x5B4, 0x5A5, 0x5A6, 0x596,
+	0x59A, 0x599, 0x5AA, 0x58B, 0x5AC, 0x58D, 0x58E, 0x59C,
+	0x695, 0x6B1, 0x6B2, 0x6A3, 0x6B4, 0x6A5, 0x6A6, 0x696,
+	0x69A, 0x699, 0x6AA, 0x68B, 0x6AC, 0x68D, 0x68E, 0x69C,
+	0x655, 0x671, 0x672, 0x663, 0x674, 0x665, 0x666, 0x656,
+	0x65A, 0x659, 0x66A, 0x64B, 0x66C, 0x64D, 0x64E, 0x65C,
+	0xA95, 0xAB1, 0xAB2, 0xAA3, 0xAB4, 0xAA5, 0xAA6, 0xA96,
+	0xA9A, 0xA99, 0xAAA, 0xA8B, 0xAAC, 0xA8D, 0xA8E, 0xA9C,
+	0x2D5, 0x2F1, 0x2F2, 0x2E3, 0x2F4, 0x2E5, 0x2E6, 0x2D6,
+	0x2DA, 0x2D9, 0x2EA, 0x2CB, 0x2EC, 0x2CD, 0x2CE, 0x2DC,
+	0xB15, 0xB31, 0xB32, 0xB23, 0xB34, 0xB25, 0xB26, 0xB16,
+	0xB1A, 0xB19, 0xB2A, 0xB0B, 0xB2C, 0xB0D, 0xB0E, 0xB1C,
+	0x355, 0x371, 0x372, 0x363, 0x374, 0x365, 0x366, 0x356,
+	0x35A, 0x359, 0x36A, 0x34B, 0x36C, 0x34D, 0x34E, 0x35C,
+	0x395, 0x3B1, 0x3B2, 0x3A3, 0x3B4, 0x3A5, 0x3A6, 0x396,
+	0x39A, 0x399, 0x3AA, 0x38B, 0x3AC, 0x38D, 0x38E, 0x39C,
+	0x715, 0x731, 0x732, 0x723, 0x734, 0x725, 0x726, 0x716,
+	0x71A, 0x719, 0x72A, 0x70B, 0x72C, 0x70D, 0x70E, 0x71C,
 };
 
+uint16_t encode_4b6b_byte(uint8_t byte)
+{
+	return encode_8b[byte];
+}
+
 uint16_t encode_4b6b(const uint8_t *src, uint8_t *dst, uint16_t len)
 {
 	uint16_t i, n;
+	uint32_t w;
 
 	// 2 input bytes produce 3 output bytes.
-	for (i = 0, n = 0; i < len - 1; i += 2, n += 3) 
+	for (i = 0, n = 0; i + 1 < len; i += 2, n += 3) 
 	{
-		uint8_t x = src[i], y = src[i + 1];
+		w = ((uint32_t)encode_8b[src[i]] << 12) | encode_8b[src[i + 1]];
 
-		uint8_t a = encode_4b[HI(4, x)], b = encode_4b[LO(4, x)];
-		uint8_t c = encode_4b[HI(4, y)], d = encode_4b[LO(4, y)];
-
-		dst[n] = (a << 2) | HI(4, b);
-		dst[n + 1] = (LO(4, b) << 4) | HI(6, c);
-		dst[n + 2] = (LO(2, c) << 6) | d;
+		dst[n] = (uint8_t)(w >> 16);
+		dst[n + 1] = (uint8_t)(w >> 8);
+		dst[n + 2] = (uint8_t)w;
 	}
 	// Odd final input byte, if any, produces 2 output bytes.
-	if (i == len - 1) 
+	if (i < len) 
 	{
-		uint8_t x = src[i];
-
-		uint8_t a = encode_4b[HI(4, x)], b = encode_4b[LO(4, x)];
+		w = encode_8b[src[i]];
 
-		dst[n++] = (a << 2) | HI(4, b);
-		dst[n++] = (LO(4, b) << 4) | 0x00;//0x05	// pad
+		dst[n++] = (uint8_t)(w >> 4);
+		dst[n++] = (uint8_t)(w << 4);	// low nibble padded with 0
 	}
 	return n;
 }
 
-// Inverse of encode_4b table, with 0xFF indicating an undefined value.
+// Inverse of the 6-bit symbols, already shifted into the high/low nibble of
+// the decoded byte. Bit 8 is set for an undefined symbol, so one OR of the two
+// halves gives the byte and its validity.
 
-static const uint8_t decode_6b[64] = 
+static const uint16_t decode_6b_hi[64] = 
 {
-	/* 0x00 */ 0xFF, /* 0x01 */ 0xFF, /* 0x02 */ 0xFF, /* 0x03 */ 0xFF,
-	/* 0x04 */ 0xFF, /* 0x05 */ 0xFF, /* 0x06 */ 0xFF, /* 0x07 */ 0xFF,
-	/* 0x08 */ 0xFF, /* 0x09 */ 0xFF, /* 0x0A */ 0xFF, /* 0x0B */ 0x0B,
-	/* 0x0C */ 0xFF, /* 0x0D */ 0x0D, /* 0x0E */ 0x0E, /* 0x0F */ 0xFF,
-	/* 0x10 */ 0xFF, /* 0x11 */ 0xFF, /* 0x12 */ 0xFF, /* 0x13 */ 0xFF,
-	/* 0x14 */ 0xFF, /* 0x15 */ 0x00, /* 0x16 */ 0x07, /* 0x17 */ 0xFF,
-	/* 0x18 */ 0xFF, /* 0x19 */ 0x09, /* 0x1A */ 0x08, /* 0x1B */ 0xFF,
-	/* 0x1C */ 0x0F, /* 0x1D */ 0xFF, /* 0x1E */ 0xFF, /* 0x1F */ 0xFF,
-	/* 0x20 */ 0xFF, /* 0x21 */ 0xFF, /* 0x22 */ 0xFF, /* 0x23 */ 0x03,
-	/* 0x24 */ 0xFF, /* 0x25 */ 0x05, /* 0x26 */ 0x06, /* 0x27 */ 0xFF,
-	/* 0x28 */ 0xFF, /* 0x29 */ 0xFF, /* 0x2A */ 0x0A, /* 0x2B */ 0xFF,
-	/* 0x2C */ 0x0C, /* 0x2D */ 0xFF, /* 0x2E */ 0xFF, /* 0x2F */ 0xFF,
-	/* 0x30 */ 0xFF, /* 0x31 */ 0x01, /* 0x32 */ 0x02, /* 0x33 */ 0xFF,
-	/* 0x34 */ 0x04, /* 0x35 */ 0xFF, /* 0x36 */ 0xFF, /* 0x37 */ 0xFF,
-	/* 0x38 */ 0xFF, /* 0x39 */ 0xFF, /* 0x3A */ 0xFF, /* 0x3B */ 0xFF,
-	/* 0x3C */ 0xFF, /* 0x3D */ 0xFF, /* 0x3E */ 0xFF, /* 0x3F */ 0xFF,
+	0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100,
+	0x100, 0x100, 0x100, 0x0B0, 0x100, 0x0D0, 0x0E0, 0x100,
+	0x100, 0x100, 0x100, 0x100, 0x100, 0x000, 0x070, 0x100,
+	0x100, 0x090, 0x080, 0x100, 0x0F0, 0x100, 0x100, 0x100,
+	0x100, 0x100, 0x100, 0x030, 0x100, 0x050, 0x060, 0x100,
+	0x100, 0x100, 0x0A0, 0x100, 0x0C0, 0x100, 0x100, 0x100,
+	0x100, 0x010, 0x020, 0x100, 0x040, 0x100, 0x100, 0x100,
+	0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100,
 };
 
+static const uint16_t decode_6b_lo[64] = 
+{
+	0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100,
+	0x100, 0x100, 0x100, 0x00B, 0x100, 0x00D, 0x00E, 0x100,
+	0x100, 0x100, 0x100, 0x100, 0x100, 0x000, 0x007, 0x100,
+	0x100, 0x009, 0x008, 0x100, 0x00F, 0x100, 0x100, 0x100,
+	0x100, 0x100, 0x100, 0x003, 0x100, 0x005, 0x006, 0x100,
+	0x100, 0x100, 0x00A, 0x100, 0x00C, 0x100, 0x100, 0x100,
+	0x100, 0x001, 0x002, 0x100, 0x004, 0x100, 0x100, 0x100,
+	0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100, 0x100,
+};
+
+uint16_t decode_4b6b_symbols(uint16_t symbols)
+{
+	return decode_6b_hi[(symbols >> 6) & 0x3F] | decode_6b_lo[symbols & 0x3F];
+}
+
 uint16_t decode_4b6b(const uint8_t *src, uint8_t *dst, uint16_t len)
 {
 	uint16_t i, n;
+	uint32_t w;
+	uint16_t a, b;
 
 	// 3 input bytes produce 2 output bytes.
-	for (i = 0, n = 0; i < len - 2; i += 3, n += 2) 
+	for (i = 0, n = 0; i + 2 < len; i += 3, n += 2) 
 	{
-		uint8_t x = src[i], y = src[i + 1], z = src[i + 2];
+		w = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
 
-		uint8_t a = decode_6b[HI(6, x)];
-		uint8_t b = decode_6b[(LO(2, x) << 4) | HI(4, y)];
-		uint8_t c = decode_6b[(LO(4, y) << 2) | HI(2, z)];
-		uint8_t d = decode_6b[LO(6, z)];
-		if (a == 0xFF || b == 0xFF || c == 0xFF || d == 0xFF)
+		a = decode_6b_hi[w >> 18] | decode_6b_lo[(w >> 12) & 0x3F];
+		b = decode_6b_hi[(w >> 6) & 0x3F] | decode_6b_lo[w & 0x3F];
+		if ((a | b) & DECODE_4B6B_INVALID)
 			return 0;
 
-		dst[n] = (a << 4) | b;
-		dst[n + 1] = (c << 4) | d;
+		dst[n] = (uint8_t)a;
+		dst[n + 1] = (uint8_t)b;
 	}
 	// Final 2 input bytes produce 1 output byte.
-	if (i == len - 2)
+	if (i + 2 == len)
 	{
-		uint8_t x = src[i], y = src[i + 1];
+		w = ((uint32_t)src[i] << 8) | src[i + 1];
 
-		uint8_t a = decode_6b[HI(6, x)];
-		uint8_t b = decode_6b[(LO(2, x) << 4) | HI(4, y)];
-		if (a == 0xFF || b == 0xFF)
+		a = decode_6b_hi[w >> 10] | decode_6b_lo[(w >> 4) & 0x3F];
+		if (a & DECODE_4B6B_INVALID)
 			return 0;
 
-		dst[n++] = (a << 4) | b;
+		dst[n++] = (uint8_t)a;
 	} 
-	else if (i == len - 1) 
+	else if (i + 1 == len) 
 	{
 		return 0;	// shouldn't happen
 	}
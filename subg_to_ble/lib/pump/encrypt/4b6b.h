@@ -6,6 +6,13 @@
 extern "C" {
 #endif
 
+// Set in the result of decode_4b6b_symbols() for an undefined symbol.
+#define DECODE_4B6B_INVALID	0x100
+
+// Return the two 6-bit symbols of one byte in the low 12 bits, 
+// first symbol to send in bits 11..6.
+uint16_t encode_4b6b_byte(uint8_t byte);
+
 // Encode bytes using 4b/6b encoding.
 // Encoding n bytes produces 3 * (n / 2) + 2 * (n % 2) output bytes.
 // Return number of bytes written to dst.
@@ -15,10 +22,14 @@ uint16_t encode_4b6b(const uint8_t *src, uint8_t *dst, uint16_t len);
 // Decode bytes using 4b/6b encoding.
 // Decoding n bytes produces 2 * (n / 3) + (n % 3) / 2 output bytes.
 // Return number of bytes written to dst if successful,
-// or -1 if invalid input was encountered.
+// or 0 if invalid input was encountered.
 
 uint16_t decode_4b6b(const uint8_t *src, uint8_t *dst, uint16_t len);
 
+// Decode the two 6-bit symbols in the low 12 bits of symbols.
+// Return the byte, with DECODE_4B6B_INVALID set if a symbol is undefined.
+uint16_t decode_4b6b_symbols(uint16_t symbols);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,219 @@
+/**
+ *@file encrypt_stream.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief 
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "encrypt_stream.h"
+#include "4b6b.h"
+#include "manchester.h"
+
+static bool stream_put(stEncryptStream_t *pStream, uint8_t byte)
+{
+	if(pStream->dstLen >= pStream->dstSize)
+	{
+		pStream->err = true;
+		return false;
+	}
+	pStream->pDst[pStream->dstLen++] = byte;
+	
+	return true;
+}
+
+static void stream_init(stEncryptStream_t *pStream, eEncryptType_t type, uint8_t *pDst, uint16_t dstSize)
+{
+	pStream->type = type;
+	pStream->pDst = pDst;
+	pStream->dstSize = dstSize;
+	pStream->dstLen = 0;
+	pStream->srcCnt = 0;
+	pStream->err = false;
+	pStream->bits = 0;
+	pStream->bitCnt = 0;
+}
+
+void encrypt_enc_init(stEncryptStream_t *pStream, eEncryptType_t type, uint8_t *pDst, uint16_t dstSize)
+{
+	stream_init(pStream, type, pDst, dstSize);
+}
+
+bool encrypt_enc_push(stEncryptStream_t *pStream, const uint8_t *pSrc, uint16_t len)
+{
+	uint16_t i;
+	uint16_t symbols;
+	
+	if(pStream->err)
+	{
+		return false;
+	}
+	
+	switch(pStream->type) 
+	{
+		case ENCRYPT_NONE:
+			if(len > pStream->dstSize - pStream->dstLen)
+			{
+				pStream->err = true;
+				return false;
+			}
+			memcpy(pStream->pDst + pStream->dstLen, pSrc, len);
+			pStream->dstLen += len;
+			break;
+			
+		case ENCRYPT_MANCHESTER:
+			for(i = 0; i < len; i++)
+			{
+				symbols = encode_manchester_byte(pSrc[i]);
+				if(!stream_put(pStream, (uint8_t)(symbols >> 8)) || !stream_put(pStream, (uint8_t)symbols))
+				{
+					return false;
+				}
+			}
+			break;
+
+		case ENCRYPT_4B6B:
+			for(i = 0; i < len; i++)
+			{
+				//12 bits in, one or two whole bytes out, at most 4 bits left over
+				pStream->bits = (pStream->bits << 12) | encode_4b6b_byte(pSrc[i]);
+				pStream->bitCnt += 12;
+				while(pStream->bitCnt >= 8)
+				{
+					pStream->bitCnt -= 8;
+					if(!stream_put(pStream, (uint8_t)(pStream->bits >> pStream->bitCnt)))
+					{
+						return false;
+					}
+				}
+			}
+			break;
+			
+		default:
+			pStream->err = true;
+			return false;
+	}
+	pStream->srcCnt += len;
+	
+	return true;
+}
+
+uint16_t encrypt_enc_finish(stEncryptStream_t *pStream)
+{
+	//odd byte count with 4b6b: last 4 bits padded with 0
+	if(pStream->type == ENCRYPT_4B6B && pStream->bitCnt > 0 && !pStream->err)
+	{
+		stream_put(pStream, (uint8_t)(pStream->bits << (8 - pStream->bitCnt)));
+		pStream->bitCnt = 0;
+	}
+	
+	return pStream->err ? 0 : pStream->dstLen;
+}
+
+void encrypt_dec_init(stEncryptStream_t *pStream, eEncryptType_t type, uint8_t *pDst, uint16_t dstSize)
+{
+	stream_init(pStream, type, pDst, dstSize);
+	manchester_dec_init(&pStream->manchester);
+}
+
+bool encrypt_dec_push(stEncryptStream_t *pStream, const uint8_t *pSrc, uint16_t len)
+{
+	uint16_t i;
+	uint16_t byte;
+	uint8_t decoded;
+	
+	if(pStream->err)
+	{
+		return false;
+	}
+	
+	switch(pStream->type) 
+	{
+		case ENCRYPT_NONE:
+			if(len > pStream->dstSize - pStream->dstLen)
+			{
+				pStream->err = true;
+				return false;
+			}
+			memcpy(pStream->pDst + pStream->dstLen, pSrc, len);
+			pStream->dstLen += len;
+			break;
+			
+		case ENCRYPT_MANCHESTER:
+			for(i = 0; i < len; i++)
+			{
+				switch(manchester_dec_push(&pStream->manchester, pSrc[i], &decoded))
+				{
+					case MANCHESTER_DEC_BYTE:
+						if(!stream_put(pStream, decoded))
+						{
+							return false;
+						}
+						break;
+						
+					case MANCHESTER_DEC_INVALID:
+						pStream->err = true;
+						return false;
+						
+					default:
+						break;
+				}
+			}
+			break;
+
+		case ENCRYPT_4B6B:
+			for(i = 0; i < len; i++)
+			{
+				//8 bits in, a byte out whenever two 6-bit symbols are complete
+				pStream->bits = (pStream->bits << 8) | pSrc[i];
+				pStream->bitCnt += 8;
+				if(pStream->bitCnt >= 12)
+				{
+					pStream->bitCnt -= 12;
+					byte = decode_4b6b_symbols((uint16_t)(pStream->bits >> pStream->bitCnt));
+					if((byte & DECODE_4B6B_INVALID) || !stream_put(pStream, (uint8_t)byte))
+					{
+						pStream->err = true;
+						return false;
+					}
+				}
+			}
+			break;
+			
+		default:
+			pStream->err = true;
+			return false;
+	}
+	pStream->srcCnt += len;
+	
+	return true;
+}
+
+uint16_t encrypt_dec_finish(stEncryptStream_t *pStream)
+{
+	switch(pStream->type) 
+	{
+		case ENCRYPT_MANCHESTER:
+			return pStream->dstLen;
+			
+		case ENCRYPT_4B6B:
+			//3n + 1 input bytes cannot come from the encoder
+			if(pStream->err || (pStream->srcCnt % 3) == 1)
+			{
+				return 0;
+			}
+			return pStream->dstLen;
+			
+		default:
+			return pStream->err ? 0 : pStream->dstLen;
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ *@file encrypt_stream.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief 
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __ENCRYPT_STREAM_H__
+#define __ENCRYPT_STREAM_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "manchester.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum 
+{
+	ENCRYPT_NONE = 0,
+	ENCRYPT_MANCHESTER = 1,
+	ENCRYPT_4B6B = 2,
+}eEncryptType_t;
+
+typedef struct
+{
+	eEncryptType_t type;
+	uint8_t  *pDst;
+	uint16_t dstSize;
+	uint16_t dstLen;
+	uint16_t srcCnt;
+	bool     err;//invalid input or dst full, nothing more is written
+	uint32_t bits;//4b6b bit accumulator
+	uint8_t  bitCnt;
+	stManchesterDec_t manchester;
+}stEncryptStream_t;
+
+//Encoder: init, push the raw bytes in any number of pieces, finish.
+//Finish returns the encoded length, 0 if dst was too small.
+void encrypt_enc_init(stEncryptStream_t *pStream, eEncryptType_t type, uint8_t *pDst, uint16_t dstSize);
+bool encrypt_enc_push(stEncryptStream_t *pStream, const uint8_t *pSrc, uint16_t len);
+uint16_t encrypt_enc_finish(stEncryptStream_t *pStream);
+
+//Decoder: same calling sequence with received bytes. Finish returns the 
+//decoded length with the same result as decode_manchester()/decode_4b6b(): 
+//the valid prefix for MANCHESTER, 0 for any invalid 4B6B input.
+void encrypt_dec_init(stEncryptStream_t *pStream, eEncryptType_t type, uint8_t *pDst, uint16_t dstSize);
+bool encrypt_dec_push(stEncryptStream_t *pStream, const uint8_t *pSrc, uint16_t len);
+uint16_t encrypt_dec_finish(stEncryptStream_t *pStream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ENCRYPT_STREAM_H__ */
@@ -16,77 +16,156 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "manchester.h"
+
 #define MANCHESTER_ONE		0x01
 #define MANCHESTER_ZERO		0x02
 
+#define MANCHESTER_INVALID	0xFF
+
+//Encoded pair of a byte, high byte holds bits 7..4, low byte holds bits 3..0,
+//each bit as a 2-bit symbol (ONE or ZERO) starting from the LSB.
+static const uint16_t encodeTbl[256] =
+{
+	0xAAAA, 0xAAA9, 0xAAA6, 0xAAA5, 0xAA9A, 0xAA99, 0xAA96, 0xAA95,
+	0xAA6A, 0xAA69, 0xAA66, 0xAA65, 0xAA5A, 0xAA59, 0xAA56, 0xAA55,
+	0xA9AA, 0xA9A9, 0xA9A6, 0xA9A5, 0xA99A, 0xA999, 0xA996, 0xA995,
+	0xA96A, 0xA969, 0xA966, 0xA965, 0xA95A, 0xA959, 0xA956, 0xA955,
+	0xA6AA, 0xA6A9, 0xA6A6, 0xA6A5, 0xA69A, 0xA699, 0xA696, 0xA695,
+	0xA66A, 0xA669, 0xA666, 0xA665, 0xA65A, 0xA659, 0xA656, 0xA655,
+	0xA5AA, 0xA5A9, 0xA5A6, 0xA5A5, 0xA59A, 0xA599, 0xA596, 0xA595,
+	0xA56A, 0xA569, 0xA566, 0xA565, 0xA55A, 0xA559, 0xA556, 0xA555,
+	0x9AAA, 0x9AA9, 0x9AA6, 0x9AA5, 0x9A9A, 0x9A99, 0x9A96, 0x9A95,
+	0x9A6A, 0x9A69, 0x9A66, 0x9A65, 0x9A5A, 0x9A59, 0x9A56, 0x9A55,
+	0x99AA, 0x99A9, 0x99A6, 0x99A5, 0x999A, 0x9999, 0x9996, 0x9995,
+	0x996A, 0x9969, 0x9966, 0x9965, 0x995A, 0x9959, 0x9956, 0x9955,
+	0x96AA, 0x96A9, 0x96A6, 0x96A5, 0x969A, 0x9699, 0x9696, 0x9695,
+	0x966A, 0x9669, 0x9666, 0x9665, 0x965A, 0x9659, 0x9656, 0x9655,
+	0x95AA, 0x95A9, 0x95A6, 0x95A5, 0x959A, 0x9599, 0x9596, 0x9595,
+	0x956A, 0x9569, 0x9566, 0x9565, 0x955A, 0x9559, 0x9556, 0x9555,
+	0x6AAA, 0x6AA9, 0x6AA6, 0x6AA5, 0x6A9A, 0x6A99, 0x6A96, 0x6A95,
+	0x6A6A, 0x6A69, 0x6A66, 0x6A65, 0x6A5A, 0x6A59, 0x6A56, 0x6A55,
+	0x69AA, 0x69A9, 0x69A6, 0x69A5, 0x699A, 0x6999, 0x6996, 0x6995,
+	0x696A, 0x6969, 0x6966, 0x6965, 0x695A, 0x6959, 0x6956, 0x6955,
+	0x66AA, 0x66A9, 0x66A6, 0x66A5, 0x669A, 0x6699, 0x6696, 0x6695,
+	0x666A, 0x6669, 0x6666, 0x6665, 0x665A, 0x6659, 0x6656, 0x6655,
+	0x65AA, 0x65A9, 0x65A6, 0x65A5, 0x659A, 0x6599, 0x6596, 0x6595,
+	0x656A, 0x6569, 0x6566, 0x6565, 0x655A, 0x6559, 0x6556, 0x6555,
+	0x5AAA, 0x5AA9, 0x5AA6, 0x5AA5, 0x5A9A, 0x5A99, 0x5A96, 0x5A95,
+	0x5A6A, 0x5A69, 0x5A66, 0x5A65, 0x5A5A, 0x5A59, 0x5A56, 0x5A55,
+	0x59AA, 0x59A9, 0x59A6, 0x59A5, 0x599A, 0x5999, 0x5996, 0x5995,
+	0x596A, 0x5969, 0x5966, 0x5965, 0x595A, 0x5959, 0x5956, 0x5955,
+	0x56AA, 0x56A9, 0x56A6, 0x56A5, 0x569A, 0x5699, 0x5696, 0x5695,
+	0x566A, 0x5669, 0x5666, 0x5665, 0x565A, 0x5659, 0x5656, 0x5655,
+	0x55AA, 0x55A9, 0x55A6, 0x55A5, 0x559A, 0x5599, 0x5596, 0x5595,
+	0x556A, 0x5569, 0x5566, 0x5565, 0x555A, 0x5559, 0x5556, 0x5555,
+};
+
+//4 symbols of an encoded byte to the data nibble, MANCHESTER_INVALID if any 
+//symbol is neither ONE nor ZERO.
+static const uint8_t decodeTbl[256] =
+{
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x0E, 0xFF, 0xFF, 0x0D, 0x0C, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0B, 0x0A, 0xFF, 0xFF, 0x09, 0x08, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x06, 0xFF, 0xFF, 0x05, 0x04, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x03, 0x02, 0xFF, 0xFF, 0x01, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+uint16_t encode_manchester_byte(uint8_t byte)
+{
+	return encodeTbl[byte];
+}
+
 bool encode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len)
 {
 	uint16_t i = 0;
-	uint8_t j = 0;
+	uint16_t symbols;
 	
 	for(i = 0; i < len; i++)
 	{
-		dst[2 * i] = 0;
-		dst[2 * i + 1] = 0;
-		
-		for(j = 0; j < 8; j++)
-		{
-			if(j < 4)
-			{
-				dst[2 * i + 1] |= (((src[i] >> j) & 0x01) ? MANCHESTER_ONE : MANCHESTER_ZERO) << (j * 2);
-			}
-			else
-			{
-				dst[2 * i] |= (((src[i] >> j) & 0x01) ? MANCHESTER_ONE : MANCHESTER_ZERO) << (j * 2 - 8);
-			}
-		}
+		symbols = encodeTbl[src[i]];
+		dst[2 * i] = (uint8_t)(symbols >> 8);
+		dst[2 * i + 1] = (uint8_t)symbols;
 	}
 	return true;
 }
 
-uint16_t decode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len)
+uint16_t decode_manchester_ex(const uint8_t *src, uint8_t *dst, uint16_t len, uint16_t *pErrOffset)
 {
 	uint16_t i = 0;
-	uint8_t j = 0;
+	uint8_t hi;
+	uint8_t lo;
 	
-	for(i=0; i < len / 2; i++)
+	for(i = 0; i < len / 2; i++)
 	{
-		dst[i] = 0;
+		hi = decodeTbl[src[2 * i]];
+		lo = decodeTbl[src[2 * i + 1]];
 		
-		for(j = 0; j < 8; j++)
+		if((hi | lo) == MANCHESTER_INVALID)
 		{
-			if(j < 4)
-			{
-				if((src[2 * i + 1] >> (j * 2) & 0x03) == MANCHESTER_ZERO)
-				{
-					dst[i] |= 0x00 << j;
-				}
-				else if((src[2 * i + 1] >> (j * 2) & 0x03) == MANCHESTER_ONE)
-				{
-					dst[i] |= 0x01 << j;
-				}
-				else
-				{
-					return i;
-				}
-			}
-			else
+			if(pErrOffset != NULL)
 			{
-				if((src[2 * i] >> (j * 2 - 8) & 0x03) == MANCHESTER_ZERO)
-				{
-					dst[i] |= 0x00 << j;
-				}
-				else if((src[2 * i] >> (j * 2 - 8) & 0x03) == MANCHESTER_ONE)
-				{
-					dst[i] |= 0x01 << j;
-				}
-				else
-				{
-					return i;
-				}
+				*pErrOffset = (hi == MANCHESTER_INVALID) ? (2 * i) : (2 * i + 1);
 			}
+			return i;
 		}
+		dst[i] = (hi << 4) | lo;
+	}
+	
+	if(pErrOffset != NULL)
+	{
+		*pErrOffset = len;
 	}
 	return i;
 }
 
+uint16_t decode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len)
+{
+	return decode_manchester_ex(src, dst, len, NULL);
+}
+
+void manchester_dec_init(stManchesterDec_t *pDec)
+{
+	pDec->inCnt = 0;
+	pDec->hi = 0;
+	pDec->errOffset = MANCHESTER_NO_ERR;
+}
+
+eManchesterDecResult_t manchester_dec_push(stManchesterDec_t *pDec, uint8_t in, uint8_t *pOut)
+{
+	uint8_t nibble;
+	
+	if(pDec->errOffset != MANCHESTER_NO_ERR)
+	{
+		return MANCHESTER_DEC_INVALID;
+	}
+	
+	nibble = decodeTbl[in];
+	if(nibble == MANCHESTER_INVALID)
+	{
+		pDec->errOffset = pDec->inCnt;
+		return MANCHESTER_DEC_INVALID;
+	}
+	
+	//even offsets carry the high nibble, odd offsets complete the byte
+	if((pDec->inCnt++ & 0x01) == 0)
+	{
+		pDec->hi = nibble;
+		return MANCHESTER_DEC_PENDING;
+	}
+	
+	*pOut = (pDec->hi << 4) | nibble;
+	return MANCHESTER_DEC_BYTE;
+}
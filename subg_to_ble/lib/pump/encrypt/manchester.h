@@ -16,14 +16,42 @@
 #ifndef __MANCHESTER_H__
 #define __MANCHESTER_H__
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define MANCHESTER_NO_ERR	0xFFFF
+
+typedef enum
+{
+	MANCHESTER_DEC_PENDING = 0,//high nibble stored, byte not complete yet
+	MANCHESTER_DEC_BYTE,//a decoded byte was written to *pOut
+	MANCHESTER_DEC_INVALID//invalid symbol seen, the rest of the stream is ignored
+}eManchesterDecResult_t;
+
+typedef struct
+{
+	uint16_t inCnt;
+	uint16_t errOffset;//offset of the first invalid encoded byte, MANCHESTER_NO_ERR if none
+	uint8_t  hi;
+}stManchesterDec_t;
+
+//Return the 2 encoded bytes of one byte, first byte to send in the high 8 bits.
+uint16_t encode_manchester_byte(uint8_t byte);
 bool encode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len);
+
+//Return number of bytes decoded before the first invalid symbol, 
+//*pErrOffset gets its offset in src (len if all valid).
+uint16_t decode_manchester_ex(const uint8_t *src, uint8_t *dst, uint16_t len, uint16_t *pErrOffset);
 uint16_t decode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len);
 
+//Streaming decoder, fed one received byte at a time.
+void manchester_dec_init(stManchesterDec_t *pDec);
+eManchesterDecResult_t manchester_dec_push(stManchesterDec_t *pDec, uint8_t in, uint8_t *pOut);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,8 +23,10 @@
 #include "nrf_drv_timer.h"
 #include "nrf_fstorage.h"
 #include "nrf_fstorage_sd.h"
+#include "app_util_platform.h"
 #include "boards.h"
 #include "kit_log.h"
+#include "ocp.h"
 
 #define TAG "OCP"
 /*******************************************************************************
@@ -34,8 +36,60 @@
 const uint32_t flashProtectSet __attribute__((used, at(0x10001208))) = 0xFFFFFF00;
 #endif
 
+#define FLASH_ASYNC_OP_NUM		NRF_FSTORAGE_SD_QUEUE_SIZE
+
+typedef struct
+{
+	bool inUse;
+	pfnFlashDone_t pfnDone;
+	void *pContext;
+}stFlashOp_t;
+
+static stFlashOp_t flashOp[FLASH_ASYNC_OP_NUM];
+
+static stFlashOp_t* flash_op_get(pfnFlashDone_t pfnDone, void *pContext)
+{
+	stFlashOp_t *pOp = NULL;
+	uint8_t i;
+	
+	CRITICAL_REGION_ENTER();
+	for(i = 0; i < FLASH_ASYNC_OP_NUM; i++)
+	{
+		if(!flashOp[i].inUse)
+		{
+			pOp = &flashOp[i];
+			pOp->inUse = true;
+			pOp->pfnDone = pfnDone;
+			pOp->pContext = pContext;
+			break;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+	
+	return pOp;
+}
+
+static void flash_op_done(stFlashOp_t *pOp, bool success)
+{
+	pfnFlashDone_t pfnDone = pOp->pfnDone;
+	void *pContext = pOp->pContext;
+	
+	// free the slot first, the callback may queue the next operation
+	pOp->inUse = false;
+	if(pfnDone != NULL)
+	{
+		pfnDone(success, pContext);
+	}
+}
+
 static void flash_event_handle(nrf_fstorage_evt_t * pEvt)
 {
+	// operations of the async api carry their slot, the blocking api passes NULL
+	if(pEvt->p_param != NULL)
+	{
+		flash_op_done((stFlashOp_t *)pEvt->p_param, pEvt->result == NRF_SUCCESS);
+	}
+	
     if (pEvt->result != NRF_SUCCESS)
     {
         KIT_LOG(TAG, "--> Event received: ERROR while executing an fstorage operation.");
@@ -88,19 +142,74 @@ void Flash_Read(void* pDest, const uint32_t srcAddr, uint32_t len)
     memcpy((uint8_t*)pDest, (uint8_t*)srcAddr, len);
 }
 
-void Flash_Write(uint32_t pageAddr, void const * pData, uint32_t len)
+void Flash_ErasePage(uint32_t pageAddr)
 {
     uint32_t err = NRF_SUCCESS;
 
 	err = nrf_fstorage_erase(&fstorage, pageAddr, 1, NULL);
 	APP_ERROR_CHECK(err);
 	wait_flash_ready(&fstorage);
+}
+
+/* Program erased words only, addr and len must be word aligned */
+void Flash_Program(uint32_t addr, void const * pData, uint32_t len)
+{
+    uint32_t err = NRF_SUCCESS;
 
-	err = nrf_fstorage_write(&fstorage, pageAddr, pData, len, NULL);
+	err = nrf_fstorage_write(&fstorage, addr, pData, len, NULL);
 	APP_ERROR_CHECK(err);
 	wait_flash_ready(&fstorage);
 }
 
+void Flash_Write(uint32_t pageAddr, void const * pData, uint32_t len)
+{
+	Flash_ErasePage(pageAddr);
+	Flash_Program(pageAddr, pData, len);
+}
+
+/* Queue a page erase, pfnDone is called from the SoftDevice event context when it is done */
+bool Flash_EraseAsync(uint32_t pageAddr, pfnFlashDone_t pfnDone, void *pContext)
+{
+	stFlashOp_t *pOp = flash_op_get(pfnDone, pContext);
+	
+	if(pOp == NULL)
+	{
+		return false;
+	}
+	
+	if(nrf_fstorage_erase(&fstorage, pageAddr, 1, pOp) != NRF_SUCCESS)
+	{
+		pOp->inUse = false;
+		return false;
+	}
+	
+	return true;
+}
+
+/* Queue a program of erased words, pData must stay valid until pfnDone is called */
+bool Flash_WriteAsync(uint32_t addr, void const * pData, uint32_t len, pfnFlashDone_t pfnDone, void *pContext)
+{
+	stFlashOp_t *pOp = flash_op_get(pfnDone, pContext);
+	
+	if(pOp == NULL)
+	{
+		return false;
+	}
+	
+	if(nrf_fstorage_write(&fstorage, addr, pData, len, pOp) != NRF_SUCCESS)
+	{
+		pOp->inUse = false;
+		return false;
+	}
+	
+	return true;
+}
+
+bool Flash_IsBusy(void)
+{
+	return nrf_fstorage_is_busy(&fstorage);
+}
+
 void Flash_Init(void)
 {
 	uint32_t err = NRF_SUCCESS;
@@ -16,13 +16,21 @@
 #ifndef __OCP_H__
 #define __OCP_H__
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef void (*pfnFlashDone_t)(bool success, void *pContext);
+
 void Flash_Read(void* pDest, const uint32_t srcAddr, uint32_t len);
 void Flash_Write(uint32_t pageAddr, void const * pData, uint32_t len);
+void Flash_ErasePage(uint32_t pageAddr);
+void Flash_Program(uint32_t addr, void const * pData, uint32_t len);
+bool Flash_EraseAsync(uint32_t pageAddr, pfnFlashDone_t pfnDone, void *pContext);
+bool Flash_WriteAsync(uint32_t addr, void const * pData, uint32_t len, pfnFlashDone_t pfnDone, void *pContext);
+bool Flash_IsBusy(void);
 void Flash_Init(void);
 void wdt_feed(void *pContext);
 void Wdt_Init(void);
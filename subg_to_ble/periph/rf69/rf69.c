@@ -21,7 +21,11 @@
 #include "boards.h"
 #include "nrf_drv_spi.h"
 
-#define RF69_FSTEP 	61.03515625
+// Fstep = FXOSC / 2^19 = 32MHz / 2^19 = 15625 / 2^8 Hz, kept as a ratio so no float math is needed
+#define RF69_FSTEP_NUM	15625
+#define RF69_FSTEP_SHIFT	8
+
+#define RF69_FRF_INVALID	0xFFFFFFFF
 
 #define TAG	"RFM"
 
@@ -41,6 +45,8 @@ static nrf_drv_spi_config_t spiCfg =
 
 static eRf69Mode_t freq433DevMode = RF69_MODE_NONE;
 static eRf69Mode_t freq916n868DevMode = RF69_MODE_NONE;
+static uint32_t freq433DevFrf = RF69_FRF_INVALID;
+static uint32_t freq916n868DevFrf = RF69_FRF_INVALID;
 
 static uint8_t freq916CfgTbl[][2] =
 {
@@ -244,12 +250,12 @@ static void spi_write_reg(eRf69Dev_t dev, uint8_t addr, uint8_t value)
 
 static void spi_write_burst(eRf69Dev_t dev, uint8_t addr, const uint8_t *pData, uint16_t cnt)
 {
-	uint8_t txData[255];
+	uint8_t txAddr = addr | 0x80;
 
-	txData[0] = addr | 0x80;
-	memcpy(txData + 1, pData, cnt);
+	// NSS stays low across both transfers, so data is sent from the caller buffer without a copy
 	spi_select(dev);
-	nrf_drv_spi_transfer(&spiInst, txData, cnt + 1, NULL, 0);
+	nrf_drv_spi_transfer(&spiInst, &txAddr, 1, NULL, 0);
+	nrf_drv_spi_transfer(&spiInst, pData, cnt, NULL, 0);
 	spi_unselect(dev);
 }
 
@@ -298,36 +304,59 @@ void Rf69_SetMode(eRf69Dev_t dev, eRf69Mode_t newMode)
 }
 
 
+/*convert a frequency (in Hz) to the FRF register value, FRF = freqHz / Fstep*/
+uint32_t Rf69_FreqToFrf(uint32_t freqHz)
+{
+	//split the division so freqHz << 8 never overflows 32 bits
+	return ((freqHz / RF69_FSTEP_NUM) << RF69_FSTEP_SHIFT) 
+		+ (((freqHz % RF69_FSTEP_NUM) << RF69_FSTEP_SHIFT) / RF69_FSTEP_NUM);
+}
+
 /*return the frequency (in Hz)*/
 uint32_t Rf69_GetFreq(eRf69Dev_t dev)
 {
-	return RF69_FSTEP * (((uint32_t) spi_read_reg(dev, REG_FRFMSB) << 16)
-		+ ((uint16_t) spi_read_reg(dev, REG_FRFMID) << 8) + spi_read_reg(dev, REG_FRFLSB));
+	uint32_t frf;
+	
+	frf = ((uint32_t) spi_read_reg(dev, REG_FRFMSB) << 16)
+		+ ((uint16_t) spi_read_reg(dev, REG_FRFMID) << 8) + spi_read_reg(dev, REG_FRFLSB);
+	
+	return (frf >> RF69_FSTEP_SHIFT) * RF69_FSTEP_NUM 
+		+ (((frf & ((1 << RF69_FSTEP_SHIFT) - 1)) * RF69_FSTEP_NUM) >> RF69_FSTEP_SHIFT);
 }
 
-/*set the frequency (in Hz)*/
-void Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz)
+/*set the carrier frequency by FRF register value*/
+void Rf69_SetFrf(eRf69Dev_t dev, uint32_t frf)
 {
 	eRf69Mode_t oldMode;
-		
-	oldMode = (dev == RF69_DEV_FREQ433) ? freq433DevMode : freq916n868DevMode;
+	uint32_t *pLastFrf;
+	uint8_t frfBytes[3];
+	
+	pLastFrf = (dev == RF69_DEV_FREQ433) ? (&freq433DevFrf) : (&freq916n868DevFrf);
 	
-	if (oldMode == RF69_MODE_TX) 
+	if(frf == *pLastFrf)
 	{
-		Rf69_SetMode(dev, RF69_MODE_RX);
+		return;
 	}
 	
-	freqHz /= RF69_FSTEP;//divide down by FSTEP to get FRF
-	spi_write_reg(dev, REG_FRFMSB, freqHz >> 16);
-	spi_write_reg(dev, REG_FRFMID, freqHz >> 8);
-	spi_write_reg(dev, REG_FRFLSB, freqHz);
+	frfBytes[0] = (uint8_t)(frf >> 16);
+	frfBytes[1] = (uint8_t)(frf >> 8);
+	frfBytes[2] = (uint8_t)frf;
+	spi_write_burst(dev, REG_FRFMSB, frfBytes, sizeof(frfBytes));
+	*pLastFrf = frf;
 	
-	if (oldMode == RF69_MODE_RX) 
+	//the new FRF is taken on the LSB write, only a running RX/TX chain has to relock
+	oldMode = (dev == RF69_DEV_FREQ433) ? freq433DevMode : freq916n868DevMode;
+	if (oldMode == RF69_MODE_RX || oldMode == RF69_MODE_TX) 
 	{
 		Rf69_SetMode(dev, RF69_MODE_SYNTH);
+		Rf69_SetMode(dev, oldMode);
 	}
-	
-	Rf69_SetMode(dev, oldMode);
+}
+
+/*set the frequency (in Hz)*/
+void Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz)
+{
+	Rf69_SetFrf(dev, Rf69_FreqToFrf(freqHz));
 }
 
 /*
@@ -380,6 +409,12 @@ bool Rf69_IsFifoOverThreshold(eRf69Dev_t dev)
 	return (spi_read_reg(dev, REG_IRQFLAGS2) & RF_IRQFLAGS2_FIFOLEVEL);
 }
 
+// stays set until the FIFO is cleared, except in sleep mode
+bool Rf69_IsFifoOverrun(eRf69Dev_t dev) 
+{
+	return (spi_read_reg(dev, REG_IRQFLAGS2) & RF_IRQFLAGS2_FIFOOVERRUN);
+}
+
 void Rf69_ClearFifo(eRf69Dev_t dev) 
 {
 	spi_write_reg(dev, REG_IRQFLAGS2, RF_IRQFLAGS2_FIFOOVERRUN);
@@ -492,16 +527,19 @@ void Rf69_DevParaCfg(eRf69Dev_t dev, eRf69Freq_t freq)
 		case RF69_FREQ_916:
 			pCfgTbl = freq916CfgTbl;
 			freq916n868DevMode = RF69_MODE_STANDBY;
+			freq916n868DevFrf = RF69_FRF_INVALID;
 			break;
 			
 		case RF69_FREQ_433:
 			pCfgTbl = freq433CfgTbl;
 			freq433DevMode = RF69_MODE_STANDBY;
+			freq433DevFrf = RF69_FRF_INVALID;
 			break;
 			
 		case RF69_FREQ_868:
 			pCfgTbl = freq868CfgTbl;
 			freq916n868DevMode = RF69_MODE_STANDBY;
+			freq916n868DevFrf = RF69_FRF_INVALID;
 			break;
 			
 		default:
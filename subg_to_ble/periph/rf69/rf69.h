@@ -46,13 +46,16 @@ typedef enum
 }eRf69Freq_t;
 
 void Rf69_SetMode(eRf69Dev_t dev, eRf69Mode_t newMode);
+uint32_t Rf69_FreqToFrf(uint32_t freqHz);
 uint32_t Rf69_GetFreq(eRf69Dev_t dev);
+void Rf69_SetFrf(eRf69Dev_t dev, uint32_t frf);
 void Rf69_SetFreq(eRf69Dev_t dev, uint32_t freqHz);
 void Rf69_SetPowerLevel(eRf69Dev_t dev, uint8_t powerLevel);
 int16_t Rf69_ReadRssi(eRf69Dev_t dev, bool forceTrigger);
 bool Rf69_IsFifoEmpty(eRf69Dev_t dev);
 bool Rf69_IsFifoFull(eRf69Dev_t dev);
 bool Rf69_IsFifoOverThreshold(eRf69Dev_t dev);
+bool Rf69_IsFifoOverrun(eRf69Dev_t dev);
 void Rf69_ClearFifo(eRf69Dev_t dev);
 void Rf69_XmitByte(eRf69Dev_t dev, uint8_t data);
 void Rf69_XmitBuf(eRf69Dev_t dev, const uint8_t* pData, int len);
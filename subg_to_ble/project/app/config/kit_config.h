@@ -20,14 +20,14 @@
 extern "C" {
 #endif
 
-/* Memory size in heap */
-#define HEAP_SIZE                               (10 * 1024)
-
-/* Memory block size of heap */
-#define HEAP_BLOCK_SIZE                         (32)  	  						
-
-/* Memory block table size */
-#define HEAP_ALLOC_TABLE_SIZE                   (HEAP_SIZE / HEAP_BLOCK_SIZE) 	
+/* Block count of each heap size class (32/64/128/256 bytes), the 256 ones hold the BLE_NOTIFY_NODE_NUM largest responses */
+#define HEAP_POOL_32_CNT                        (8)
+#define HEAP_POOL_64_CNT                        (4)
+#define HEAP_POOL_128_CNT                       (4)
+#define HEAP_POOL_256_CNT                       (4)
+
+/* Check block bounds and double free in heap, costs 4 bytes per block */
+//#define HEAP_GUARD_SUPPORT
 
 //#define KIT_ASSERT_SUPPORT
 
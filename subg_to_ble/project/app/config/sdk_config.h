@@ -5499,7 +5499,7 @@
  
 
 #ifndef APP_TIMER_WITH_PROFILER
-#define APP_TIMER_WITH_PROFILER 0
+#define APP_TIMER_WITH_PROFILER 1
 #endif
 
 // <q> APP_TIMER_CONFIG_SWI_NUMBER  - Configure SWI instance used.
@@ -9886,9 +9886,18 @@
 #define NRF_SDH_BLE_GAP_DATA_LENGTH 251
 #endif
 
+// <q> BLE_MONITOR_LINK_ENABLED  - Second peripheral link for a read only monitoring client
+// <i> The SoftDevice needs more RAM for the second link, raise the IRAM1 start of the target to the
+// <i> "Monitor link needs RAM start" value logged at boot. Until then it boots with one link.
+// <i> The application side of the second link is about 150 bytes of RAM.
+
+#ifndef BLE_MONITOR_LINK_ENABLED
+#define BLE_MONITOR_LINK_ENABLED 0
+#endif
+
 // <o> NRF_SDH_BLE_PERIPHERAL_LINK_COUNT - Maximum number of peripheral links. 
 #ifndef NRF_SDH_BLE_PERIPHERAL_LINK_COUNT
-#define NRF_SDH_BLE_PERIPHERAL_LINK_COUNT 1
+#define NRF_SDH_BLE_PERIPHERAL_LINK_COUNT (1 + BLE_MONITOR_LINK_ENABLED)
 #endif
 
 // <o> NRF_SDH_BLE_CENTRAL_LINK_COUNT - Maximum number of central links. 
@@ -9900,7 +9909,7 @@
 // <i> Maximum number of total concurrent connections using the default configuration.
 
 #ifndef NRF_SDH_BLE_TOTAL_LINK_COUNT
-#define NRF_SDH_BLE_TOTAL_LINK_COUNT 1
+#define NRF_SDH_BLE_TOTAL_LINK_COUNT (1 + BLE_MONITOR_LINK_ENABLED)
 #endif
 
 // <o> NRF_SDH_BLE_GAP_EVENT_LENGTH - GAP event length. 
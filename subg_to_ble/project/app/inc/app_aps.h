@@ -25,6 +25,9 @@ void Aps_PutCmd(const uint8_t *pBuf, uint16_t len, int8_t rssi);
 void Aps_Init(void);
 void Aps_StartLoop(void);
 void Aps_StopLoop(void);
+uint32_t Aps_GetCmdStackMaxUsed(void);
+uint32_t Aps_GetCmdQueueMaxCnt(void);
+uint32_t Aps_GetScratchMaxUsed(void);
 
 #ifdef __cplusplus
 }
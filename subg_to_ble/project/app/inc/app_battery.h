@@ -23,9 +23,14 @@ extern "C" {
 #endif
 
 void Batt_Init(void);
+bool Batt_StartMeasure(void);
+void Batt_StartLoadMeasure(void);
 uint8_t Batt_GetLevel(void);
 bool Batt_IsLow(void);
 uint16_t Batt_GetVoltage(void);
+uint16_t Batt_GetLoadVoltage(void);
+uint16_t Batt_GetLoadMinVoltage(void);
+uint16_t Batt_GetDeferCnt(void);
 
 #ifdef __cplusplus
 }
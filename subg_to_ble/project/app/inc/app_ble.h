@@ -27,10 +27,75 @@ typedef enum
 	BLE_STATE_CONNECTED
 }eBleState_t;
 
+typedef enum 
+{
+	BLE_LINK_PRIMARY = 0,// the central sending pump commands
+	BLE_LINK_MONITOR,// read only, gets a copy of the traffic and statistics
+	BLE_LINK_STANDBY,// came in while the monitor slot was taken, gets nothing until it claims the primary
+	BLE_LINK_NUM
+}eBleLink_t;
+
+typedef enum 
+{
+	BLE_CONN_PROFILE_IDLE = 0,// long interval with slave latency
+	BLE_CONN_PROFILE_BURST,// short interval while commands arrive
+	BLE_CONN_PROFILE_NUM
+}eBleConnProfile_t;
+
+typedef enum 
+{
+	BLE_ADV_STAGE_DIRECTED = 0,// high duty directed to the last central
+	BLE_ADV_STAGE_FAST,
+	BLE_ADV_STAGE_SLOW// plus the slow ramp step
+}eBleAdvStage_t;
+
+typedef struct
+{
+	eBleConnProfile_t profile;// the one the granted interval falls in
+	uint16_t interval;// 1.25ms units
+	uint16_t latency;
+	uint32_t profileTime[BLE_CONN_PROFILE_NUM];// ms, all connections since boot
+	uint16_t updateCnt;// profile changes requested
+	uint16_t rateLimitCnt;// changes held back by the minimum gap
+	uint16_t rejectCnt;// burst profile refused by the central
+	uint8_t txPhy;// BLE_GAP_PHY_xxx of the current connection
+	uint8_t rxPhy;
+	uint16_t attMtu;
+	uint16_t dataLen;// link layer payload octets
+	uint16_t phyFailCnt;// 2M requests the central did not take
+	uint32_t cmdNoRspCnt;// commands by write without response
+	uint16_t cmdLostCnt;// sequence numbers skipped by them
+	uint16_t reconnectCnt;
+	uint32_t reconnectLast;// ms from disconnect to connect
+	uint32_t reconnectMax;
+	uint8_t reconnectStage;// eBleAdvStage_t the last reconnect came in
+}stBleLinkStat_t;
+
+typedef struct
+{
+	uint32_t sentCnt;
+	uint16_t dropCnt;// no free node, too long, not connected or refused by the stack
+	uint16_t busyCnt;// sends held back until HVN_TX_COMPLETE
+	uint16_t lastLatency;// ms from queueing to the stack accepting it
+	uint16_t maxLatency;
+	uint8_t depth;// responses waiting now
+	uint8_t maxDepth;
+	uint32_t hvnEvtCnt;// connection events that completed notifications
+	uint32_t hvnPktCnt;// notifications completed in them
+	uint8_t hvnPerEvtMax;
+	uint8_t eventLength;// connection event length in use, 1.25ms units
+	uint8_t hvnQueueSize;// SoftDevice notification queue in use
+	uint16_t tickCnt;// timer tick notifications sent
+	uint16_t tickSkipCnt;// ticks left out, a response was going out anyway
+}stBleNotifyStat_t;
+
 void Ble_Init(void);
 void Ble_IpsNotifyRespCntAndSendData(uint8_t *data, int len);
 eBleState_t Ble_GetState(void);
 void Ble_NusSendData(uint8_t *data, uint8_t len);
+void Ble_GetLinkStat(stBleLinkStat_t *pStat);
+void Ble_GetNotifyStat(stBleNotifyStat_t *pStat);
+void Ble_UpdateTickPeriod(void);
 
 #ifdef __cplusplus
 }
@@ -17,6 +17,7 @@ uint8_t* Cfg_GetAdvName(void);
 uint8_t Cfg_GetAdvNameLen(void);
 uint8_t Cfg_GetMotionData0(void);
 uint8_t Cfg_GetMotionData1(void);
+uint8_t Cfg_GetTickPeriod(void);
 void Cfg_Init(void);
 
 #ifdef __cplusplus
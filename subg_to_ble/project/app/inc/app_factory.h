@@ -15,6 +15,7 @@ void Fct_StartLoop(void);
 void Fct_StopLoop(void);
 void Fct_PutReq(const uint8_t *pBuf, uint16_t len);
 bool Fct_GetStatus(void);
+uint32_t Fct_GetReqQueueMaxCnt(void);
 
 #ifdef __cplusplus
 }
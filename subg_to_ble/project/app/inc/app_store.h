@@ -0,0 +1,56 @@
+/**
+ *@file app_store.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief 
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __APP_STORE_H__
+#define __APP_STORE_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STORE_REC_MAX_LEN		64// bounds the RAM buffer records are programmed from
+
+typedef enum
+{
+	STORE_KEY_LEGACY_PAGE0 = 0,// raw copy of the old fixed config layout
+	STORE_KEY_LEGACY_PAGE1,// raw copy of the old fixed SN layout
+	STORE_KEY_CFG_BLE,
+	STORE_KEY_CFG_MOTION,
+	STORE_KEY_SN,
+	STORE_KEY_RADIO_CAL,
+	STORE_KEY_CFG_TICK,
+	STORE_KEY_NUM
+}eStoreKey_t;
+
+typedef void (*pfnStoreDone_t)(eStoreKey_t key, bool success);
+
+void Store_Init(void);
+uint16_t Store_Read(eStoreKey_t key, void *pData, uint16_t size);
+bool Store_WriteAsync(eStoreKey_t key, const void *pData, uint16_t len);
+bool Store_Delete(eStoreKey_t key);
+bool Store_IsBusy(void);
+void Store_SetDoneHandler(pfnStoreDone_t pfnDone);
+uint32_t Store_GetFreeSize(void);
+uint32_t Store_GetGcCnt(void);
+uint32_t Store_GetFailCnt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -16,6 +16,7 @@
 #ifndef __APP_SUBG_H__
 #define __APP_SUBG_H__
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,11 +36,26 @@ typedef enum
 	SUBG_RX_INT
 }eSubgRxStatus_t;
 
+typedef struct
+{
+	uint16_t rxOverrunCnt;// rx FIFO overflowed, bytes were lost
+	uint16_t txUnderrunCnt;// tx FIFO ran empty before the frame was complete
+	uint16_t bleOverlapCnt;// tx started inside a BLE radio event, on the full FIFO
+	uint16_t blePrefillCnt;// tx FIFO topped up ahead of a BLE radio event
+}stSubgFifoStat_t;
+
+// Called for every received byte of a packet, in order.
+typedef void (*pfnSubgRxByte_t)(void *pContext, uint8_t byte);
+
 void Subg_SetMode(eSubgMode_t mode);
 eSubgMode_t Subg_GetMode(void);
+uint8_t *Subg_GetTxBuf(uint16_t *pSize);
 void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt); 
+void Subg_SendTxBuf(uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt); 
 eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint8_t *pRxLen, uint32_t timeout, uint8_t usePktLen); 
+eSubgRxStatus_t Subg_ListenPkt(pfnSubgRxByte_t pfnRxByte, void *pContext, uint8_t *pRxLen, uint32_t timeout, uint8_t usePktLen); 
 void Subg_SetFreq(uint32_t freqHz);
+void Subg_SetFrf(uint32_t frf);
 void Subg_CfgRf(void);
 void Subg_Init(void);
 int Subg_GetRssi(void); 
@@ -47,8 +63,10 @@ uint16_t Subg_GetRxPktCnt(void);
 uint16_t Subg_GetTxPktCnt(void); 
 void Subg_SetPreamble(uint16_t preamble); 
 void Subg_SetPktLen(uint8_t len); 
+bool Subg_IsIdleFor(uint32_t ms);
 void Subg_SetIntFlg(void);
 void Subg_ClrIntFlg(void);
+void Subg_GetFifoStat(stSubgFifoStat_t *pStat);
 //void Subg_Test(void);
 
 #ifdef __cplusplus
@@ -23,6 +23,10 @@ extern "C" {
 
 void Sys_Idle(void);
 void Sys_Init(void);
+uint32_t Sys_GetStackSize(void);
+uint32_t Sys_GetStackMaxUsed(void);
+void Sys_StackMark(void);
+uint32_t Sys_GetStackUsedSinceMark(void);
 
 #ifdef __cplusplus
 }
@@ -13,17 +13,36 @@
  *published by the Free Software Foundation.
  *
  */
+#include <stddef.h>
+
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "kit_fifo.h"
 #include "kit_log.h"
 #include "app_ble.h"
 #include "kit_delay.h"
 #include "kit_utils.h"
 #include "app_subg.h"
-#include "4b6b.h"
-#include "manchester.h"
-
-#define RILEY_LINK_FXOSC	(24000000)
+#include "encrypt_stream.h"
+#include "kit_arena.h"
+#include "app_sys.h"
+#include "app_store.h"
+
+// 1 logs the DWT cycle counts of the sw encode/decode, off in release builds
+#ifndef APS_CODEC_PROFILE
+#define APS_CODEC_PROFILE 0
+#endif
+
+#if APS_CODEC_PROFILE
+#include "nrf.h"
+#endif
+
+// CC111x: freq = FREQ * FXOSC / 2^16, FXOSC = 24MHz, so freq = FREQ * 46875 / 2^7
+// RF69:   freq = FRF * 32MHz / 2^19, so FRF = FREQ * 6 exactly
+#define CC111X_FREQ_MUL					46875
+#define CC111X_FREQ_SHIFT				7
+#define CC111X_FREQ_REG_LIMIT			((0xFFFFFFFFUL / CC111X_FREQ_MUL) << CC111X_FREQ_SHIFT)// the Hz value of a larger FREQ does not fit 32 bits
+#define CC111X_FREQ_REG_TO_FRF(reg)		((reg) * 6)
 
 #define MAX_868_FREQ		(870000000)
 #define MIN_868_FREQ		(866000000)
@@ -39,10 +58,18 @@
 #define SUBG_MAX_PKT_LEN				107// 4bit->6bit:(71*4+71*2)/4=106.5(71-byte long packet),and 433 max unencode len is 80 bytes
 
 #define APS_CMD_LOOP_TIME_MS   			10
-#define APS_CMD_QUEUE_SIZE				2// 2 = actually only one
+#define APS_CMD_QUEUE_SIZE				2// power of 2: one in process + one pending
 
 #define BLE_RESPONSE_MAX_LEN			150
 
+#define APS_RADIO_CAL_NUM				4// pumps remembered, most recently used first
+#define APS_PUMP_ID_LEN					4// first bytes of the sent packet: type and serial on MiniMed, pod address on Omnipod
+
+#define APS_SWEEP_MAX_STEPS				((BLE_RESPONSE_MAX_LEN - 1) / sizeof(stSweepResult_t))
+
+// per-command buffers: the response and the sweep results
+#define APS_SCRATCH_SIZE				(((BLE_RESPONSE_MAX_LEN + 3) & ~3) + ((APS_SWEEP_MAX_STEPS * sizeof(stSweepResult_t) + 3) & ~3))
+
 #define RESPONSE_CODE_RX_TIMEOUT 		0xaa
 #define RESPONSE_CODE_CMD_INTERRUPTED 	0xbb
 #define RESPONSE_CODE_SUCCESS 			0xdd
@@ -68,16 +95,11 @@ typedef enum
 	CMD_SET_SW_ENCODING = 0x0b,
 	CMD_SET_PREAMBLE    = 0x0c,
 	CMD_RESET_RADIO_CFG = 0x0d,
-	CMD_GET_STATISTICS  = 0x0e
+	CMD_GET_STATISTICS  = 0x0e,
+	CMD_FREQ_SWEEP      = 0x0f,
+	CMD_GET_RADIO_CAL   = 0x10
 }eCmdTypes_t;
 
-typedef enum 
-{
-	ENCRYPT_NONE = 0,
-	ENCRYPT_MANCHESTER = 1,
-	ENCRYPT_4B6B = 2,
-}eEncryptType_t;
-
 typedef struct 
 {
 	eCmdTypes_t	cmd;
@@ -129,10 +151,37 @@ typedef struct __attribute__((packed))
 	uint16_t  pktTxCnt;
 	uint16_t  crcFailCnt;
 	uint16_t  spiSyncFailCnt;
-	uint16_t  placeholder0;
-	uint16_t  placeholder1;
+	uint16_t  stackMaxUsed;
+	uint16_t  cmdStackMaxUsed;
 }stCmdGetStatisticsRespPkt_t;
 
+typedef struct __attribute__((packed)) 
+{
+	uint8_t  startFreqReg[3];// CC111x FREQ2/FREQ1/FREQ0
+	uint16_t freqStep;// in CC111x FREQ register units
+	uint8_t  stepCnt;
+	uint8_t  probeCnt;// send and listen times per step
+	uint32_t listenTimeout;
+	uint16_t preambleExtend;
+	uint8_t  sendPkt[];
+}stCmdFreqSweep_t;
+
+typedef struct __attribute__((packed)) 
+{
+	uint8_t successCnt;
+	uint8_t avgRssi;// cc111x format, 0 if nothing received
+}stSweepResult_t;
+
+// radio settings of the last successful exchange with a pump, kept in the store
+typedef struct __attribute__((packed)) 
+{
+	uint8_t pumpId[APS_PUMP_ID_LEN];
+	uint8_t freqReg[3];// CC111x FREQ2/FREQ1/FREQ0
+	uint8_t band;// eSubgMode_t
+	uint8_t encoding;// eEncryptType_t
+	uint8_t rssi;// cc111x format
+}stRadioCal_t;
+
 static stKitFifoStruct_t apsCmdQueue;
 static stApsReqPkt_t apsCmdBuf[APS_CMD_QUEUE_SIZE];
 static uint32_t apsCmdLoopCnt = 0;
@@ -140,6 +189,16 @@ static uint8_t subgFreqReg[3] = {0x12, 0x14, 0x83};
 static uint8_t usePktLen = 0;
 static eEncryptType_t encryptType = ENCRYPT_NONE;
 static bool apsLoopStart = false;
+static uint32_t apsScratchBuf[(APS_SCRATCH_SIZE + 3) / 4];
+static stKitArena_t apsScratch;
+static uint8_t *apsRespBuf = NULL;// [response code][response data], taken from apsScratch for each command
+static uint32_t cmdStackMaxUsed = 0;// deepest stack seen while a command ran, interrupts included
+static stRadioCal_t radioCal[APS_RADIO_CAL_NUM];// unused entries are all zero
+static bool radioCalLoadFlg = false;
+static bool radioCalApplyFlg = false;
+#if APS_CODEC_PROFILE
+static uint32_t decodeCycles = 0;
+#endif
 
 static bool encrypt_set(eEncryptType_t type) 
 {
@@ -158,70 +217,65 @@ static bool encrypt_set(eEncryptType_t type)
 	return true;
 }
 
-static uint16_t encrypt_encode(uint8_t *pSrc, uint8_t *pDst, uint16_t len) 
+static uint16_t encrypt_encode_to_tx(const uint8_t *pSrc, uint16_t len) 
 {
+	stEncryptStream_t encoder;
+	uint16_t txBufSize;
+	uint8_t *pTxBuf = Subg_GetTxBuf(&txBufSize);
 	uint16_t encodeLen = 0;
+#if APS_CODEC_PROFILE
+	uint32_t cycles = DWT->CYCCNT;
+#endif
 	
-	switch(encryptType) 
-	{
-		case ENCRYPT_NONE:
-			//KIT_LOG(TAG, "Encode type: NONE.");
-			memcpy(pDst, pSrc, len);
-			encodeLen = len;
-			break;
-			
-		case ENCRYPT_MANCHESTER:
-			//KIT_LOG(TAG, "Encode type: MANCHESTER.");
-			if(encode_manchester(pSrc, pDst, len))
-			{
-				encodeLen = len * 2;
-			}
-			break;
-
-		case ENCRYPT_4B6B:
-			//KIT_LOG(TAG, "Encode type: 4B6B.");
-			encodeLen = encode_4b6b(pSrc, pDst, len);			
-			break;
-			
-		default:
-			//KIT_LOG(TAG, "Encode: unknown encode type 0x%02X.", encryptType);
-			break;
-	}
+	encrypt_enc_init(&encoder, encryptType, pTxBuf, txBufSize);
+	encrypt_enc_push(&encoder, pSrc, len);
+	encodeLen = encrypt_enc_finish(&encoder);
 	
 	//KIT_LOG(TAG, "Encode len: %d.", encodeLen);
+#if APS_CODEC_PROFILE
+	cycles = DWT->CYCCNT - cycles;
+	KIT_LOG(TAG, "Encode %d bytes: %d cycles, %d cycles/byte.", len, cycles, len ? cycles / len : 0);
+#endif
 	
 	return encodeLen;
 }
 
-
-uint16_t encrypt_decode(uint8_t *pSrc, uint8_t *pDst, uint16_t len) 
+static void rx_decode_byte(void *pContext, uint8_t byte)
 {
-	uint16_t decodeLen = 0;
+#if APS_CODEC_PROFILE
+	uint32_t cycles = DWT->CYCCNT;
+#endif
 
-	switch(encryptType) 
-	{
-		case ENCRYPT_NONE:
-			//KIT_LOG(TAG, "Decode type: NONE.");
-			memcpy(pDst, pSrc, len);
-			decodeLen = len;
-			break;
-		
-		case ENCRYPT_MANCHESTER:
-			//KIT_LOG(TAG, "Decode type: MANCHESTER.");			
-			decodeLen = decode_manchester(pSrc, pDst, len);
-			break;
+	encrypt_dec_push((stEncryptStream_t *)pContext, &byte, 1);
+	
+#if APS_CODEC_PROFILE
+	decodeCycles += DWT->CYCCNT - cycles;
+#endif
+}
 
-		case ENCRYPT_4B6B:
-			//KIT_LOG(TAG, "Decode type: 4B6B.");
-			decodeLen = decode_4b6b(pSrc, pDst, len);
-			break;
-			
-		default:
-			//KIT_LOG(TAG, "Decode: unknown decode type 0x%02X.", encryptType);
-			break;
-	}
+// Received bytes are decoded as they arrive, straight into the packet field of the response.
+static eSubgRxStatus_t listen_and_decode(stEncryptStream_t *pDecoder, uint32_t timeout) 
+{
+	stSubgRespPkt_t *pResp = (stSubgRespPkt_t *)(apsRespBuf + 1);
+	uint8_t getPktLen = 0;
+	
+	encrypt_dec_init(pDecoder, encryptType, pResp->pkt, sizeof(pResp->pkt));
+#if APS_CODEC_PROFILE
+	decodeCycles = 0;
+#endif
+	
+	return Subg_ListenPkt(rx_decode_byte, pDecoder, &getPktLen, timeout, usePktLen);
+}
+
+static uint16_t listen_decode_finish(stEncryptStream_t *pDecoder) 
+{
+	uint16_t decodeLen = encrypt_dec_finish(pDecoder);
 	
 	//KIT_LOG(TAG, "Decode len: %d.", decodeLen);
+#if APS_CODEC_PROFILE
+	KIT_LOG(TAG, "Decode %d bytes: %d cycles, %d cycles/byte.", pDecoder->srcCnt, decodeCycles, 
+		pDecoder->srcCnt ? decodeCycles / pDecoder->srcCnt : 0);
+#endif
 	
 	return decodeLen;
 }
@@ -236,13 +290,9 @@ static void send_byte_to_ble(const uint8_t byte)
 
 static void send_bytes_to_ble(const uint8_t *pBytes, int len) 
 {
-	uint8_t sendBytes[BLE_RESPONSE_MAX_LEN] = {0};
-	uint16_t sendLen = 0;
-		
-	sendBytes[0] = RESPONSE_CODE_SUCCESS;
-	memcpy(sendBytes + 1, pBytes, len);
-	sendLen = len + 1;
-	Ble_IpsNotifyRespCntAndSendData(sendBytes, sendLen);
+	apsRespBuf[0] = RESPONSE_CODE_SUCCESS;
+	memcpy(apsRespBuf + 1, pBytes, len);
+	Ble_IpsNotifyRespCntAndSendData(apsRespBuf, len + 1);
 }
 
 static uint8_t  convert_rssi_to_cc111x(int rssi) 
@@ -255,6 +305,37 @@ static uint8_t  convert_rssi_to_cc111x(int rssi)
 	return cc111xRssi;
 }
 
+static void send_rx_result_to_ble(eSubgRxStatus_t result, stEncryptStream_t *pDecoder) 
+{
+	stSubgRespPkt_t *pResp = (stSubgRespPkt_t *)(apsRespBuf + 1);
+	uint16_t decodePktLen = 0;
+	
+	switch(result)
+	{
+		case SUBG_RX_OK:		
+			// The packet is already decoded in place, only the header is left to fill.
+			decodePktLen = listen_decode_finish(pDecoder);
+			apsRespBuf[0] = RESPONSE_CODE_SUCCESS;
+			pResp->rssi = convert_rssi_to_cc111x(Subg_GetRssi());
+			pResp->pktCnt = (uint8_t)(Subg_GetRxPktCnt() & 0xff);
+			Ble_IpsNotifyRespCntAndSendData(apsRespBuf, 1 + offsetof(stSubgRespPkt_t, pkt) + decodePktLen);
+			break;
+			
+		case SUBG_RX_TIMEOUT:
+			KIT_LOG(TAG, "Resp: rx timeout!");
+			send_byte_to_ble(RESPONSE_CODE_RX_TIMEOUT);
+			break;
+
+		case SUBG_RX_INT:
+			KIT_LOG(TAG, "Resp: rx interrupted!");
+			send_byte_to_ble(RESPONSE_CODE_CMD_INTERRUPTED);
+			break;
+			
+		default:
+			break;
+	}
+}
+
 static bool valid_freq_and_set_mode(uint32_t freq) 
 {
 	if (MIN_868_FREQ <= freq && freq <= MAX_868_FREQ) 
@@ -278,15 +359,26 @@ static bool valid_freq_and_set_mode(uint32_t freq)
 	return false;
 }
 
+static uint32_t freq_reg_to_hz(uint32_t regValue) 
+{
+	if(regValue >= CC111X_FREQ_REG_LIMIT)
+	{
+		return 0xFFFFFFFF;
+	}
+	
+	return (regValue >> CC111X_FREQ_SHIFT) * CC111X_FREQ_MUL 
+		+ (((regValue & ((1 << CC111X_FREQ_SHIFT) - 1)) * CC111X_FREQ_MUL) >> CC111X_FREQ_SHIFT);
+}
+
 static void check_and_set_freq(void) 
 {
 	uint32_t regValue = ((uint32_t)subgFreqReg[0] << 16) + ((uint32_t)subgFreqReg[1] << 8) + ((uint32_t)subgFreqReg[2]);
-	uint32_t freq = (uint32_t)(((uint64_t)regValue * RILEY_LINK_FXOSC) >> 16);
+	uint32_t freq = freq_reg_to_hz(regValue);
 	
 	if(valid_freq_and_set_mode(freq)) 
 	{
 		KIT_LOG(TAG, "Set freq to: %dHz.", freq);
-		Subg_SetFreq(freq);
+		Subg_SetFrf(CC111X_FREQ_REG_TO_FRF(regValue));
 	} 
 	else 
 	{
@@ -294,6 +386,86 @@ static void check_and_set_freq(void)
 	}
 }
 
+static bool radio_cal_valid(const stRadioCal_t *pCal)
+{
+	return pCal->freqReg[0] != 0 || pCal->freqReg[1] != 0 || pCal->freqReg[2] != 0;
+}
+
+// the store is ready only after the ble stack, so the table is loaded on the first connection
+static void radio_cal_load(void)
+{
+	if(radioCalLoadFlg)
+	{
+		return;
+	}
+	
+	radioCalLoadFlg = true;
+	if(Store_Read(STORE_KEY_RADIO_CAL, radioCal, sizeof(radioCal)) != sizeof(radioCal))
+	{
+		memset(radioCal, 0, sizeof(radioCal));
+	}
+}
+
+// Pre-apply the settings of the most recently used pump, the host may still override all of them.
+static void radio_cal_apply(void)
+{
+	const stRadioCal_t *pCal = &radioCal[0];
+	
+	if(!radio_cal_valid(pCal))
+	{
+		return;
+	}
+	
+	Subg_SetMode((eSubgMode_t)pCal->band);
+	Subg_CfgRf();
+	memcpy(subgFreqReg, pCal->freqReg, sizeof(subgFreqReg));
+	check_and_set_freq();
+	encrypt_set((eEncryptType_t)pCal->encoding);
+	KIT_LOG(TAG, "Radio cal applied: pump %02X%02X%02X%02X, band %d, encoding %d.", 
+		pCal->pumpId[0], pCal->pumpId[1], pCal->pumpId[2], pCal->pumpId[3], pCal->band, pCal->encoding);
+}
+
+// Called after a pump answered, only a changed pump or setting is written to flash.
+static void radio_cal_update(const uint8_t *pPumpId, uint8_t rssi)
+{
+	stRadioCal_t newCal[APS_RADIO_CAL_NUM];
+	stRadioCal_t cal;
+	uint8_t i;
+	
+	memcpy(cal.pumpId, pPumpId, APS_PUMP_ID_LEN);
+	memcpy(cal.freqReg, subgFreqReg, sizeof(cal.freqReg));
+	cal.band = (uint8_t)Subg_GetMode();
+	cal.encoding = (uint8_t)encryptType;
+	cal.rssi = rssi;
+	
+	if(memcmp(&radioCal[0], &cal, offsetof(stRadioCal_t, rssi)) == 0)
+	{
+		radioCal[0].rssi = rssi;
+		return;
+	}
+	
+	// the pump moves to the front, its older entry or the least recently used one drops out
+	newCal[0] = cal;
+	for(i = 0; i < APS_RADIO_CAL_NUM - 1; i++)
+	{
+		if(memcmp(radioCal[i].pumpId, pPumpId, APS_PUMP_ID_LEN) == 0)
+		{
+			break;
+		}
+		newCal[i + 1] = radioCal[i];
+	}
+	for(; i < APS_RADIO_CAL_NUM - 1; i++)
+	{
+		newCal[i + 1] = radioCal[i + 1];
+	}
+	
+	// the store may read the table from the flash event context
+	CRITICAL_REGION_ENTER();
+	memcpy(radioCal, newCal, sizeof(radioCal));
+	CRITICAL_REGION_EXIT();
+	Store_WriteAsync(STORE_KEY_RADIO_CAL, radioCal, sizeof(radioCal));
+}
+
 static void cmd_set_sw_encoding(const uint8_t *buf, uint16_t len) 
 {
 	if(encrypt_set((eEncryptType_t)buf[0]))
@@ -313,44 +485,15 @@ static void cmd_set_mode_reg(void)
 
 static void cmd_get_pkt(const uint8_t *pBuf) 
 {
-	uint8_t getPkt[SUBG_MAX_PKT_LEN] = {0};
-	uint8_t getPktLen = 0;
+	stEncryptStream_t decoder;
 	eSubgRxStatus_t result;
-	
-	stSubgRespPkt_t subgResp;
-	uint8_t decodePkt[SUBG_MAX_PKT_LEN] = {0};
-	uint16_t decodePktLen = 0;
 
 	stCmdGetPkt_t *p = (stCmdGetPkt_t *)pBuf;
 	Kit_ReverseFourBytes((uint32_t *)&p->listenTimeout);
 	KIT_LOG(TAG, "Listen timeout: %d.", p->listenTimeout);
 	
-	result = Subg_GetPkt(getPkt, &getPktLen, p->listenTimeout, usePktLen);
-	
-	switch(result)
-	{
-		case SUBG_RX_OK:		
-			subgResp.rssi = convert_rssi_to_cc111x(Subg_GetRssi());
-			subgResp.pktCnt = (uint8_t)(Subg_GetRxPktCnt() & 0xff);
-			Kit_PrintBytes(TAG, "Rx done:", (const uint8_t*)getPkt, getPktLen);
-			decodePktLen = encrypt_decode(getPkt, decodePkt, getPktLen);
-			memcpy(subgResp.pkt, decodePkt, decodePktLen);
-			send_bytes_to_ble((const uint8_t *)&subgResp, 2 + decodePktLen);
-			break;
-			
-		case SUBG_RX_TIMEOUT:
-			KIT_LOG(TAG, "Resp: rx timeout!");
-			send_byte_to_ble(RESPONSE_CODE_RX_TIMEOUT);
-			break;
-
-		case SUBG_RX_INT:
-			KIT_LOG(TAG, "Resp: rx interrupted!");
-			send_byte_to_ble(RESPONSE_CODE_CMD_INTERRUPTED);
-			break;
-			
-		default:
-			break;
-	}
+	result = listen_and_decode(&decoder, p->listenTimeout);
+	send_rx_result_to_ble(result, &decoder);
  }
 
 static void cmd_get_state(void) 
@@ -366,8 +509,7 @@ static void cmd_get_version(void)
 static void cmd_send_pkt(const uint8_t *pBuf, uint16_t len) 
 {
 	uint16_t sendPktLen = 0;
-	uint8_t encodePkt[SUBG_MAX_PKT_LEN] = {0};
-	uint8_t encodePktLen = 0;
+	uint16_t encodePktLen = 0;
 	
 	stCmdSendPkt_t *p = (stCmdSendPkt_t *)pBuf;
 
@@ -384,24 +526,19 @@ static void cmd_send_pkt(const uint8_t *pBuf, uint16_t len)
 		KIT_LOG(TAG, "Last byte is 0, len - 1.");
 	}
 
-	encodePktLen = encrypt_encode(p->sendPkt, encodePkt, sendPktLen);
-	Subg_SendPkt(encodePkt, encodePktLen, p->repeatCnt, p->repeatIntvl, p->preambleExtend);
+	encodePktLen = encrypt_encode_to_tx(p->sendPkt, sendPktLen);
+	Subg_SendTxBuf(encodePktLen, p->repeatCnt, p->repeatIntvl, p->preambleExtend);
 	send_byte_to_ble(RESPONSE_CODE_SUCCESS);
 }
 	
 static void cmd_send_and_listen(const uint8_t *pBuf, uint16_t len) 
 {
 	uint16_t sendPktLen = 0;
-	uint8_t encodePkt[SUBG_MAX_PKT_LEN] = {0};
-	uint8_t encodePktLen = 0;
+	uint16_t encodePktLen = 0;
+	uint16_t txBufSize;
 	
-	uint8_t getPkt[SUBG_MAX_PKT_LEN] = {0};
-	uint8_t getPktLen = 0;
+	stEncryptStream_t decoder;
 	eSubgRxStatus_t result;
-
-	stSubgRespPkt_t subgResp;
-	uint8_t decodePkt[SUBG_MAX_PKT_LEN] = {0};
-	uint16_t decodePktLen = 0;
 	
 	stCmdSendAndListen_t *p = (stCmdSendAndListen_t *)pBuf;
 	
@@ -420,44 +557,27 @@ static void cmd_send_and_listen(const uint8_t *pBuf, uint16_t len)
 		KIT_LOG(TAG, "Last byte is 0, len - 1.");
 	}
 
-	encodePktLen = encrypt_encode(p->sendPkt, encodePkt, sendPktLen);
+	encodePktLen = encrypt_encode_to_tx(p->sendPkt, sendPktLen);
 	
-	Kit_PrintBytes(TAG, "Send to subg:", (const uint8_t*)encodePkt, encodePktLen);
+	Kit_PrintBytes(TAG, "Send to subg:", (const uint8_t*)Subg_GetTxBuf(&txBufSize), encodePktLen);
 
-	Subg_SendPkt(encodePkt, encodePktLen, p->repeatCnt, p->repeatIntvl, p->preambleExtend);
-	result = Subg_GetPkt(getPkt, &getPktLen, p->listenTimeout, usePktLen);
+	// The encoded packet stays in the tx buffer, retries send it again as is.
+	Subg_SendTxBuf(encodePktLen, p->repeatCnt, p->repeatIntvl, p->preambleExtend);
+	result = listen_and_decode(&decoder, p->listenTimeout);
 
 	while(result == SUBG_RX_TIMEOUT && p->retryCnt > 0)
 	{
 		KIT_LOG(TAG, "Retry send and listen!", result);
-		Subg_SendPkt(encodePkt, encodePktLen, 0, p->repeatIntvl, p->preambleExtend);
-		result = Subg_GetPkt(getPkt, &getPktLen, p->listenTimeout, usePktLen);
+		Subg_SendTxBuf(encodePktLen, 0, p->repeatIntvl, p->preambleExtend);
+		result = listen_and_decode(&decoder, p->listenTimeout);
 		p->retryCnt--;
 	}	
 
-	switch(result)
+	send_rx_result_to_ble(result, &decoder);
+	
+	if(result == SUBG_RX_OK && sendPktLen >= APS_PUMP_ID_LEN)
 	{
-		case SUBG_RX_OK:		
-			subgResp.rssi = convert_rssi_to_cc111x(Subg_GetRssi());
-			subgResp.pktCnt = (uint8_t)(Subg_GetRxPktCnt() & 0xff);
-			Kit_PrintBytes(TAG, "Rx done:", (const uint8_t*)getPkt, getPktLen);
-			decodePktLen = encrypt_decode(getPkt, decodePkt, getPktLen);
-			memcpy(subgResp.pkt, decodePkt, decodePktLen);
-			send_bytes_to_ble((const uint8_t *)&subgResp, 2 + decodePktLen);
-			break;
-			
-		case SUBG_RX_TIMEOUT:
-			KIT_LOG(TAG, "Resp: rx timeout!");
-			send_byte_to_ble(RESPONSE_CODE_RX_TIMEOUT);
-			break;
-
-		case SUBG_RX_INT:
-			KIT_LOG(TAG, "Resp: rx interrupted!");
-			send_byte_to_ble(RESPONSE_CODE_CMD_INTERRUPTED);
-			break;
-			
-		default:
-			break;
+		radio_cal_update(p->sendPkt, convert_rssi_to_cc111x(Subg_GetRssi()));
 	}
 }
  
@@ -550,37 +670,187 @@ static void cmd_reset_radio_config(void)
 	send_byte_to_ble(RESPONSE_CODE_SUCCESS);
 }
 
+static void cmd_freq_sweep(const uint8_t *pBuf, uint16_t len) 
+{
+	uint16_t sendPktLen = 0;
+	uint16_t encodePktLen = 0;
+	
+	stEncryptStream_t decoder;
+	eSubgRxStatus_t result;
+	
+	stSweepResult_t *sweepResult;
+	eSubgMode_t sweepMode;
+	uint32_t startReg;
+	uint32_t regValue;
+	int32_t rssiSum;
+	uint8_t step;
+	uint8_t probe;
+	
+	stCmdFreqSweep_t *p = (stCmdFreqSweep_t *)pBuf;
+	
+	if(len < sizeof(stCmdFreqSweep_t))
+	{
+		send_byte_to_ble(RESPONSE_CODE_PARAM_ERROR);
+		return;
+	}
+	
+	Kit_ReverseTwoBytes((uint16_t *)&p->freqStep);
+	Kit_ReverseFourBytes((uint32_t *)&p->listenTimeout);
+	Kit_ReverseTwoBytes((uint16_t *)&p->preambleExtend);
+	
+	startReg = ((uint32_t)p->startFreqReg[0] << 16) + ((uint32_t)p->startFreqReg[1] << 8) + ((uint32_t)p->startFreqReg[2]);
+	sendPktLen = len - (p->sendPkt - (uint8_t *)p);
+	
+	KIT_LOG(TAG, "Sweep start reg: 0x%06X, step: %d, cnt: %d, probe cnt: %d.", startReg, p->freqStep, p->stepCnt, p->probeCnt);
+	
+	// The whole sweep must stay inside one band, so that one radio config serves all steps.
+	if(p->stepCnt == 0 || p->stepCnt > APS_SWEEP_MAX_STEPS || p->probeCnt == 0 || sendPktLen == 0 
+		|| !valid_freq_and_set_mode(freq_reg_to_hz(startReg + (uint32_t)p->freqStep * (p->stepCnt - 1))))
+	{
+		send_byte_to_ble(RESPONSE_CODE_PARAM_ERROR);
+		return;
+	}
+	sweepMode = Subg_GetMode();
+	
+	sweepResult = (stSweepResult_t *)Kit_ArenaAlloc(&apsScratch, p->stepCnt * sizeof(stSweepResult_t));
+	if(sweepResult == NULL)
+	{
+		check_and_set_freq();
+		send_byte_to_ble(RESPONSE_CODE_PARAM_ERROR);
+		return;
+	}
+	
+	if(!valid_freq_and_set_mode(freq_reg_to_hz(startReg)) || Subg_GetMode() != sweepMode)
+	{
+		check_and_set_freq();
+		send_byte_to_ble(RESPONSE_CODE_PARAM_ERROR);
+		return;
+	}
+	
+	if ((p->sendPkt[sendPktLen - 1] == 0) && (sweepMode != SUBG_MODE_OMNIPOD))
+	{
+		sendPktLen--;
+	}
+	encodePktLen = encrypt_encode_to_tx(p->sendPkt, sendPktLen);
+	
+	for(step = 0; step < p->stepCnt; step++)
+	{
+		regValue = startReg + (uint32_t)p->freqStep * step;
+		Subg_SetFrf(CC111X_FREQ_REG_TO_FRF(regValue));
+		
+		sweepResult[step].successCnt = 0;
+		sweepResult[step].avgRssi = 0;
+		rssiSum = 0;
+		
+		for(probe = 0; probe < p->probeCnt; probe++)
+		{
+			if(Ble_GetState() == BLE_STATE_ADV)
+			{
+				check_and_set_freq();
+				return;
+			}
+			
+			Subg_SendTxBuf(encodePktLen, 0, 0, p->preambleExtend);
+			result = listen_and_decode(&decoder, p->listenTimeout);
+			
+			if(result == SUBG_RX_INT)
+			{
+				KIT_LOG(TAG, "Resp: sweep interrupted!");
+				check_and_set_freq();
+				send_byte_to_ble(RESPONSE_CODE_CMD_INTERRUPTED);
+				return;
+			}
+			
+			if(result == SUBG_RX_OK && listen_decode_finish(&decoder) > 0)
+			{
+				sweepResult[step].successCnt++;
+				rssiSum += Subg_GetRssi();
+			}
+		}
+		
+		if(sweepResult[step].successCnt > 0)
+		{
+			sweepResult[step].avgRssi = convert_rssi_to_cc111x(rssiSum / sweepResult[step].successCnt);
+		}
+		KIT_LOG(TAG, "Sweep reg 0x%06X: %d/%d.", regValue, sweepResult[step].successCnt, p->probeCnt);
+	}
+	
+	// Leave the radio on the frequency the host configured.
+	check_and_set_freq();
+	send_bytes_to_ble((const uint8_t *)sweepResult, p->stepCnt * sizeof(stSweepResult_t));
+}
+
 static void cmd_get_statistics(void)
 {
 	stCmdGetStatisticsRespPkt_t statistics;
+	stSubgFifoStat_t fifoStat;
 
+	Subg_GetFifoStat(&fifoStat);
 	statistics.updTime = apsCmdLoopCnt * APS_CMD_LOOP_TIME_MS;
 	Kit_ReverseFourBytes((uint32_t *)&statistics.updTime);
 	statistics.rxOverflowCnt = 0;
-	statistics.rxFifoOverflowCnt = 0;
+	statistics.rxFifoOverflowCnt = fifoStat.rxOverrunCnt;
+	Kit_ReverseTwoBytes((uint16_t *)&statistics.rxFifoOverflowCnt);
 	statistics.pktRxCnt = Subg_GetRxPktCnt();
 	Kit_ReverseTwoBytes((uint16_t *)&statistics.pktRxCnt);
 	statistics.pktTxCnt = Subg_GetTxPktCnt();
 	Kit_ReverseTwoBytes((uint16_t *)&statistics.pktTxCnt);
 	statistics.crcFailCnt = 0;
 	statistics.spiSyncFailCnt = 0;
-	statistics.placeholder0 = 0; // Placeholder
-	statistics.placeholder1 = 0; // Placeholder
+	statistics.stackMaxUsed = Sys_GetStackMaxUsed();
+	Kit_ReverseTwoBytes((uint16_t *)&statistics.stackMaxUsed);
+	statistics.cmdStackMaxUsed = cmdStackMaxUsed;
+	Kit_ReverseTwoBytes((uint16_t *)&statistics.cmdStackMaxUsed);
 	send_bytes_to_ble((const uint8_t *)(&statistics), sizeof(statistics));
 }
 
+// [count][entries], all pumps or only the one whose id is given, entry 0 is pre-applied on connect
+static void cmd_get_radio_cal(const uint8_t *pBuf, uint16_t len)
+{
+	stRadioCal_t *pCal = (stRadioCal_t *)(apsRespBuf + 2);
+	uint8_t cnt = 0;
+	uint8_t i;
+	
+	if(len != 0 && len < APS_PUMP_ID_LEN)
+	{
+		send_byte_to_ble(RESPONSE_CODE_PARAM_ERROR);
+		return;
+	}
+	
+	for(i = 0; i < APS_RADIO_CAL_NUM; i++)
+	{
+		if(radio_cal_valid(&radioCal[i]) && (len == 0 || memcmp(radioCal[i].pumpId, pBuf, APS_PUMP_ID_LEN) == 0))
+		{
+			pCal[cnt++] = radioCal[i];
+		}
+	}
+	
+	apsRespBuf[0] = RESPONSE_CODE_SUCCESS;
+	apsRespBuf[1] = cnt;
+	Ble_IpsNotifyRespCntAndSendData(apsRespBuf, 2 + cnt * sizeof(stRadioCal_t));
+}
+
 static void aps_cmd_loop(void *pContext) 
 {
-	stApsReqPkt_t req;
+	stApsReqPkt_t *pReq;
 	
 	apsCmdLoopCnt++;
-	if(!Kit_FifoStructOut(&apsCmdQueue, (void *)&req, 1)) 
+	if(radioCalApplyFlg)
+	{
+		radioCalApplyFlg = false;
+		radio_cal_apply();
+	}
+	
+	pReq = (stApsReqPkt_t *)Kit_FifoStructPeek(&apsCmdQueue);
+	if(pReq == NULL) 
 	{
 		return;
 	}
+	apsRespBuf = (uint8_t *)Kit_ArenaAlloc(&apsScratch, BLE_RESPONSE_MAX_LEN);
+	Sys_StackMark();
 		
 	Subg_ClrIntFlg();
-	switch (req.cmd) 
+	switch (pReq->cmd) 
 	{
 		case CMD_GET_STATE:
 			KIT_LOG(TAG, "CMD_GET_STATE.");
@@ -594,22 +864,22 @@ static void aps_cmd_loop(void *pContext)
 			
 		case CMD_GET_PKT:
 			//KIT_LOG(TAG, "CMD_GET_PKT.");
-			cmd_get_pkt(req.pkt);
+			cmd_get_pkt(pReq->pkt);
 			break;
 			
 		case CMD_SEND_PKT:
 			//KIT_LOG(TAG, "CMD_SEND_PKT.");
-			cmd_send_pkt(req.pkt, req.pktLen);
+			cmd_send_pkt(pReq->pkt, pReq->pktLen);
 			break;
 			
 		case CMD_SEND_AND_LISTEN:
 			KIT_LOG(TAG, "CMD_SEND_AND_LISTEN.");
-			cmd_send_and_listen(req.pkt, req.pktLen);
+			cmd_send_and_listen(pReq->pkt, pReq->pktLen);
 			break;
 			
 		case CMD_UPDATE_REG:
 			//KIT_LOG(TAG, "CMD_UPDATE_REG.");
-			cmd_update_reg(req.pkt, req.pktLen);
+			cmd_update_reg(pReq->pkt, pReq->pktLen);
 			break;
 			
 		case CMD_LED:
@@ -619,7 +889,7 @@ static void aps_cmd_loop(void *pContext)
 			
 		case CMD_READ_REG:
 			KIT_LOG(TAG, "CMD_READ_REG.");
-			cmd_read_reg(req.pkt, req.pktLen);
+			cmd_read_reg(pReq->pkt, pReq->pktLen);
 			break;
 			
 		case CMD_SET_MODE_REG:
@@ -629,12 +899,12 @@ static void aps_cmd_loop(void *pContext)
 			
 		case CMD_SET_SW_ENCODING:
 			KIT_LOG(TAG, "CMD_SET_SW_ENCODING.");
-			cmd_set_sw_encoding(req.pkt, req.pktLen);
+			cmd_set_sw_encoding(pReq->pkt, pReq->pktLen);
 			break;
 			
 		case CMD_SET_PREAMBLE:
 			KIT_LOG(TAG, "CMD_SET_PREAMBLE.");
-			cmd_set_preamble(req.pkt, req.pktLen);
+			cmd_set_preamble(pReq->pkt, pReq->pktLen);
 			break;
 			
 		case CMD_RESET_RADIO_CFG:
@@ -646,11 +916,32 @@ static void aps_cmd_loop(void *pContext)
 			KIT_LOG(TAG, "CMD_GET_STATISTICS.");
 			cmd_get_statistics();
 			break;
+			
+		case CMD_FREQ_SWEEP:
+			KIT_LOG(TAG, "CMD_FREQ_SWEEP.");
+			cmd_freq_sweep(pReq->pkt, pReq->pktLen);
+			break;
+			
+		case CMD_GET_RADIO_CAL:
+			KIT_LOG(TAG, "CMD_GET_RADIO_CAL.");
+			cmd_get_radio_cal(pReq->pkt, pReq->pktLen);
+			break;
 
 		default:
-			KIT_LOG(TAG, "Unkown cmd 0x%02x.", req.cmd);
+			KIT_LOG(TAG, "Unkown cmd 0x%02x.", pReq->cmd);
 			break;
 	}
+	
+	// the request is used in place, free its slot only after it is done
+	Kit_FifoStructRelease(&apsCmdQueue);
+	Kit_ArenaReset(&apsScratch);
+	apsRespBuf = NULL;
+	
+	if(Sys_GetStackUsedSinceMark() > cmdStackMaxUsed)
+	{
+		cmdStackMaxUsed = Sys_GetStackUsedSinceMark();
+		KIT_LOG(TAG, "Cmd stack max used: %d bytes, scratch max used: %d bytes.", cmdStackMaxUsed, Kit_ArenaMaxUsed(&apsScratch));
+	}
 }
 
 void Aps_PutCmd(const uint8_t *pBuf, uint16_t len, int8_t rssi) 
@@ -675,27 +966,53 @@ void Aps_PutCmd(const uint8_t *pBuf, uint16_t len, int8_t rssi)
 		return;
 	}
 	
-	stApsReqPkt_t req = 
+	if (len - 2 > APS_MAX_PARA_LEN + SUBG_MAX_PKT_LEN) 
 	{
-		.cmd = cmd,
-		.pktLen = len - 2,
-		.rssi = rssi,
-	};
-	memcpy(req.pkt, pBuf + 2, req.pktLen);
+		KIT_LOG(TAG, "Cmd 0x%02x too long: %d bytes, dropped!", cmd, len - 2);
+		return;
+	}
 	
-	if(!Kit_FifoStructIn(&apsCmdQueue, (void*)&req, 1)) 
+	stApsReqPkt_t *pReq = (stApsReqPkt_t *)Kit_FifoStructReserve(&apsCmdQueue);
+	if(pReq == NULL) 
 	{
 		KIT_LOG(TAG, "Cannot queue cmd 0x%02x.", cmd);
 		return;
 	}
 	
+	pReq->cmd = cmd;
+	pReq->pktLen = len - 2;
+	pReq->rssi = rssi;
+	memcpy(pReq->pkt, pBuf + 2, pReq->pktLen);
+	Kit_FifoStructCommit(&apsCmdQueue);
+	
 	Subg_SetIntFlg();	
 }
 
+uint32_t Aps_GetCmdStackMaxUsed(void)
+{
+	return cmdStackMaxUsed;
+}
+
+uint32_t Aps_GetCmdQueueMaxCnt(void)
+{
+	return Kit_FifoStructMaxCntGet(&apsCmdQueue);
+}
+
+uint32_t Aps_GetScratchMaxUsed(void)
+{
+	return Kit_ArenaMaxUsed(&apsScratch);
+}
+
 void Aps_Init(void)
 {
 	Kit_FifoStructCreate(&apsCmdQueue, (void*)apsCmdBuf, sizeof(apsCmdBuf), sizeof(stApsReqPkt_t));
+	Kit_ArenaInit(&apsScratch, apsScratchBuf, sizeof(apsScratchBuf));
 	app_timer_create(&apsCmdLoopTimer, APP_TIMER_MODE_REPEATED, aps_cmd_loop);
+#if APS_CODEC_PROFILE
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
 	KIT_LOG(TAG, "Init OK!");
 }
 
@@ -704,6 +1021,8 @@ void Aps_StartLoop(void)
 	if(!apsLoopStart)
 	{
 		apsLoopStart = true;
+		radio_cal_load();
+		radioCalApplyFlg = true;
 		app_timer_start(apsCmdLoopTimer, APP_TIMER_TICKS(APS_CMD_LOOP_TIME_MS), NULL);
 		KIT_LOG(TAG, "Loop start!");
 	}
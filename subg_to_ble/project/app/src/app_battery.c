@@ -16,97 +16,82 @@
 #include <stdbool.h>
 
 #include "nrfx_saadc.h"
-#include "kit_delay.h"
 #include "kit_log.h"
 #include "app_timer.h"
 #include "boards.h"
 #include "nrf_gpio.h"
 #include "app_indication.h"
 #include "app_ble.h"
+#include "app_battery.h"
+#include "app_subg.h"
 
 #define BAT_MAX_VOLTAGE 	3200//mv
-#define BAT_ADC_MAX_VALUE 	700
+#define BAT_ADC_MAX_VALUE 	700// at 10 bit, the 12 bit result is 4 times larger
+#define BAT_ADC_SCALE		(BAT_ADC_MAX_VALUE << 2)
 #define BAT_LOW_DET_INVL 	180000//ms
+#define BAT_EMA_SHIFT		2// new sample weight 1/4
+#define BAT_EMA_FRAC		4// filter state in 1/16 mv
+#define BAT_EMPTY_LEVEL		10
+#define BAT_IDLE_SETTLE_MS	200// cell recovery after the radio went to sleep
+#define BAT_IDLE_RETRY_MS	1000
+
+// idle samples feed the level, load samples are taken while the subg radio transmits
+typedef enum
+{
+	BAT_SAMPLE_IDLE = 0,
+	BAT_SAMPLE_LOAD
+}eBattSample_t;
 
 #define TAG "BAT"
 
 APP_TIMER_DEF(batDetTimer);
+APP_TIMER_DEF(batRetryTimer);
 static uint8_t battLevel = 0;
 static uint16_t battVoltage = 0;
-static const uint16_t voltageTable[] = {3100, 3000, 2900, 2800, 2700, 2600, 2500, 2550, 2400};
+static int32_t battVoltageEma = -1;// -1 until the first sample
+static nrf_saadc_value_t adcBuf;
+static volatile bool adcBusy = false;
+static eBattSample_t adcSample = BAT_SAMPLE_IDLE;
+static uint16_t adcTxPktCnt = 0;// subg tx count when the idle sample started
+static uint16_t battLoadVoltage = 0;
+static uint16_t battLoadMinVoltage = 0xFFFF;
+static uint16_t battDeferCnt = 0;
+static const uint16_t voltageTable[] = {3100, 3000, 2900, 2800, 2700, 2600, 2500, 2450, 2400};// descending
 static const uint8_t percentageTable[] = {100, 90, 80, 70, 60, 50, 40, 30, 20};//must correspond to voltageTable
 
-static void adc_callback(nrfx_saadc_evt_t const *pEvt)
-{
-}
-
-static void adc_init(void)
-{
-	uint32_t err = NRF_SUCCESS;
-	
-	nrfx_saadc_config_t adcCfg = NRFX_SAADC_DEFAULT_CONFIG;
-	err = nrfx_saadc_init(&adcCfg, adc_callback);
-    APP_ERROR_CHECK(err);
-	
-	nrf_saadc_channel_config_t adcChannel = NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(ADC_BAT_DET_CHANNEL);
-	err = nrfx_saadc_channel_init(ADC_BAT_DET_CHANNEL, &adcChannel);
-    APP_ERROR_CHECK(err);
-}
-
-static void adc_uninit(void)
+// Linear between the table points, full above the first one and empty below the last one
+static uint8_t volt_to_level(uint16_t voltage)
 {
-	nrfx_saadc_uninit();
-	nrf_gpio_cfg_default(ADC_BAT_DET_PIN);
-}
-
-static uint8_t batt_detect(void)
-{
-	int16_t adcResult = 0;
-	nrf_saadc_value_t adcTmp = 0;
     uint8_t length = sizeof(voltageTable) / sizeof(voltageTable[0]);
 	uint8_t i;
-		
-	adc_init();
-	Kit_DelayMs(5);
-	for(i = 0; i < 2; i++)
-	{
-		nrfx_saadc_sample_convert(ADC_BAT_DET_CHANNEL, &adcTmp);
-		adcResult += adcTmp;
-	}
-	adc_uninit();
-	adcResult = adcResult / 2;
-	battVoltage = (uint16_t)((float)adcResult / BAT_ADC_MAX_VALUE * BAT_MAX_VOLTAGE);
-	    
-    //find the first value which is < volatage
+	
     for(i = 0; i < length; i++) 
 	{
-        if(battVoltage > voltageTable[i])
+        if(voltage >= voltageTable[i])
         {
             break;
         }
     }
-
-    if(i >= length) 
+	
+	if(i == 0)
 	{
-        battLevel = 10;
-    }
-	else
+		return percentageTable[0];
+	}
+	
+	if(i >= length)
 	{
-        battLevel = percentageTable[i];
-    }
+		return BAT_EMPTY_LEVEL;
+	}
 	
-	KIT_LOG(TAG, "Level = %d.", battLevel);	
-
-	return battLevel;
+	return percentageTable[i] + (uint32_t)(voltage - voltageTable[i]) * (percentageTable[i - 1] - percentageTable[i])
+		/ (voltageTable[i - 1] - voltageTable[i]);
 }
 
-static void batt_low_check_handle(void *pContext)
+static void batt_low_check(uint8_t batt)
 {
 	static bool flag = false;
-	uint8_t batt = 0;
 	
-	batt = batt_detect();
-	if(batt <= 10 && !flag)
+	if(batt <= BAT_EMPTY_LEVEL && !flag)
 	{
 		Idc_SetType(INDICATE_LOW_POWER);
 		flag = true;
@@ -125,21 +110,157 @@ static void batt_low_check_handle(void *pContext)
 	}
 }
 
+static int32_t adc_to_voltage(int16_t adcValue)
+{
+	if(adcValue < 0)
+	{
+		adcValue = 0;
+	}
+	
+	return ((int32_t)adcValue * BAT_MAX_VOLTAGE + BAT_ADC_SCALE / 2) / BAT_ADC_SCALE;
+}
+
+static void batt_update(int32_t voltage)
+{
+	if(battVoltageEma < 0)
+	{
+		battVoltageEma = voltage << BAT_EMA_FRAC;
+	}
+	else
+	{
+		battVoltageEma += ((voltage << BAT_EMA_FRAC) - battVoltageEma) >> BAT_EMA_SHIFT;
+	}
+	
+	battVoltage = (uint16_t)((battVoltageEma + (1 << (BAT_EMA_FRAC - 1))) >> BAT_EMA_FRAC);
+	battLevel = volt_to_level(battVoltage);
+	KIT_LOG(TAG, "Sample %dmv, filtered %dmv, level = %d.", voltage, battVoltage, battLevel);
+}
+
+// Runs in the SAADC interrupt once the oversampled result is in adcBuf
+static void adc_callback(nrfx_saadc_evt_t const *pEvt)
+{
+	int32_t voltage;
+	
+	if(pEvt->type != NRFX_SAADC_EVT_DONE)
+	{
+		return;
+	}
+	
+	voltage = adc_to_voltage(pEvt->data.done.p_buffer[0]);
+	adcBusy = false;
+	
+	if(adcSample == BAT_SAMPLE_LOAD)
+	{
+		battLoadVoltage = (uint16_t)voltage;
+		if(battLoadVoltage < battLoadMinVoltage)
+		{
+			battLoadMinVoltage = battLoadVoltage;
+			KIT_LOG(TAG, "Min voltage under tx load: %dmv.", battLoadMinVoltage);
+		}
+		return;
+	}
+	
+	// a tx started while sampling, the value is not an idle one
+	if(!Subg_IsIdleFor(0) || Subg_GetTxPktCnt() != adcTxPktCnt)
+	{
+		battDeferCnt++;
+		app_timer_start(batRetryTimer, APP_TIMER_TICKS(BAT_IDLE_RETRY_MS), NULL);
+		return;
+	}
+	
+	batt_update(voltage);
+	batt_low_check(battLevel);
+}
+
+static bool adc_start(eBattSample_t sample)
+{
+	if(adcBusy)
+	{
+		return false;
+	}
+	
+	adcBusy = true;
+	adcSample = sample;
+	adcTxPktCnt = Subg_GetTxPktCnt();
+	if(nrfx_saadc_buffer_convert(&adcBuf, 1) != NRFX_SUCCESS || nrfx_saadc_sample() != NRFX_SUCCESS)
+	{
+		adcBusy = false;
+		return false;
+	}
+	
+	return true;
+}
+
+// The SAADC stays initialised, in low power mode it only draws current while sampling
+static void adc_init(void)
+{
+	uint32_t err = NRF_SUCCESS;
+	
+	nrfx_saadc_config_t adcCfg = NRFX_SAADC_DEFAULT_CONFIG;
+	adcCfg.resolution = NRF_SAADC_RESOLUTION_12BIT;
+	adcCfg.oversample = NRF_SAADC_OVERSAMPLE_16X;
+	adcCfg.low_power_mode = true;
+	err = nrfx_saadc_init(&adcCfg, adc_callback);
+    APP_ERROR_CHECK(err);
+	
+	// burst takes all oversamples on one trigger, the long acquisition replaces the settle delay
+	nrf_saadc_channel_config_t adcChannel = NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(ADC_BAT_DET_CHANNEL);
+	adcChannel.acq_time = NRF_SAADC_ACQTIME_40US;
+	adcChannel.burst = NRF_SAADC_BURST_ENABLED;
+	err = nrfx_saadc_channel_init(ADC_BAT_DET_CHANNEL, &adcChannel);
+    APP_ERROR_CHECK(err);
+}
+
+static void batt_low_check_handle(void *pContext)
+{
+	Batt_StartMeasure();
+}
+
+static void batt_retry_handle(void *pContext)
+{
+	Batt_StartMeasure();
+}
+
 void Batt_Init(void)
 {
     uint32_t errCode = NRF_SUCCESS;
 	
     errCode =  app_timer_create(&batDetTimer, APP_TIMER_MODE_REPEATED, batt_low_check_handle);
+    APP_ERROR_CHECK(errCode);
+    errCode =  app_timer_create(&batRetryTimer, APP_TIMER_MODE_SINGLE_SHOT, batt_retry_handle);
     APP_ERROR_CHECK(errCode);
 	
 	errCode = app_timer_start(batDetTimer, APP_TIMER_TICKS(BAT_LOW_DET_INVL), NULL);
 	APP_ERROR_CHECK(errCode);
 
-	batt_detect();
+	adc_init();
+	Batt_StartMeasure();
 	
 	KIT_LOG(TAG, "Init OK!");
 }
 
+/* 
+ * Returns at once, the level and voltage are updated from the SAADC interrupt.
+ * While the subg radio is busy or has just been, the sample is deferred to a later idle window.
+ */
+bool Batt_StartMeasure(void)
+{
+	if(!Subg_IsIdleFor(BAT_IDLE_SETTLE_MS) || !adc_start(BAT_SAMPLE_IDLE))
+	{
+		battDeferCnt++;
+		app_timer_start(batRetryTimer, APP_TIMER_TICKS(BAT_IDLE_RETRY_MS), NULL);
+		return false;
+	}
+	
+	return true;
+}
+
+/* Called by the subg layer once a transmission is running, skipped while a sample is in progress */
+void Batt_StartLoadMeasure(void)
+{
+	adc_start(BAT_SAMPLE_LOAD);
+}
+
 uint8_t Batt_GetLevel(void)
 {
 	return battLevel;
@@ -150,9 +271,26 @@ uint16_t Batt_GetVoltage(void)
 	return battVoltage;
 }
 
+/* Last and lowest voltage sampled during a subg transmission, 0 and 0xFFFF before the first one */
+uint16_t Batt_GetLoadVoltage(void)
+{
+	return battLoadVoltage;
+}
+
+uint16_t Batt_GetLoadMinVoltage(void)
+{
+	return battLoadMinVoltage;
+}
+
+uint16_t Batt_GetDeferCnt(void)
+{
+	return battDeferCnt;
+}
+
 bool Batt_IsLow(void)
 {
-	if(battLevel <= 10)
+	// not low before the first measurement is done
+	if(battVoltageEma >= 0 && battLevel <= BAT_EMPTY_LEVEL)
 	{
 		return true;
 	}
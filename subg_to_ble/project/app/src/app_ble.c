@@ -13,9 +13,14 @@
  *published by the Free Software Foundation.
  *
  */
+#include <string.h>
+#include <stddef.h>
 #include "app_error.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "kit_log.h"
+#include "kit_queue.h"
+#include "kit_heap.h"
 #include "app_battery.h"
 #include "app_ble.h"
 #include "ble.h"
@@ -43,6 +48,7 @@
 #include "ocp.h"
 #include "app_indication.h"
 #include "app_config.h"
+#include "kit_utils.h"
 #include "boards.h"
 
 #define BLE_CONN_CFG_TAG        			1                            /**< Tag that refers to the BLE stack configuration set with @ref sd_ble_cfg_set. The default tag is @ref BLE_CONN_CFG_TAG_DEFAULT. */
@@ -50,16 +56,29 @@
 #define BLE_SOC_OBSERVER_PRIO   			1                            /**< Applications' SoC observer priority. You shouldn't need to modify this value. */
 
 #define BLE_IPS_SERVICE_UUID_TYPE       	BLE_UUID_TYPE_VENDOR_BEGIN                  /**< UUID type for the Nordic UART Service (vendor specific). */
-#define BLE_ADV_INTERVAL                	480                                         /**< The advertising interval (in units of 0.625 ms. This value corresponds to 187.5 ms). */
-#define BLE_ADV_DURATION                	0                                        	/**< The advertising duration (180 seconds) in units of 10 milliseconds. */
-
-#define BLE_MIN_CONN_INTERVAL               MSEC_TO_UNITS(50, UNIT_1_25_MS)//80ms            /**< Minimum acceptable connection interval (0.1 seconds). */
-#define BLE_MAX_CONN_INTERVAL               MSEC_TO_UNITS(100, UNIT_1_25_MS)//100ms           /**< Maximum acceptable connection interval (0.2 second). */
-#define BLE_SLAVE_LATENCY                   0                                           /**< Slave latency. */
+#define BLE_ADV_FAST_INTERVAL           	MSEC_TO_UNITS(20, UNIT_0_625_MS)            /**< Burst interval after boot or a disconnect. */
+#define BLE_ADV_FAST_DURATION           	MSEC_TO_UNITS(30000, UNIT_10_MS)            /**< Burst length, the slow ramp follows. */
+#define BLE_ADV_STATUS_INTERVAL         	APP_TIMER_TICKS(60000)                      /**< Refresh of the status block in the scan response. */
+#define BLE_ADV_STATUS_COMPANY_ID       	0xFFFF                                      /**< No assigned company identifier, 0xFFFF is the one for internal use. */
+#define BLE_ADV_STATUS_VERSION          	1                                           /**< Layout of stBleAdvStatus_t. */
+#define BLE_ADV_STATUS_PUMP_RECENT      	0x01                                        /**< Status flag, a pump packet came in within BLE_ADV_STATUS_PUMP_WINDOW_MS. */
+#define BLE_ADV_STATUS_PUMP_WINDOW_MS   	(10 * 60000)
+
+#define BLE_MIN_CONN_INTERVAL               MSEC_TO_UNITS(100, UNIT_1_25_MS)//100ms           /**< Minimum acceptable connection interval of the idle profile. */
+#define BLE_MAX_CONN_INTERVAL               MSEC_TO_UNITS(200, UNIT_1_25_MS)//200ms           /**< Maximum acceptable connection interval of the idle profile. */
+#define BLE_SLAVE_LATENCY                   4                                           /**< Slave latency of the idle profile. */
+#define BLE_BURST_MIN_CONN_INTERVAL         MSEC_TO_UNITS(15, UNIT_1_25_MS)             /**< Minimum connection interval while commands arrive, the lowest iOS accepts. */
+#define BLE_BURST_MAX_CONN_INTERVAL         MSEC_TO_UNITS(30, UNIT_1_25_MS)             /**< Maximum connection interval while commands arrive. */
+#define BLE_BURST_SLAVE_LATENCY             0                                           /**< Slave latency while commands arrive. */
+#define BLE_CONN_IDLE_TIMEOUT_MS            3000                                        /**< No command for this long relaxes the link to the idle profile. */
+#define BLE_CONN_UPDATE_MIN_GAP_MS          2000                                        /**< Minimum time between two profile changes. */
 #define BLE_CONN_SUP_TIMEOUT                MSEC_TO_UNITS(5000, UNIT_10_MS)             /**< Connection supervisory timeout (4 seconds). */
 #define BLE_FIRST_CONN_PARAMS_UPDATE_DELAY  APP_TIMER_TICKS(5000)                       /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define BLE_NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000)                      /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define BLE_MAX_CONN_PARAMS_UPDATE_COUNT    3                                           /**< Number of attempts before giving up the connection parameter negotiation. */
+#define BLE_LL_DATA_LEN                     27                                          /**< Link layer payload octets, S112 has no data length extension. */
+#define BLE_NOTIFY_NODE_NUM                 4                                           /**< Responses that can wait for a SoftDevice TX buffer. */
+#define BLE_NOTIFY_DATA_MAX_LEN             BLE_IPS_MAX_DATA_CHAR_LEN                   /**< Largest response that can be queued. */
 
 #define BLE_BATT_UPDATE_INTERVAL     		APP_TIMER_TICKS(10000)                   	/**< Battery level measurement interval (ticks). */
 #define BLE_TX_POWER_LEVEL                  (4)                                   		/**< TX Power Level value. This will be set both in the TX Power service, in the advertising data, and also used to set the radio transmit power. */
@@ -75,15 +94,153 @@ NRF_BLE_QWR_DEF(m_qwr);                             	/**< Context for the Queued
 BLE_ADVERTISING_DEF(m_advertising);				/**< Advertising module instance. */
 BLE_BAS_DEF(m_bas);									/**< Structure used to identify the battery service. */
 APP_TIMER_DEF(m_battery_timer_id);                    /**< Battery timer. */
+APP_TIMER_DEF(connIdleTimer);
+APP_TIMER_DEF(connRateTimer);
+APP_TIMER_DEF(advStatusTimer);
+APP_TIMER_DEF(tickTimer);
+
+typedef enum 
+{
+	BLE_NOTIFY_CH_IPS = 0,// ips data value plus response count notification
+	BLE_NOTIFY_CH_NUS,
+#if BLE_MONITOR_LINK_ENABLED
+	BLE_NOTIFY_CH_MONITOR,// nus notifications to the monitor link
+#endif
+	BLE_NOTIFY_CH_NUM
+}eBleNotifyCh_t;
+
+typedef struct
+{
+	stKitQueueNode_t node;
+	uint32_t queueTime;// Timer_GetCnt() when queued
+	uint16_t len;
+	uint8_t data[BLE_NOTIFY_DATA_MAX_LEN];
+}stBleNotifyNode_t;
 
-static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;	/**< Handle of the current connection. */
+typedef struct
+{
+	uint16_t connHandle;
+	eBleState_t state;
+#if BLE_MONITOR_LINK_ENABLED
+	ble_gap_conn_params_t connParams;// kept for a monitor link claiming the primary slot
+	ble_gap_addr_t peerAddr;
+#endif
+}stBleLink_t;
+
+static stBleLink_t bleLink[BLE_LINK_NUM] =                  /**< The primary link owns the pump commands, the monitor only listens. */
+{
+	[BLE_LINK_PRIMARY] = {BLE_CONN_HANDLE_INVALID, BLE_STATE_ADV},
+	[BLE_LINK_MONITOR] = {BLE_CONN_HANDLE_INVALID, BLE_STATE_ADV},
+	[BLE_LINK_STANDBY] = {BLE_CONN_HANDLE_INVALID, BLE_STATE_ADV},
+};
 static ble_uuid_t m_adv_uuids[] =                           /**< Universally unique service identifier. */
 {
     {BLE_UUID_IPS_SERVICE, BLE_IPS_SERVICE_UUID_TYPE}
 };
 
+typedef struct
+{
+	uint32_t interval;// 0.625ms units
+	uint32_t duration;// 10ms units, 0 forever
+}stBleAdvStep_t;
+
+// manufacturer data in the scan response, multi byte values are big endian
+typedef struct __attribute__((packed)) 
+{
+	uint8_t	version;
+	uint8_t	battLevel;// percent
+	uint8_t	fwMajor;
+	uint8_t	fwMinor;
+	uint8_t	hwMajor;
+	uint8_t	hwMinor;
+	int8_t	pumpRssi;// dBm of the last pump packet
+	uint8_t	flags;
+	uint16_t uptime;// minutes
+}stBleAdvStatus_t;
+
+// the name gets what the status block leaves of the scan response
+#define BLE_ADV_SR_NAME_MAX_LEN				(BLE_GAP_ADV_SET_DATA_SIZE_MAX - 2 * AD_DATA_OFFSET - 2 - sizeof(stBleAdvStatus_t))
+
+/* Slow advertising steps after the burst, each one sparser, the last never ends */
+static const stBleAdvStep_t advRamp[] =
+{
+	{244, MSEC_TO_UNITS(60000, UNIT_10_MS)},// 152.5ms
+	{480, MSEC_TO_UNITS(120000, UNIT_10_MS)},// 300ms
+	{1636, 0},// 1022.5ms
+};
+
 static bool bleNameChangeFlg = false;
-static eBleState_t bleState = BLE_STATE_ADV;
+
+#if BLE_MONITOR_LINK_ENABLED
+#define BLE_MONITOR_FRAME_CMD				0x01// command the primary link wrote
+#define BLE_MONITOR_FRAME_RESP				0x02// ips response sent back, pump packets included
+#define BLE_MONITOR_FRAME_STAT				0x03// stBleMonitorStat_t
+#define BLE_MONITOR_STAT_INTERVAL			APP_TIMER_TICKS(5000)
+
+// multi byte values are big endian
+typedef struct __attribute__((packed)) 
+{
+	uint8_t	primaryState;// eBleState_t
+	uint8_t	battLevel;// percent
+	uint16_t battVoltage;// mv
+	uint16_t subgRxCnt;
+	uint16_t subgTxCnt;
+	int8_t	pumpRssi;
+	uint16_t interval;// primary link, 1.25ms units
+	uint32_t uptime;// ms
+}stBleMonitorStat_t;
+
+APP_TIMER_DEF(monitorStatTimer);
+#endif
+
+static const ble_gap_conn_params_t connProfileParams[BLE_CONN_PROFILE_NUM] =
+{
+	[BLE_CONN_PROFILE_IDLE] = 
+	{
+		.min_conn_interval = BLE_MIN_CONN_INTERVAL,
+		.max_conn_interval = BLE_MAX_CONN_INTERVAL,
+		.slave_latency     = BLE_SLAVE_LATENCY,
+		.conn_sup_timeout  = BLE_CONN_SUP_TIMEOUT,
+	},
+	[BLE_CONN_PROFILE_BURST] = 
+	{
+		.min_conn_interval = BLE_BURST_MIN_CONN_INTERVAL,
+		.max_conn_interval = BLE_BURST_MAX_CONN_INTERVAL,
+		.slave_latency     = BLE_BURST_SLAVE_LATENCY,
+		.conn_sup_timeout  = BLE_CONN_SUP_TIMEOUT,
+	},
+};
+static eBleConnProfile_t connProfileWanted = BLE_CONN_PROFILE_IDLE;// what the activity asks for
+static eBleConnProfile_t connProfileReq = BLE_CONN_PROFILE_IDLE;// last one requested from the central
+static uint32_t connProfileStart = 0;// Timer_GetCnt() when the link entered linkStat.profile
+static uint32_t connLastUpdate = 0;
+static bool phyUpdatePending = false;// 2M request still to be sent, the controller was busy
+static bool cmdSeqValid = false;// no write without response seen yet on this connection
+static uint8_t cmdSeqNext = 0;
+static uint8_t advRampStep = 0;
+static uint8_t advStage = BLE_ADV_STAGE_FAST;// eBleAdvStage_t plus the ramp step when slow
+static ble_gap_addr_t lastPeerAddr;// directed advertising target after a disconnect
+static bool lastPeerValid = false;
+static bool reconnectPending = false;
+static uint8_t bleLinkCnt = NRF_SDH_BLE_TOTAL_LINK_COUNT;// links the SoftDevice got RAM for
+static uint32_t disconnectTime = 0;
+static stBleAdvStatus_t advStatus;
+static uint16_t advStatusRxCnt = 0;
+static uint32_t advStatusRxTime = 0;
+static bool advStatusRxSeen = false;
+static uint8_t advEncBuf[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];// the SoftDevice only takes new data in buffers it is not sending from
+static uint8_t advSrEncBuf[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];
+static uint8_t advEncIdx = 0;
+static stBleLinkStat_t linkStat;
+static uint8_t notifyNodeCnt = 0;// nodes taken from the heap, at most BLE_NOTIFY_NODE_NUM
+static uint8_t notifyNodeMaxCnt = 0;
+static stKitQueueList_t notifyList[BLE_NOTIFY_CH_NUM];
+static uint8_t primaryHvnCnt = 0;// notifications handed to the SoftDevice on the primary link, not completed yet
+static uint8_t ipsRespHvnCnt = 0;// the central reads the ips value, no new one until these, up to its count notification, went out
+static stBleNotifyStat_t notifyStat;
+static bool tickSubscribed = false;
+
+static bool link_claim(uint16_t connHandle);
 
 /**@brief Function for assert macro callback.
  *
@@ -103,9 +260,9 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t * p_file_name)
 
 /**@brief Function for changing the tx power.
  */
-static void tx_power_set(int8_t power)
+static void tx_power_set(uint16_t connHandle, int8_t power)
 {
-    ret_code_t err = sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_CONN, m_conn_handle, power);
+    ret_code_t err = sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_CONN, connHandle, power);
     APP_ERROR_CHECK(err);
 }
 
@@ -228,6 +385,13 @@ static void nrf_qwr_error_handler(uint32_t nrf_error)
 /**@snippet [Handling the data received over BLE] */
 static void nus_data_handler(ble_nus_evt_t * p_evt)
 {
+	// config and factory requests are taken from the primary link only, subscribing alone claims nothing
+	// requests are answered on the primary link only, they do not claim it
+	if(p_evt->type != BLE_NUS_EVT_RX_DATA || p_evt->conn_handle != bleLink[BLE_LINK_PRIMARY].connHandle)
+	{
+		return;
+	}
+	
 	switch(p_evt->type )
 	{
 		case BLE_NUS_EVT_RX_DATA:	
@@ -261,18 +425,474 @@ static void nus_data_handler(ble_nus_evt_t * p_evt)
 	}
 }
 
+/* The profile the link is in follows the interval the central really granted */
+static void conn_profile_track(ble_gap_conn_params_t const *pParams)
+{
+	uint32_t now = Timer_GetCnt();
+	
+	linkStat.profileTime[linkStat.profile] += now - connProfileStart;
+	connProfileStart = now;
+	linkStat.interval = pParams->max_conn_interval;
+	linkStat.latency = pParams->slave_latency;
+	linkStat.profile = (pParams->max_conn_interval <= BLE_BURST_MAX_CONN_INTERVAL) ? BLE_CONN_PROFILE_BURST : BLE_CONN_PROFILE_IDLE;
+}
+
+static void conn_profile_request(eBleConnProfile_t profile)
+{
+	uint32_t elapsed = Timer_GetCnt() - connLastUpdate;
+	
+	connProfileWanted = profile;
+	if(bleLink[BLE_LINK_PRIMARY].connHandle == BLE_CONN_HANDLE_INVALID || profile == connProfileReq)
+	{
+		return;
+	}
+	
+	// renegotiations are rate limited, the latest wish is applied once the gap has passed
+	if(linkStat.updateCnt > 0 && elapsed < BLE_CONN_UPDATE_MIN_GAP_MS)
+	{
+		linkStat.rateLimitCnt++;
+		app_timer_start(connRateTimer, APP_TIMER_TICKS(BLE_CONN_UPDATE_MIN_GAP_MS - elapsed), NULL);
+		return;
+	}
+	
+	if(ble_conn_params_change_conn_params(bleLink[BLE_LINK_PRIMARY].connHandle, (ble_gap_conn_params_t *)&connProfileParams[profile]) == NRF_SUCCESS)
+	{
+		connProfileReq = profile;
+		connLastUpdate = Timer_GetCnt();
+		linkStat.updateCnt++;
+		KIT_LOG(TAG, "Conn profile %d requested.", profile);
+	}
+}
+
+static void conn_rate_handle(void *pContext)
+{
+	conn_profile_request(connProfileWanted);
+}
+
+static void conn_idle_handle(void *pContext)
+{
+	conn_profile_request(BLE_CONN_PROFILE_IDLE);
+}
+
+/* Every command keeps the link in the burst profile for another idle timeout */
+static void conn_activity(void)
+{
+	app_timer_stop(connIdleTimer);
+	app_timer_start(connIdleTimer, APP_TIMER_TICKS(BLE_CONN_IDLE_TIMEOUT_MS), NULL);
+	conn_profile_request(BLE_CONN_PROFILE_BURST);
+}
+
+/* Ask for 2M, the central may keep 1M and the link just stays there */
+static void conn_phy_request(void)
+{
+	ble_gap_phys_t const phys =
+	{
+		.rx_phys = BLE_GAP_PHY_2MBPS,
+		.tx_phys = BLE_GAP_PHY_2MBPS,
+	};
+	uint32_t err_code;
+	
+	err_code = sd_ble_gap_phy_update(bleLink[BLE_LINK_PRIMARY].connHandle, &phys);
+	phyUpdatePending = (err_code == NRF_ERROR_BUSY);
+	if(err_code != NRF_SUCCESS && err_code != NRF_ERROR_BUSY)
+	{
+		linkStat.phyFailCnt++;
+	}
+}
+
+static void conn_phy_track(ble_gap_evt_phy_update_t const *pPhy)
+{
+	if(pPhy->status != BLE_HCI_STATUS_CODE_SUCCESS)
+	{
+		linkStat.phyFailCnt++;
+		KIT_LOG(TAG, "PHY update failed 0x%02x.", pPhy->status);
+		return;
+	}
+	linkStat.txPhy = pPhy->tx_phy;
+	linkStat.rxPhy = pPhy->rx_phy;
+	KIT_LOG(TAG, "PHY tx %d, rx %d.", linkStat.txPhy, linkStat.rxPhy);
+}
+
+static void conn_profile_start(ble_gap_conn_params_t const *pParams)
+{
+	connProfileWanted = BLE_CONN_PROFILE_IDLE;
+	connProfileReq = BLE_CONN_PROFILE_IDLE;
+	connProfileStart = Timer_GetCnt();
+	conn_profile_track(pParams);
+	linkStat.txPhy = BLE_GAP_PHY_1MBPS;
+	linkStat.rxPhy = BLE_GAP_PHY_1MBPS;
+	linkStat.attMtu = BLE_GATT_ATT_MTU_DEFAULT;
+	linkStat.dataLen = BLE_LL_DATA_LEN;
+	conn_phy_request();
+}
+
+static void conn_profile_stop(void)
+{
+	app_timer_stop(connIdleTimer);
+	app_timer_stop(connRateTimer);
+	phyUpdatePending = false;
+	cmdSeqValid = false;
+	linkStat.profileTime[linkStat.profile] += Timer_GetCnt() - connProfileStart;
+	connProfileStart = Timer_GetCnt();
+}
+
+static eBleLink_t notify_link(eBleNotifyCh_t ch)
+{
+#if BLE_MONITOR_LINK_ENABLED
+	if(ch == BLE_NOTIFY_CH_MONITOR)
+	{
+		return BLE_LINK_MONITOR;
+	}
+#endif
+	return BLE_LINK_PRIMARY;
+}
+
+static uint32_t notify_send(eBleNotifyCh_t ch, stBleNotifyNode_t *pNotify)
+{
+	uint16_t len = pNotify->len;
+	uint32_t err_code;
+	
+	if(ch == BLE_NOTIFY_CH_NUS)
+	{
+		return ble_nus_data_send(&m_nus, pNotify->data, &len, bleLink[BLE_LINK_PRIMARY].connHandle);
+	}
+#if BLE_MONITOR_LINK_ENABLED
+	if(ch == BLE_NOTIFY_CH_MONITOR)
+	{
+		return ble_nus_data_send(&m_nus, pNotify->data, &len, bleLink[BLE_LINK_MONITOR].connHandle);
+	}
+#endif
+	
+	err_code = ble_ips_data_send(pNotify->data, len, &m_ips);
+	if(err_code == NRF_SUCCESS)
+	{
+		err_code = ble_ips_response_cnt_notify(&m_ips);
+	}
+	
+	return err_code;
+}
+
+/* Called in a critical region */
+static void notify_free(stKitQueueNode_t *pNode)
+{
+	Kit_Free(KIT_QUEUE_ENTRY(pNode, stBleNotifyNode_t, node));
+	notifyNodeCnt--;
+}
+
+/* Hand queued responses to the SoftDevice until its TX buffers are full, HVN_TX_COMPLETE calls again */
+static void notify_flush(void)
+{
+	stKitQueueNode_t *pNode;
+	stBleNotifyNode_t *pNotify;
+	uint32_t err_code;
+	uint32_t latency;
+	uint8_t ch;
+	
+	CRITICAL_REGION_ENTER();
+	for(ch = 0; ch < BLE_NOTIFY_CH_NUM; ch++)
+	{
+		while((pNode = Kit_QueuePeekFront(&notifyList[ch])) != NULL)
+		{
+			if(ch == BLE_NOTIFY_CH_IPS && ipsRespHvnCnt != 0)
+			{
+				break;
+			}
+			
+			pNotify = KIT_QUEUE_ENTRY(pNode, stBleNotifyNode_t, node);
+			err_code = notify_send((eBleNotifyCh_t)ch, pNotify);
+			if(err_code == NRF_ERROR_RESOURCES)
+			{
+				notifyStat.busyCnt++;
+				break;
+			}
+			
+			if(err_code == NRF_SUCCESS)
+			{
+				latency = Timer_GetCnt() - pNotify->queueTime;
+				notifyStat.lastLatency = (latency > 0xffff) ? 0xffff : latency;
+				if(notifyStat.lastLatency > notifyStat.maxLatency)
+				{
+					notifyStat.maxLatency = notifyStat.lastLatency;
+				}
+				notifyStat.sentCnt++;
+				if(notify_link((eBleNotifyCh_t)ch) == BLE_LINK_PRIMARY)
+				{
+					primaryHvnCnt++;
+				}
+				if(ch == BLE_NOTIFY_CH_IPS)
+				{
+					// completed in order, the count notification is the last one queued
+					ipsRespHvnCnt = primaryHvnCnt;
+				}
+			}
+			else
+			{
+				notifyStat.dropCnt++;
+				KIT_LOG(TAG, "Notify ch %d error 0x%02x!", ch, err_code);
+			}
+			notify_free(Kit_QueuePopFront(&notifyList[ch]));
+		}
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+/* 
+ * A node for len bytes, the caller fills in the data and hands it over with notify_push().
+ * It is sized to the response, the short config and monitor ones come from the small heap classes.
+ */
+static stBleNotifyNode_t *notify_alloc(eBleNotifyCh_t ch, uint16_t len)
+{
+	stBleNotifyNode_t *pNotify = NULL;
+	
+	if(bleLink[notify_link(ch)].connHandle != BLE_CONN_HANDLE_INVALID && len <= BLE_NOTIFY_DATA_MAX_LEN)
+	{
+		CRITICAL_REGION_ENTER();
+		if(notifyNodeCnt < BLE_NOTIFY_NODE_NUM)
+		{
+			pNotify = (stBleNotifyNode_t *)Kit_Malloc(offsetof(stBleNotifyNode_t, data) + len);
+		}
+		if(pNotify != NULL && ++notifyNodeCnt > notifyNodeMaxCnt)
+		{
+			notifyNodeMaxCnt = notifyNodeCnt;
+		}
+		CRITICAL_REGION_EXIT();
+	}
+	
+	if(pNotify == NULL)
+	{
+		notifyStat.dropCnt++;
+		KIT_LOG(TAG, "Notify ch %d dropped!", ch);
+		return NULL;
+	}
+	
+	pNotify->len = len;
+	
+	return pNotify;
+}
+
+static void notify_push(eBleNotifyCh_t ch, stBleNotifyNode_t *pNotify)
+{
+	CRITICAL_REGION_ENTER();
+	pNotify->queueTime = Timer_GetCnt();
+	Kit_QueuePushBack(&notifyList[ch], &pNotify->node);
+	CRITICAL_REGION_EXIT();
+	
+	notify_flush();
+}
+
+static void notify_queue(eBleNotifyCh_t ch, const uint8_t *pData, uint16_t len)
+{
+	stBleNotifyNode_t *pNotify = notify_alloc(ch, len);
+	
+	if(pNotify != NULL)
+	{
+		memcpy(pNotify->data, pData, len);
+		notify_push(ch, pNotify);
+	}
+}
+
+/* The SoftDevice reports completed notifications once per connection event */
+static void notify_tx_complete(uint16_t connHandle, uint8_t count)
+{
+	notifyStat.hvnEvtCnt++;
+	notifyStat.hvnPktCnt += count;
+	if(count > notifyStat.hvnPerEvtMax)
+	{
+		notifyStat.hvnPerEvtMax = count;
+	}
+	if(connHandle == bleLink[BLE_LINK_PRIMARY].connHandle)
+	{
+		CRITICAL_REGION_ENTER();
+		primaryHvnCnt = (count < primaryHvnCnt) ? primaryHvnCnt - count : 0;
+		ipsRespHvnCnt = (count < ipsRespHvnCnt) ? ipsRespHvnCnt - count : 0;
+		CRITICAL_REGION_EXIT();
+	}
+	notify_flush();
+}
+
+static void notify_clear(eBleLink_t link)
+{
+	uint8_t ch;
+	
+	CRITICAL_REGION_ENTER();
+	for(ch = 0; ch < BLE_NOTIFY_CH_NUM; ch++)
+	{
+		while(notify_link((eBleNotifyCh_t)ch) == link && notifyList[ch].cnt > 0)
+		{
+			notify_free(Kit_QueuePopFront(&notifyList[ch]));
+		}
+	}
+	if(link == BLE_LINK_PRIMARY)
+	{
+		primaryHvnCnt = 0;
+		ipsRespHvnCnt = 0;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+static eBleLink_t link_find(uint16_t connHandle)
+{
+	uint8_t link;
+	
+	for(link = 0; link < BLE_LINK_NUM; link++)
+	{
+		if(bleLink[link].connHandle == connHandle)
+		{
+			break;
+		}
+	}
+	
+	return (eBleLink_t)link;
+}
+
+#if BLE_MONITOR_LINK_ENABLED
+/* Copies to the monitor never take the last free node, the primary responses come first */
+static void monitor_send(uint8_t type, const uint8_t *pData, uint16_t len)
+{
+	stBleNotifyNode_t *pNotify;
+	ble_nus_client_context_t *pClient = NULL;
+	
+	if(bleLink[BLE_LINK_MONITOR].connHandle == BLE_CONN_HANDLE_INVALID || notifyNodeCnt + 1 >= BLE_NOTIFY_NODE_NUM)
+	{
+		return;
+	}
+	blcm_link_ctx_get(m_nus.p_link_ctx_storage, bleLink[BLE_LINK_MONITOR].connHandle, (void *)&pClient);
+	if(pClient == NULL || !pClient->is_notification_enabled)
+	{
+		return;
+	}
+	
+	// the frame is built in the node, no copy of up to a whole response on the SoftDevice event stack
+	if(len > BLE_NOTIFY_DATA_MAX_LEN - 1)
+	{
+		len = BLE_NOTIFY_DATA_MAX_LEN - 1;
+	}
+	pNotify = notify_alloc(BLE_NOTIFY_CH_MONITOR, len + 1);
+	if(pNotify != NULL)
+	{
+		pNotify->data[0] = type;
+		memcpy(&pNotify->data[1], pData, len);
+		notify_push(BLE_NOTIFY_CH_MONITOR, pNotify);
+	}
+}
+
+static void monitor_stat_handle(void *pContext)
+{
+	stBleMonitorStat_t stat;
+	
+	stat.primaryState = bleLink[BLE_LINK_PRIMARY].state;
+	stat.battLevel = Batt_GetLevel();
+	stat.battVoltage = Batt_GetVoltage();
+	Kit_ReverseTwoBytes((uint16_t *)&stat.battVoltage);
+	stat.subgRxCnt = Subg_GetRxPktCnt();
+	Kit_ReverseTwoBytes((uint16_t *)&stat.subgRxCnt);
+	stat.subgTxCnt = Subg_GetTxPktCnt();
+	Kit_ReverseTwoBytes((uint16_t *)&stat.subgTxCnt);
+	stat.pumpRssi = (int8_t)Subg_GetRssi();
+	stat.interval = (bleLink[BLE_LINK_PRIMARY].state == BLE_STATE_CONNECTED) ? linkStat.interval : 0;
+	Kit_ReverseTwoBytes((uint16_t *)&stat.interval);
+	stat.uptime = Timer_GetCnt();
+	Kit_ReverseFourBytes((uint32_t *)&stat.uptime);
+	monitor_send(BLE_MONITOR_FRAME_STAT, (const uint8_t *)&stat, sizeof(stat));
+}
+
+/* With a link still up the advertising module leaves restarting to us */
+static void monitor_adv_restart(ble_adv_mode_t mode)
+{
+	sd_ble_gap_adv_stop(m_advertising.adv_handle);
+	ble_advertising_start(&m_advertising, mode);
+}
+#else
+#define monitor_send(type, pData, len)
+#endif
+
+/* A response on its way wakes the central anyway, the tick only goes out on a quiet link */
+static void tick_handle(void *pContext)
+{
+	uint32_t err_code = NRF_ERROR_BUSY;
+	
+	CRITICAL_REGION_ENTER();
+	if(ipsRespHvnCnt == 0 && notifyList[BLE_NOTIFY_CH_IPS].cnt == 0)
+	{
+		err_code = ble_ips_timer_tick_notify(&m_ips);
+		if(err_code == NRF_SUCCESS)
+		{
+			primaryHvnCnt++;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+	
+	if(err_code == NRF_SUCCESS)
+	{
+		notifyStat.tickCnt++;
+	}
+	else if(err_code == NRF_ERROR_BUSY || err_code == NRF_ERROR_RESOURCES)
+	{
+		notifyStat.tickSkipCnt++;
+	}
+	else
+	{
+		KIT_LOG(TAG, "Timer tick error 0x%02x!", err_code);
+	}
+}
+
+/* Only runs while the primary central is subscribed, an idle board has no tick wake-ups */
+static void tick_start(void)
+{
+	app_timer_stop(tickTimer);
+	if(tickSubscribed && Cfg_GetTickPeriod() > 0)
+	{
+		app_timer_start(tickTimer, APP_TIMER_TICKS(Cfg_GetTickPeriod() * 1000), NULL);
+	}
+}
+
+/* Write commands are not acknowledged, a gap in the sequence shows the central dropped some */
+static void cmd_seq_check(uint8_t seq)
+{
+	if(cmdSeqValid && seq != cmdSeqNext)
+	{
+		linkStat.cmdLostCnt += (uint8_t)(seq - cmdSeqNext);
+		KIT_LOG(TAG, "Cmd seq %d, expected %d!", seq, cmdSeqNext);
+	}
+	cmdSeqValid = true;
+	cmdSeqNext = seq + 1;
+	linkStat.cmdNoRspCnt++;
+}
+
 static void ips_data_handler(ble_ips_evt_t * p_evt)
 {
 	int8_t rssi;
     uint8_t ch_index;
 
+	// only a pump command claims the free primary slot, other links are read only
+	if((p_evt->type == BLE_IPS_EVT_DATA_RX || p_evt->type == BLE_IPS_EVT_DATA_NO_RSP_RX) ? 
+		!link_claim(p_evt->conn_handle) : p_evt->conn_handle != bleLink[BLE_LINK_PRIMARY].connHandle)
+	{
+		return;
+	}
+	
     switch (p_evt->type)
     {
         case BLE_IPS_EVT_DATA_RX:			
-			sd_ble_gap_rssi_get(m_conn_handle, &rssi, &ch_index);
+			sd_ble_gap_rssi_get(bleLink[BLE_LINK_PRIMARY].connHandle, &rssi, &ch_index);
+			conn_activity();
 			Kit_PrintBytes(TAG, "Data access, write:", (const uint8_t*)p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
+			monitor_send(BLE_MONITOR_FRAME_CMD, p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
 			Aps_PutCmd(p_evt->params.rx_data.p_data, p_evt->params.rx_data.length, (int)rssi);
             break;
+			
+        case BLE_IPS_EVT_DATA_NO_RSP_RX:
+			if(p_evt->params.rx_data.length < 2)
+			{
+				break;
+			}
+			sd_ble_gap_rssi_get(bleLink[BLE_LINK_PRIMARY].connHandle, &rssi, &ch_index);
+			conn_activity();
+			cmd_seq_check(p_evt->params.rx_data.p_data[0]);
+			Kit_PrintBytes(TAG, "Data no rsp, write:", (const uint8_t*)p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
+			monitor_send(BLE_MONITOR_FRAME_CMD, p_evt->params.rx_data.p_data + 1, p_evt->params.rx_data.length - 1);
+			Aps_PutCmd(p_evt->params.rx_data.p_data + 1, p_evt->params.rx_data.length - 1, (int)rssi);
+            break;
 
         case BLE_IPS_EVT_CUS_NAME_RX:
 			Kit_PrintBytes(TAG, "Custom name access, write:", (const uint8_t*)p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
@@ -280,10 +900,16 @@ static void ips_data_handler(ble_ips_evt_t * p_evt)
 			{
 				Cfg_SetAdvName(p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
 				bleNameChangeFlg = true;
-				sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
+				sd_ble_gap_disconnect(bleLink[BLE_LINK_PRIMARY].connHandle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
 			}
             break;
 						
+		case BLE_IPS_EVT_TMR_TICK_ON:
+		case BLE_IPS_EVT_TMR_TICK_OFF:
+			tickSubscribed = (p_evt->type == BLE_IPS_EVT_TMR_TICK_ON);
+			tick_start();
+			break;
+			
 		case BLE_IPS_EVT_LED_MODE_RX:
 			//KIT_LOG(TAG, "Led mode access, write: set mode = %d.", p_evt->params.rx_data.p_data[0]);
 			break;
@@ -309,10 +935,16 @@ static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 {
     uint32_t err_code = NRF_SUCCESS;
 
-    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
+    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED && connProfileReq == BLE_CONN_PROFILE_BURST)
+    {
+		// a central that refuses the short interval keeps the link as it is
+		linkStat.rejectCnt++;
+		KIT_LOG(TAG, "Burst conn profile refused!");
+    }
+    else if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
     {
 		//KIT_LOG(TAG, "Connect params evt failed!");
-        err_code = sd_ble_gap_disconnect(m_conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
+        err_code = sd_ble_gap_disconnect(p_evt->conn_handle, BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
         APP_ERROR_CHECK(err_code);
     }
 }
@@ -349,6 +981,220 @@ static void conn_params_init(void)
 }
 
 
+static void adv_ramp_set(uint8_t step)
+{
+	ble_adv_modes_config_t config = m_advertising.adv_modes_config;
+	
+	config.ble_adv_slow_interval = advRamp[step].interval;
+	config.ble_adv_slow_timeout = advRamp[step].duration;
+	ble_advertising_modes_config_set(&m_advertising, &config);
+	advRampStep = step;
+}
+
+/* Disconnect to connect time, whatever advertising stage brought the central back */
+static void adv_reconnect_track(ble_gap_addr_t const *pPeerAddr)
+{
+	uint32_t latency = Timer_GetCnt() - disconnectTime;
+	
+	lastPeerAddr = *pPeerAddr;
+	lastPeerValid = true;
+	if(!reconnectPending)
+	{
+		return;
+	}
+	
+	reconnectPending = false;
+	linkStat.reconnectCnt++;
+	linkStat.reconnectLast = latency;
+	if(latency > linkStat.reconnectMax)
+	{
+		linkStat.reconnectMax = latency;
+	}
+	linkStat.reconnectStage = advStage;
+	KIT_LOG(TAG, "Reconnect in %d ms, adv stage %d.", latency, advStage);
+}
+
+/* Everything the primary link runs, from its connect or from a monitor link claiming the slot */
+static void primary_link_up(ble_gap_conn_params_t const *pParams, ble_gap_addr_t const *pPeerAddr)
+{
+	uint32_t err_code;
+	
+	KIT_LOG(TAG, "Connected!");
+	m_ips.conn_handle = bleLink[BLE_LINK_PRIMARY].connHandle;// the service may have taken a monitor link that came first
+	err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, bleLink[BLE_LINK_PRIMARY].connHandle);
+	APP_ERROR_CHECK(err_code);
+	conn_profile_start(pParams);
+	adv_reconnect_track(pPeerAddr);
+	sd_ble_gap_rssi_start(bleLink[BLE_LINK_PRIMARY].connHandle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
+	err_code = app_timer_start(m_battery_timer_id, BLE_BATT_UPDATE_INTERVAL, NULL);
+	APP_ERROR_CHECK(err_code);
+	battery_level_update_handle(NULL);
+	Aps_StartLoop();
+	Cfg_StartLoop();
+	Idc_SetType(INDICATE_CONNECTED);
+#if BLE_MONITOR_LINK_ENABLED
+	// keep a slot open for the monitor
+	if(bleLinkCnt > 1 && bleLink[BLE_LINK_MONITOR].connHandle == BLE_CONN_HANDLE_INVALID)
+	{
+		adv_ramp_set(0);
+		monitor_adv_restart(BLE_ADV_MODE_SLOW);
+	}
+#endif
+}
+
+/*
+ * Without bonding a central is only known by the address it last connected with as primary. 
+ * An address match gets the primary slot back straight away. Any other central, including the 
+ * last one with a rotated private address, waits on the monitor slot, or on standby when that is 
+ * taken, until it claims the free primary with a pump command.
+ */
+static eBleLink_t link_assign(ble_gap_addr_t const *pPeerAddr)
+{
+#if BLE_MONITOR_LINK_ENABLED
+	if(bleLinkCnt > 1 && !(bleLink[BLE_LINK_PRIMARY].connHandle == BLE_CONN_HANDLE_INVALID 
+		&& lastPeerValid && lastPeerAddr.addr_type == pPeerAddr->addr_type 
+		&& memcmp(lastPeerAddr.addr, pPeerAddr->addr, BLE_GAP_ADDR_LEN) == 0))
+	{
+		return (bleLink[BLE_LINK_MONITOR].connHandle == BLE_CONN_HANDLE_INVALID) ? BLE_LINK_MONITOR : BLE_LINK_STANDBY;
+	}
+#endif
+	return BLE_LINK_PRIMARY;
+}
+
+#if BLE_MONITOR_LINK_ENABLED
+/* A standby link moves up once the monitor slot frees */
+static void link_standby_move(void)
+{
+	if(bleLink[BLE_LINK_STANDBY].connHandle == BLE_CONN_HANDLE_INVALID || bleLink[BLE_LINK_MONITOR].connHandle != BLE_CONN_HANDLE_INVALID)
+	{
+		return;
+	}
+	
+	KIT_LOG(TAG, "Standby link takes the monitor slot!");
+	bleLink[BLE_LINK_MONITOR] = bleLink[BLE_LINK_STANDBY];
+	bleLink[BLE_LINK_STANDBY].connHandle = BLE_CONN_HANDLE_INVALID;
+	bleLink[BLE_LINK_STANDBY].state = BLE_STATE_ADV;
+	app_timer_start(monitorStatTimer, BLE_MONITOR_STAT_INTERVAL, NULL);
+}
+#endif
+
+/* True for the primary link, a monitor or standby link becomes it with a pump command while the primary slot is free */
+static bool link_claim(uint16_t connHandle)
+{
+#if BLE_MONITOR_LINK_ENABLED
+	eBleLink_t link = link_find(connHandle);
+	ble_ips_client_context_t *pClient;
+	
+	if(link != BLE_LINK_PRIMARY && link != BLE_LINK_NUM && bleLink[BLE_LINK_PRIMARY].connHandle == BLE_CONN_HANDLE_INVALID)
+	{
+		KIT_LOG(TAG, "Link %d claims the primary!", link);
+		if(link == BLE_LINK_MONITOR)
+		{
+			app_timer_stop(monitorStatTimer);
+			notify_clear(BLE_LINK_MONITOR);
+		}
+		bleLink[BLE_LINK_PRIMARY] = bleLink[link];
+		bleLink[link].connHandle = BLE_CONN_HANDLE_INVALID;
+		bleLink[link].state = BLE_STATE_ADV;
+		link_standby_move();
+		primary_link_up(&bleLink[BLE_LINK_PRIMARY].connParams, &bleLink[BLE_LINK_PRIMARY].peerAddr);
+		linkStat.attMtu = nrf_ble_gatt_eff_mtu_get(&m_gatt, connHandle);// exchanged before the claim
+		// subscribed before the claim, the service kept it per link
+		if(blcm_link_ctx_get(m_ips.p_link_ctx_storage, connHandle, (void *)&pClient) == NRF_SUCCESS)
+		{
+			tickSubscribed = pClient->is_tmr_tick_notification_enabled;
+			tick_start();
+		}
+	}
+#endif
+	return connHandle == bleLink[BLE_LINK_PRIMARY].connHandle;
+}
+
+static void adv_status_fill(void)
+{
+	uint32_t now = Timer_GetCnt();
+	uint16_t rxCnt = Subg_GetRxPktCnt();
+	
+	if(rxCnt != advStatusRxCnt)
+	{
+		advStatusRxCnt = rxCnt;
+		advStatusRxTime = now;
+		advStatusRxSeen = true;
+	}
+	
+	advStatus.version = BLE_ADV_STATUS_VERSION;
+	advStatus.battLevel = Batt_GetLevel();
+	advStatus.fwMajor = FW_VERSION_MAJOR;
+	advStatus.fwMinor = FW_VERSION_MINOR;
+	advStatus.hwMajor = HW_VERSION_MAJOR;
+	advStatus.hwMinor = HW_VERSION_MINOR;
+	advStatus.pumpRssi = advStatusRxSeen ? (int8_t)Subg_GetRssi() : 0;
+	advStatus.flags = (advStatusRxSeen && now - advStatusRxTime < BLE_ADV_STATUS_PUMP_WINDOW_MS) ? BLE_ADV_STATUS_PUMP_RECENT : 0;
+	advStatus.uptime = now / 60000;
+	Kit_ReverseTwoBytes(&advStatus.uptime);
+}
+
+static void adv_data_build(ble_advdata_t *pAdvData, ble_advdata_t *pSrData, ble_advdata_manuf_data_t *pManuf)
+{
+	adv_status_fill();
+	memset(pManuf, 0, sizeof(ble_advdata_manuf_data_t));
+	pManuf->company_identifier = BLE_ADV_STATUS_COMPANY_ID;
+	pManuf->data.p_data = (uint8_t *)&advStatus;
+	pManuf->data.size = sizeof(advStatus);
+	
+    memset(pAdvData, 0, sizeof(ble_advdata_t));
+    pAdvData->name_type               = BLE_ADVDATA_FULL_NAME;
+    pAdvData->include_appearance      = false;
+    pAdvData->flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+    pAdvData->uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
+    pAdvData->uuids_complete.p_uuids  = m_adv_uuids;
+	
+    memset(pSrData, 0, sizeof(ble_advdata_t));
+    pSrData->name_type               = BLE_ADVDATA_SHORT_NAME;
+    pSrData->short_name_len          = BLE_ADV_SR_NAME_MAX_LEN;
+    pSrData->p_manuf_specific_data   = pManuf;
+}
+
+/* Swap in freshly encoded data while advertising keeps running */
+static void adv_status_update(void)
+{
+	ble_advdata_t advdata;
+	ble_advdata_t srdata;
+	ble_advdata_manuf_data_t manuf;
+	ble_gap_adv_data_t newData;
+	uint16_t advLen = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+	uint16_t srLen = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+	uint8_t idx;
+	
+	// directed advertising carries no data
+	if(bleLink[BLE_LINK_PRIMARY].state != BLE_STATE_ADV || advStage == BLE_ADV_STAGE_DIRECTED)
+	{
+		return;
+	}
+	
+	CRITICAL_REGION_ENTER();
+	idx = advEncIdx ^ 1;
+	adv_data_build(&advdata, &srdata, &manuf);
+	if(ble_advdata_encode(&advdata, advEncBuf[idx], &advLen) == NRF_SUCCESS &&
+	   ble_advdata_encode(&srdata, advSrEncBuf[idx], &srLen) == NRF_SUCCESS)
+	{
+		newData.adv_data.p_data = advEncBuf[idx];
+		newData.adv_data.len = advLen;
+		newData.scan_rsp_data.p_data = advSrEncBuf[idx];
+		newData.scan_rsp_data.len = srLen;
+		if(ble_advertising_advdata_update(&m_advertising, &newData, false) == NRF_SUCCESS)
+		{
+			advEncIdx = idx;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+static void adv_status_handle(void *pContext)
+{
+	adv_status_update();
+}
+
 /**@brief Function for handling advertising events.
  *
  * @details This function will be called for advertising events which are passed to the application.
@@ -359,10 +1205,36 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 {
     switch (ble_adv_evt)
     {
+        case BLE_ADV_EVT_PEER_ADDR_REQUEST:
+			// no reply falls through to fast advertising
+			if(lastPeerValid)
+			{
+				ble_advertising_peer_addr_reply(&m_advertising, &lastPeerAddr);
+			}
+            break;
+			
+        case BLE_ADV_EVT_DIRECTED_HIGH_DUTY:
+			advStage = BLE_ADV_STAGE_DIRECTED;
+            break;
+			
         case BLE_ADV_EVT_FAST:
+			advStage = BLE_ADV_STAGE_FAST;
+			adv_ramp_set(0);
+			adv_status_update();
+            break;
+			
+        case BLE_ADV_EVT_SLOW:
+			advStage = BLE_ADV_STAGE_SLOW + advRampStep;
+			adv_status_update();
             break;
 
         case BLE_ADV_EVT_IDLE:
+			// a slow step timed out, go on with the next one
+			if(advRampStep + 1 < sizeof(advRamp) / sizeof(advRamp[0]))
+			{
+				adv_ramp_set(advRampStep + 1);
+				ble_advertising_start(&m_advertising, BLE_ADV_MODE_SLOW);
+			}
             break;
 
         default:
@@ -376,22 +1248,20 @@ static void advertising_init(void)
 {
     uint32_t               err_code = NRF_SUCCESS;
     ble_advertising_init_t init;
+	ble_advdata_manuf_data_t manuf;
 
     memset(&init, 0, sizeof(init));
+	adv_data_build(&init.advdata, &init.srdata, &manuf);
 
-    init.advdata.name_type               = BLE_ADVDATA_FULL_NAME;
-    init.advdata.include_appearance      = false;
-    init.advdata.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-    init.advdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
-    init.advdata.uuids_complete.p_uuids  = m_adv_uuids;
-
+    init.config.ble_adv_directed_high_duty_enabled = true;
     init.config.ble_adv_fast_enabled  = true;
-    init.config.ble_adv_fast_interval = BLE_ADV_INTERVAL;
-    init.config.ble_adv_fast_timeout  = BLE_ADV_DURATION;
-    init.config.ble_adv_on_disconnect_disabled = false;
+    init.config.ble_adv_fast_interval = BLE_ADV_FAST_INTERVAL;
+    init.config.ble_adv_fast_timeout  = BLE_ADV_FAST_DURATION;
+    init.config.ble_adv_slow_enabled  = true;
+    init.config.ble_adv_slow_interval = advRamp[0].interval;
+    init.config.ble_adv_slow_timeout  = advRamp[0].duration;
+    init.config.ble_adv_on_disconnect_disabled = (BLE_MONITOR_LINK_ENABLED != 0);// the other link may still be up
     init.evt_handler = on_adv_evt;
-	
-    init.srdata.name_type               = BLE_ADVDATA_FULL_NAME;
 
     err_code = ble_advertising_init(&m_advertising, &init);
     APP_ERROR_CHECK(err_code);
@@ -419,13 +1289,41 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 {
     uint32_t err_code = NRF_SUCCESS;
 	ble_gap_conn_sec_mode_t sec_mode;
+	eBleLink_t link;
 
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_DISCONNECTED:
+			link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+			if(link == BLE_LINK_NUM)
+			{
+				break;
+			}
+			bleLink[link].connHandle = BLE_CONN_HANDLE_INVALID;
+			bleLink[link].state = BLE_STATE_ADV;
+			notify_clear(link);
+#if BLE_MONITOR_LINK_ENABLED
+			if(link != BLE_LINK_PRIMARY)
+			{
+				KIT_LOG(TAG, "Link %d disconnected!", link);
+				if(link == BLE_LINK_MONITOR)
+				{
+					app_timer_stop(monitorStatTimer);
+					link_standby_move();
+				}
+				// a slot is free again, fast while the primary one is still open
+				adv_ramp_set(0);
+				monitor_adv_restart((bleLink[BLE_LINK_PRIMARY].state == BLE_STATE_CONNECTED) ? BLE_ADV_MODE_SLOW : BLE_ADV_MODE_FAST);
+				break;
+			}
+#endif
             KIT_LOG(TAG, "Disconnected!");
-			sd_ble_gap_rssi_stop(m_conn_handle);
-            m_conn_handle = BLE_CONN_HANDLE_INVALID;
+			sd_ble_gap_rssi_stop(p_ble_evt->evt.gap_evt.conn_handle);
+			disconnectTime = Timer_GetCnt();
+			reconnectPending = true;
+			conn_profile_stop();
+			tickSubscribed = false;
+			app_timer_stop(tickTimer);
 			Fct_StopLoop();
 			Aps_StopLoop();
 			Cfg_StopLoop();
@@ -441,31 +1339,83 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 			}
 			else
 			{
+#if BLE_MONITOR_LINK_ENABLED
+				monitor_adv_restart(BLE_ADV_MODE_DIRECTED_HIGH_DUTY);
+#endif
 				Idc_SetType(INDICATE_DISCONNECTED);
 			}
-			bleState = BLE_STATE_ADV;
             break;
 
         case BLE_GAP_EVT_CONNECTED:
-            KIT_LOG(TAG, "Connected!");
-            m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
-            APP_ERROR_CHECK(err_code);
-			tx_power_set(BLE_TX_POWER_LEVEL);
-            sd_ble_gap_rssi_start(m_conn_handle, BLE_GAP_RSSI_THRESHOLD_INVALID, 0);
-			err_code = app_timer_start(m_battery_timer_id, BLE_BATT_UPDATE_INTERVAL, NULL);
-			APP_ERROR_CHECK(err_code);
-			battery_level_update_handle(NULL);
-			Aps_StartLoop();
-			Cfg_StartLoop();
-			Idc_SetType(INDICATE_CONNECTED);
-			bleState = BLE_STATE_CONNECTED;
+			link = link_assign(&p_ble_evt->evt.gap_evt.params.connected.peer_addr);
+			bleLink[link].connHandle = p_ble_evt->evt.gap_evt.conn_handle;
+			bleLink[link].state = BLE_STATE_CONNECTED;
+			tx_power_set(bleLink[link].connHandle, BLE_TX_POWER_LEVEL);
+#if BLE_MONITOR_LINK_ENABLED
+			if(link != BLE_LINK_PRIMARY)
+			{
+				bleLink[link].connParams = p_ble_evt->evt.gap_evt.params.connected.conn_params;
+				bleLink[link].peerAddr = p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+				KIT_LOG(TAG, "Link %d connected!", link);
+				if(link == BLE_LINK_MONITOR)
+				{
+					app_timer_start(monitorStatTimer, BLE_MONITOR_STAT_INTERVAL, NULL);
+				}
+				// the primary slot is still free
+				if(bleLink[BLE_LINK_PRIMARY].connHandle == BLE_CONN_HANDLE_INVALID && bleLink[BLE_LINK_STANDBY].connHandle == BLE_CONN_HANDLE_INVALID)
+				{
+					adv_ramp_set(0);
+					monitor_adv_restart(BLE_ADV_MODE_FAST);
+				}
+				break;
+			}
+#endif
+			primary_link_up(&p_ble_evt->evt.gap_evt.params.connected.conn_params, &p_ble_evt->evt.gap_evt.params.connected.peer_addr);
             break;
 			
 		case BLE_GATTS_EVT_HVN_TX_COMPLETE:
-			//KIT_LOG(TAG, "Ble tx comolete.");
+			notify_tx_complete(p_ble_evt->evt.gatts_evt.conn_handle, p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count);
 			break;
 
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+#if BLE_MONITOR_LINK_ENABLED
+			link = link_find(p_ble_evt->evt.gap_evt.conn_handle);
+			if(link != BLE_LINK_PRIMARY && link != BLE_LINK_NUM)
+			{
+				bleLink[link].connParams = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params;
+				break;
+			}
+#endif
+			if(p_ble_evt->evt.gap_evt.conn_handle != bleLink[BLE_LINK_PRIMARY].connHandle)
+			{
+				break;
+			}
+			conn_profile_track(&p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params);
+			KIT_LOG(TAG, "Conn interval %d x 1.25ms, latency %d.", linkStat.interval, linkStat.latency);
+			if(phyUpdatePending)
+			{
+				conn_phy_request();
+			}
+            break;
+			
+		case BLE_GAP_EVT_PHY_UPDATE:
+			if(p_ble_evt->evt.gap_evt.conn_handle == bleLink[BLE_LINK_PRIMARY].connHandle)
+			{
+				conn_phy_track(&p_ble_evt->evt.gap_evt.params.phy_update);
+			}
+			break;
+			
+#if BLE_MONITOR_LINK_ENABLED
+		case BLE_EVT_USER_MEM_REQUEST:
+			// queued writes are taken on the primary link only, nrf_ble_qwr answers those
+			if(p_ble_evt->evt.common_evt.conn_handle != bleLink[BLE_LINK_PRIMARY].connHandle)
+			{
+				err_code = sd_ble_user_mem_reply(p_ble_evt->evt.common_evt.conn_handle, NULL);
+				APP_ERROR_CHECK(err_code);
+			}
+			break;
+#endif
+			
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
             //KIT_LOG(TAG, "PHY update request.");
@@ -482,14 +1432,14 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
         case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
             // Pairing not supported
             //KIT_LOG(TAG, "Pairing not supported.");
-            err_code = sd_ble_gap_sec_params_reply(m_conn_handle, BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP, NULL, NULL);
+            err_code = sd_ble_gap_sec_params_reply(p_ble_evt->evt.gap_evt.conn_handle, BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP, NULL, NULL);
             APP_ERROR_CHECK(err_code);
             break;
 
         case BLE_GATTS_EVT_SYS_ATTR_MISSING:
             // No system attributes have been stored.
             //KIT_LOG(TAG, "No system attributes have been stored.");
-            err_code = sd_ble_gatts_sys_attr_set(m_conn_handle, NULL, 0, 0);
+            err_code = sd_ble_gatts_sys_attr_set(p_ble_evt->evt.gatts_evt.conn_handle, NULL, 0, 0);
             APP_ERROR_CHECK(err_code);
             break;
 
@@ -518,6 +1468,11 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 /**@brief Function for handling events from the GATT library. */
 static void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
 {
+	if(p_evt->evt_id == NRF_BLE_GATT_EVT_ATT_MTU_UPDATED && p_evt->conn_handle == bleLink[BLE_LINK_PRIMARY].connHandle)
+	{
+		linkStat.attMtu = p_evt->params.att_mtu_effective;
+		KIT_LOG(TAG, "ATT MTU %d.", linkStat.attMtu);
+	}
 }
 
 /**@brief   Function for initializing the GATT module.
@@ -560,9 +1515,54 @@ static void soc_evt_handler(uint32_t evt_id, void * p_context)
  *
  * @details Initializes the SoftDevice and the BLE event interrupt.
  */
+/* Longer connection events and a deeper notification queue let one event carry a whole response */
+static uint32_t ble_throughput_cfg_set(uint16_t eventLength, uint8_t hvnQueueSize, uint32_t ramStart)
+{
+    ble_cfg_t ble_cfg;
+    uint32_t err_code;
+	
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag = BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gap_conn_cfg.conn_count = bleLinkCnt;
+    ble_cfg.conn_cfg.params.gap_conn_cfg.event_length = eventLength;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GAP, &ble_cfg, ramStart);
+	if(err_code != NRF_SUCCESS)
+	{
+		return err_code;
+	}
+	
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.conn_cfg.conn_cfg_tag = BLE_CONN_CFG_TAG;
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = hvnQueueSize;
+    err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ramStart);
+	if(err_code == NRF_SUCCESS)
+	{
+		notifyStat.eventLength = eventLength;
+		notifyStat.hvnQueueSize = hvnQueueSize;
+	}
+	
+	return err_code;
+}
+
+#if BLE_MONITOR_LINK_ENABLED
+/* Each link costs SoftDevice RAM for its connection event and buffers, the monitor is dropped first when it does not fit */
+static uint32_t ble_link_cnt_set(uint8_t linkCnt, uint32_t ramStart)
+{
+    ble_cfg_t ble_cfg;
+	
+    memset(&ble_cfg, 0, sizeof(ble_cfg));
+    ble_cfg.gap_cfg.role_count_cfg.adv_set_count = BLE_GAP_ADV_SET_COUNT_DEFAULT;
+    ble_cfg.gap_cfg.role_count_cfg.periph_role_count = linkCnt;
+	bleLinkCnt = linkCnt;
+	
+    return sd_ble_cfg_set(BLE_GAP_CFG_ROLE_COUNT, &ble_cfg, ramStart);
+}
+#endif
+
 static void ble_stack_init(void)
 {
     ret_code_t err_code = NRF_SUCCESS;
+	ble_opt_t opt;
 	
     // Initialize the async SVCI interface to bootloader before any interrupts are enabled.
     err_code = ble_dfu_buttonless_async_svci_init();
@@ -574,10 +1574,38 @@ static void ble_stack_init(void)
     // Fetch the start address of the application RAM.
     uint32_t ram_start = 0;
     err_code = nrf_sdh_ble_default_cfg_set(BLE_CONN_CFG_TAG, &ram_start);
+    APP_ERROR_CHECK(err_code);
+	err_code = ble_throughput_cfg_set(BLE_CONN_EVENT_LENGTH, BLE_HVN_TX_QUEUE_SIZE, ram_start);
     APP_ERROR_CHECK(err_code);
 
-    // Enable BLE stack.
+    // Enable BLE stack, the default config still fits when the board profile needs more RAM than the app leaves.
     err_code = nrf_sdh_ble_enable(&ram_start);
+#if BLE_MONITOR_LINK_ENABLED
+	if(err_code == NRF_ERROR_NO_MEM)
+	{
+		KIT_LOG(TAG, "Monitor link needs RAM start 0x%08x, left out!", ram_start);
+		nrf_sdh_ble_app_ram_start_get(&ram_start);
+		err_code = ble_link_cnt_set(1, ram_start);
+		APP_ERROR_CHECK(err_code);
+		err_code = ble_throughput_cfg_set(BLE_CONN_EVENT_LENGTH, BLE_HVN_TX_QUEUE_SIZE, ram_start);
+		APP_ERROR_CHECK(err_code);
+		err_code = nrf_sdh_ble_enable(&ram_start);
+	}
+#endif
+	if(err_code == NRF_ERROR_NO_MEM)
+	{
+		KIT_LOG(TAG, "Throughput profile needs RAM start 0x%08x, using defaults!", ram_start);
+		nrf_sdh_ble_app_ram_start_get(&ram_start);
+		err_code = ble_throughput_cfg_set(NRF_SDH_BLE_GAP_EVENT_LENGTH, BLE_GATTS_HVN_TX_QUEUE_SIZE_DEFAULT, ram_start);
+		APP_ERROR_CHECK(err_code);
+		err_code = nrf_sdh_ble_enable(&ram_start);
+	}
+    APP_ERROR_CHECK(err_code);
+	
+	// let a connection event run past the event length while there is data and no other radio activity
+	memset(&opt, 0, sizeof(opt));
+	opt.common_opt.conn_evt_ext.enable = 1;
+	err_code = sd_ble_opt_set(BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
     APP_ERROR_CHECK(err_code);
 
     // Register a handler for BLE events.
@@ -635,6 +1663,11 @@ void Ble_Init(void)
 {
     ret_code_t err_code;
 	
+	Kit_QueueListInit(&notifyList[BLE_NOTIFY_CH_IPS]);
+	Kit_QueueListInit(&notifyList[BLE_NOTIFY_CH_NUS]);
+#if BLE_MONITOR_LINK_ENABLED
+	Kit_QueueListInit(&notifyList[BLE_NOTIFY_CH_MONITOR]);
+#endif
 	ble_stack_init();
 	Cfg_StorageLoad();
 	gap_params_init();
@@ -646,41 +1679,66 @@ void Ble_Init(void)
 
     err_code = app_timer_create(&m_battery_timer_id, APP_TIMER_MODE_REPEATED, battery_level_update_handle);
     APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&connIdleTimer, APP_TIMER_MODE_SINGLE_SHOT, conn_idle_handle);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&connRateTimer, APP_TIMER_MODE_SINGLE_SHOT, conn_rate_handle);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&advStatusTimer, APP_TIMER_MODE_REPEATED, adv_status_handle);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&tickTimer, APP_TIMER_MODE_REPEATED, tick_handle);
+    APP_ERROR_CHECK(err_code);
+	err_code = app_timer_start(advStatusTimer, BLE_ADV_STATUS_INTERVAL, NULL);
+    APP_ERROR_CHECK(err_code);
+#if BLE_MONITOR_LINK_ENABLED
+    err_code = app_timer_create(&monitorStatTimer, APP_TIMER_MODE_REPEATED, monitor_stat_handle);
+    APP_ERROR_CHECK(err_code);
+#endif
 			
 	KIT_LOG(TAG, "Init OK!");
 }
 
+/* data is copied, the caller may reuse it on return */
 void Ble_NusSendData(uint8_t *data, uint8_t len) 
 {
-	uint32_t err_code = NRF_SUCCESS;
-	
-	err_code = ble_nus_data_send(&m_nus, data, (uint16_t *)(&len), m_conn_handle);
-	
-	if(err_code != NRF_SUCCESS)
-	{
-		KIT_LOG(TAG, "Nus send data error!");
-	}
+	notify_queue(BLE_NOTIFY_CH_NUS, data, len);
 }
 
+/* data is copied, the caller may reuse it on return */
 void Ble_IpsNotifyRespCntAndSendData(uint8_t *data, int len) 
 {
-	uint32_t err_code = NRF_SUCCESS;
-	
-	err_code = ble_ips_data_send(data, len, &m_ips);
-	
-	if(err_code == NRF_SUCCESS)
+	notify_queue(BLE_NOTIFY_CH_IPS, data, (len < 0) ? 0xffff : (uint16_t)len);
+	if(len > 0)
 	{
-		ble_ips_response_cnt_notify(&m_ips);
+		monitor_send(BLE_MONITOR_FRAME_RESP, data, len);
 	}
-	else
+}
+
+eBleState_t Ble_GetState(void) 
+{
+	return bleLink[BLE_LINK_PRIMARY].state;
+}
+
+/* Profile times include the running part of the current connection */
+void Ble_GetLinkStat(stBleLinkStat_t *pStat)
+{
+	*pStat = linkStat;
+	if(bleLink[BLE_LINK_PRIMARY].connHandle != BLE_CONN_HANDLE_INVALID)
 	{
-		KIT_LOG(TAG, "Ips notify error!");
+		pStat->profileTime[linkStat.profile] += Timer_GetCnt() - connProfileStart;
 	}
 }
 
-eBleState_t Ble_GetState(void) 
+void Ble_GetNotifyStat(stBleNotifyStat_t *pStat)
+{
+	*pStat = notifyStat;
+	pStat->depth = notifyNodeCnt;
+	pStat->maxDepth = notifyNodeMaxCnt;
+}
+
+/* A new period takes effect right away on a subscribed link */
+void Ble_UpdateTickPeriod(void)
 {
-	return bleState;
+	tick_start();
 }
 
 
@@ -1,7 +1,9 @@
 #include "app_timer.h"
 #include "ble_ips.h"
 #include "kit_fifo.h"
+#include "kit_heap.h"
 #include "kit_log.h"
+#include "kit_utils.h"
 #include "led.h"
 #include "motor.h"
 #if defined(BOARD_XH_5102)	
@@ -12,15 +14,19 @@
 #include "app_ble.h"
 #include "app_battery.h"
 #include "app_config.h"
+#include "app_sys.h"
+#include "app_aps.h"
+#include "app_factory.h"
+#include "app_store.h"
+#include "app_subg.h"
 
 #define TAG "CFG"
 
-#define CFG_STORE_ADDR			FLASH_PAGE_0_ADDR
 #define CFG_INIT_FLG			0xAA55AA55
 #define CFG_MOTION_DATA_SIZE	16 
 
 #define CFG_REQ_PARA_MAX_LEN	2
-#define CFG_REQ_QUEUE_SIZE		2// 2 = actually only one
+#define CFG_REQ_QUEUE_SIZE		1// power of 2
 #define CFG_REQ_LOOP_TIME_MS   	100
 
 #define CFG_RESP_SUCCESS 		0xaa
@@ -30,7 +36,17 @@
 
 #define CFG_RESP_HEADER_TYPE_ERR_LEN   	3
 
-#define CFG_UPDATE_TIMEOUT     	20
+#define CFG_DIAG_PAGE_MEM		0x00
+#define CFG_DIAG_PAGE_BATT		0x01
+#define CFG_DIAG_PAGE_LINK		0x02
+#define CFG_DIAG_PAGE_NOTIFY	0x03
+#define CFG_DIAG_PAGE_SUBG		0x04
+#define CFG_DIAG_PAGE_HEAP		0x05
+
+#define CFG_TICK_PERIOD_DEFAULT	60// s
+#define CFG_TICK_PERIOD_MAX		240// s, app_timer takes up to half the 24 bit RTC range
+
+#define CFG_UPDATE_TIMEOUT     	500// ms, changes within this window are saved together
 
 APP_TIMER_DEF(m_cfg_update_timer_id);
 APP_TIMER_DEF(cfgReqLoopTimer);
@@ -41,6 +57,8 @@ typedef enum
 	CFG_REQ_MOTION_DATA_SET,
 	CFG_REQ_BATT_VOLT_GET,
 	CFG_REQ_CALLING,
+	CFG_REQ_DIAG_GET,
+	CFG_REQ_TICK_PERIOD,// no parameter reads it, one byte sets it
 	CFG_REQ_NONE = 0xff
 }eCfgReqType_t;
 
@@ -57,10 +75,17 @@ typedef struct
 	uint32_t initFlg;
 }stMotionCfg_t;
 
+typedef struct
+{
+	uint8_t period;// s, 0 turns the timer tick off
+	uint32_t initFlg;
+}stTickCfg_t;
+
 typedef struct
 {
 	stBleCfg_t ble;
 	stMotionCfg_t motion;
+	stTickCfg_t tick;
 }stCfgStorage_t;
 
 typedef struct __attribute__((packed)) 
@@ -74,6 +99,116 @@ typedef struct __attribute__((packed))
 	uint8_t	voltLow;
 }stRespBatt;
 
+typedef struct __attribute__((packed)) 
+{
+	uint8_t	period;
+}stRespTick_t;
+
+// diagnostics page 0: RAM high-water marks, 16-bit values are big endian
+typedef struct __attribute__((packed)) 
+{
+	uint16_t stackSize;
+	uint16_t stackMaxUsed;
+	uint16_t cmdStackMaxUsed;
+	uint16_t apsScratchMaxUsed;
+	uint8_t	apsQueueMaxCnt;
+	uint8_t	cfgQueueMaxCnt;
+	uint8_t	fctQueueMaxCnt;
+	uint8_t	timerOpQueueMaxCnt;
+}stDiagMem_t;
+
+// diagnostics page 1: battery, idle and under subg tx load, in mv, big endian
+typedef struct __attribute__((packed)) 
+{
+	uint16_t idleVoltage;
+	uint16_t loadVoltage;
+	uint16_t loadMinVoltage;
+	uint16_t deferCnt;// idle samples moved away from radio activity
+	uint8_t	level;
+}stDiagBatt_t;
+
+// diagnostics page 2: ble link, times in ms, big endian
+typedef struct __attribute__((packed)) 
+{
+	uint8_t	profile;// eBleConnProfile_t the granted interval falls in
+	uint16_t interval;// 1.25ms units
+	uint16_t latency;
+	uint32_t idleTime;
+	uint32_t burstTime;
+	uint16_t updateCnt;
+	uint16_t rateLimitCnt;
+	uint16_t rejectCnt;
+	uint8_t txPhy;// BLE_GAP_PHY_xxx
+	uint8_t rxPhy;
+	uint16_t attMtu;
+	uint16_t dataLen;
+	uint16_t phyFailCnt;
+	uint32_t cmdNoRspCnt;
+	uint16_t cmdLostCnt;
+	uint16_t reconnectCnt;
+	uint32_t reconnectLast;
+	uint32_t reconnectMax;
+	uint8_t	reconnectStage;// eBleAdvStage_t
+}stDiagLink_t;
+
+// diagnostics page 3: ble response queue, latency in ms, big endian
+typedef struct __attribute__((packed)) 
+{
+	uint32_t sentCnt;
+	uint16_t dropCnt;
+	uint16_t busyCnt;
+	uint16_t lastLatency;
+	uint16_t maxLatency;
+	uint8_t	depth;
+	uint8_t	maxDepth;
+	uint32_t hvnEvtCnt;// hvnPktCnt / hvnEvtCnt is the notifications per connection event
+	uint32_t hvnPktCnt;
+	uint8_t	hvnPerEvtMax;
+	uint8_t	eventLength;// 1.25ms units
+	uint8_t	hvnQueueSize;
+	uint16_t tickCnt;
+	uint16_t tickSkipCnt;
+}stDiagNotify_t;
+
+// diagnostics page 4: rf69 FIFO timing against the BLE radio events, big endian
+typedef struct __attribute__((packed)) 
+{
+	uint16_t rxOverrunCnt;
+	uint16_t txUnderrunCnt;
+	uint16_t bleOverlapCnt;
+	uint16_t blePrefillCnt;
+}stDiagSubg_t;
+
+// diagnostics page 5: one entry per heap size class, smallest first, big endian
+typedef struct __attribute__((packed)) 
+{
+	uint16_t blockSize;
+	uint8_t	blockCnt;
+	uint8_t	usedCnt;
+	uint8_t	maxUsedCnt;
+	uint16_t failCnt;// no block left in the class or a larger one
+	uint16_t guardErrCnt;
+}stDiagHeapClass_t;
+
+typedef struct __attribute__((packed)) 
+{
+	stDiagHeapClass_t heapClass[KIT_HEAP_CLASS_NUM];
+}stDiagHeap_t;
+
+typedef struct __attribute__((packed)) 
+{
+	uint8_t	page;
+    union 
+    {
+		stDiagMem_t mem;
+		stDiagBatt_t batt;
+		stDiagLink_t link;
+		stDiagNotify_t notify;
+		stDiagSubg_t subg;
+		stDiagHeap_t heap;
+    }__attribute__((packed)) data;
+}stRespDiag_t;
+
 typedef struct __attribute__((packed)) 
 {
 	uint8_t header;
@@ -83,6 +218,8 @@ typedef struct __attribute__((packed))
     {
 		stRespMotion_t motion;
 		stRespBatt batt;
+		stRespTick_t tick;
+		stRespDiag_t diag;
     }__attribute__((packed)) para;
 }stCfgRespPkt_t;
 
@@ -106,10 +243,18 @@ static stCfgRespPkt_t cfgRespPkt =
 static stCfgStorage_t config;
 static bool cfgLoopStart = false;
 
+static void cfg_save(void)
+{
+	// queued without waiting for flash, unchanged records are skipped by the store
+	Store_WriteAsync(STORE_KEY_CFG_BLE, &config.ble, sizeof(config.ble));
+	Store_WriteAsync(STORE_KEY_CFG_MOTION, &config.motion, sizeof(config.motion));
+	Store_WriteAsync(STORE_KEY_CFG_TICK, &config.tick, sizeof(config.tick));
+}
+
 static void cfg_update_handle(void * p_context)
 {
-	Flash_Write((uint32_t)CFG_STORE_ADDR, (void const *)(&config), sizeof(stCfgStorage_t));
-	KIT_LOG(TAG, "Update success!");
+	cfg_save();
+	KIT_LOG(TAG, "Update queued!");
 }
 
 static void motion_data_get(void) 
@@ -186,6 +331,224 @@ static void calling(void)
 }
 #endif
 
+static uint16_t diag_mem_page(stDiagMem_t *pMem)
+{
+	pMem->stackSize = Sys_GetStackSize();
+	Kit_ReverseTwoBytes(&pMem->stackSize);
+	pMem->stackMaxUsed = Sys_GetStackMaxUsed();
+	Kit_ReverseTwoBytes(&pMem->stackMaxUsed);
+	pMem->cmdStackMaxUsed = Aps_GetCmdStackMaxUsed();
+	Kit_ReverseTwoBytes(&pMem->cmdStackMaxUsed);
+	pMem->apsScratchMaxUsed = Aps_GetScratchMaxUsed();
+	Kit_ReverseTwoBytes(&pMem->apsScratchMaxUsed);
+	pMem->apsQueueMaxCnt = Aps_GetCmdQueueMaxCnt();
+	pMem->cfgQueueMaxCnt = Kit_FifoStructMaxCntGet(&cfgReqQueue);
+	pMem->fctQueueMaxCnt = Fct_GetReqQueueMaxCnt();
+	pMem->timerOpQueueMaxCnt = app_timer_op_queue_utilization_get();
+	
+	return sizeof(stDiagMem_t);
+}
+
+static uint16_t diag_batt_page(stDiagBatt_t *pBatt)
+{
+	pBatt->idleVoltage = Batt_GetVoltage();
+	Kit_ReverseTwoBytes(&pBatt->idleVoltage);
+	pBatt->loadVoltage = Batt_GetLoadVoltage();
+	Kit_ReverseTwoBytes(&pBatt->loadVoltage);
+	pBatt->loadMinVoltage = Batt_GetLoadMinVoltage();
+	Kit_ReverseTwoBytes(&pBatt->loadMinVoltage);
+	pBatt->deferCnt = Batt_GetDeferCnt();
+	Kit_ReverseTwoBytes(&pBatt->deferCnt);
+	pBatt->level = Batt_GetLevel();
+	
+	return sizeof(stDiagBatt_t);
+}
+
+static uint16_t diag_link_page(stDiagLink_t *pLink)
+{
+	stBleLinkStat_t stat;
+	
+	Ble_GetLinkStat(&stat);
+	pLink->profile = (uint8_t)stat.profile;
+	pLink->interval = stat.interval;
+	Kit_ReverseTwoBytes(&pLink->interval);
+	pLink->latency = stat.latency;
+	Kit_ReverseTwoBytes(&pLink->latency);
+	pLink->idleTime = stat.profileTime[BLE_CONN_PROFILE_IDLE];
+	Kit_ReverseFourBytes(&pLink->idleTime);
+	pLink->burstTime = stat.profileTime[BLE_CONN_PROFILE_BURST];
+	Kit_ReverseFourBytes(&pLink->burstTime);
+	pLink->updateCnt = stat.updateCnt;
+	Kit_ReverseTwoBytes(&pLink->updateCnt);
+	pLink->rateLimitCnt = stat.rateLimitCnt;
+	Kit_ReverseTwoBytes(&pLink->rateLimitCnt);
+	pLink->rejectCnt = stat.rejectCnt;
+	Kit_ReverseTwoBytes(&pLink->rejectCnt);
+	pLink->txPhy = stat.txPhy;
+	pLink->rxPhy = stat.rxPhy;
+	pLink->attMtu = stat.attMtu;
+	Kit_ReverseTwoBytes(&pLink->attMtu);
+	pLink->dataLen = stat.dataLen;
+	Kit_ReverseTwoBytes(&pLink->dataLen);
+	pLink->phyFailCnt = stat.phyFailCnt;
+	Kit_ReverseTwoBytes(&pLink->phyFailCnt);
+	pLink->cmdNoRspCnt = stat.cmdNoRspCnt;
+	Kit_ReverseFourBytes(&pLink->cmdNoRspCnt);
+	pLink->cmdLostCnt = stat.cmdLostCnt;
+	Kit_ReverseTwoBytes(&pLink->cmdLostCnt);
+	pLink->reconnectCnt = stat.reconnectCnt;
+	Kit_ReverseTwoBytes(&pLink->reconnectCnt);
+	pLink->reconnectLast = stat.reconnectLast;
+	Kit_ReverseFourBytes(&pLink->reconnectLast);
+	pLink->reconnectMax = stat.reconnectMax;
+	Kit_ReverseFourBytes(&pLink->reconnectMax);
+	pLink->reconnectStage = stat.reconnectStage;
+	
+	return sizeof(stDiagLink_t);
+}
+
+static uint16_t diag_notify_page(stDiagNotify_t *pNotify)
+{
+	stBleNotifyStat_t stat;
+	
+	Ble_GetNotifyStat(&stat);
+	pNotify->sentCnt = stat.sentCnt;
+	Kit_ReverseFourBytes(&pNotify->sentCnt);
+	pNotify->dropCnt = stat.dropCnt;
+	Kit_ReverseTwoBytes(&pNotify->dropCnt);
+	pNotify->busyCnt = stat.busyCnt;
+	Kit_ReverseTwoBytes(&pNotify->busyCnt);
+	pNotify->lastLatency = stat.lastLatency;
+	Kit_ReverseTwoBytes(&pNotify->lastLatency);
+	pNotify->maxLatency = stat.maxLatency;
+	Kit_ReverseTwoBytes(&pNotify->maxLatency);
+	pNotify->depth = stat.depth;
+	pNotify->maxDepth = stat.maxDepth;
+	pNotify->hvnEvtCnt = stat.hvnEvtCnt;
+	Kit_ReverseFourBytes(&pNotify->hvnEvtCnt);
+	pNotify->hvnPktCnt = stat.hvnPktCnt;
+	Kit_ReverseFourBytes(&pNotify->hvnPktCnt);
+	pNotify->hvnPerEvtMax = stat.hvnPerEvtMax;
+	pNotify->eventLength = stat.eventLength;
+	pNotify->hvnQueueSize = stat.hvnQueueSize;
+	pNotify->tickCnt = stat.tickCnt;
+	Kit_ReverseTwoBytes(&pNotify->tickCnt);
+	pNotify->tickSkipCnt = stat.tickSkipCnt;
+	Kit_ReverseTwoBytes(&pNotify->tickSkipCnt);
+	
+	return sizeof(stDiagNotify_t);
+}
+
+static uint16_t diag_subg_page(stDiagSubg_t *pSubg)
+{
+	stSubgFifoStat_t stat;
+	
+	Subg_GetFifoStat(&stat);
+	pSubg->rxOverrunCnt = stat.rxOverrunCnt;
+	Kit_ReverseTwoBytes(&pSubg->rxOverrunCnt);
+	pSubg->txUnderrunCnt = stat.txUnderrunCnt;
+	Kit_ReverseTwoBytes(&pSubg->txUnderrunCnt);
+	pSubg->bleOverlapCnt = stat.bleOverlapCnt;
+	Kit_ReverseTwoBytes(&pSubg->bleOverlapCnt);
+	pSubg->blePrefillCnt = stat.blePrefillCnt;
+	Kit_ReverseTwoBytes(&pSubg->blePrefillCnt);
+	
+	return sizeof(stDiagSubg_t);
+}
+
+static uint16_t diag_heap_page(stDiagHeap_t *pHeap)
+{
+	stKitHeapStat_t stat;
+	stDiagHeapClass_t *pClass;
+	uint8_t i;
+	
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		pClass = &pHeap->heapClass[i];
+		Kit_HeapStatGet(i, &stat);
+		pClass->blockSize = stat.blockSize;
+		Kit_ReverseTwoBytes(&pClass->blockSize);
+		pClass->blockCnt = stat.blockCnt;
+		pClass->usedCnt = stat.usedCnt;
+		pClass->maxUsedCnt = stat.maxUsedCnt;
+		pClass->failCnt = stat.failCnt;
+		Kit_ReverseTwoBytes(&pClass->failCnt);
+		pClass->guardErrCnt = stat.guardErrCnt;
+		Kit_ReverseTwoBytes(&pClass->guardErrCnt);
+	}
+	
+	return sizeof(stDiagHeap_t);
+}
+
+static void diag_get(const uint8_t *pBuf, uint8_t len) 
+{	
+	uint16_t pageLen = 0;
+	
+	cfgRespPkt.type = CFG_REQ_DIAG_GET;	
+	cfgRespPkt.para.diag.page = (len > 0) ? pBuf[0] : CFG_DIAG_PAGE_MEM;
+	
+	switch(cfgRespPkt.para.diag.page)
+	{
+		case CFG_DIAG_PAGE_MEM:
+			pageLen = diag_mem_page(&cfgRespPkt.para.diag.data.mem);
+			break;
+			
+		case CFG_DIAG_PAGE_BATT:
+			pageLen = diag_batt_page(&cfgRespPkt.para.diag.data.batt);
+			break;
+			
+		case CFG_DIAG_PAGE_LINK:
+			pageLen = diag_link_page(&cfgRespPkt.para.diag.data.link);
+			break;
+			
+		case CFG_DIAG_PAGE_NOTIFY:
+			pageLen = diag_notify_page(&cfgRespPkt.para.diag.data.notify);
+			break;
+			
+		case CFG_DIAG_PAGE_SUBG:
+			pageLen = diag_subg_page(&cfgRespPkt.para.diag.data.subg);
+			break;
+			
+		case CFG_DIAG_PAGE_HEAP:
+			pageLen = diag_heap_page(&cfgRespPkt.para.diag.data.heap);
+			break;
+			
+		default:
+			break;
+	}
+	
+	if(pageLen == 0)
+	{
+		cfgRespPkt.errCode = CFG_RESP_PARAM_ERROR;
+		Ble_NusSendData((uint8_t *)&cfgRespPkt, CFG_RESP_HEADER_TYPE_ERR_LEN);
+		return;
+	}
+	
+	cfgRespPkt.errCode = CFG_RESP_SUCCESS;
+	Ble_NusSendData((uint8_t *)&cfgRespPkt, CFG_RESP_HEADER_TYPE_ERR_LEN + 1 + pageLen);
+}
+
+static void tick_period(const uint8_t *pBuf, uint8_t len) 
+{	
+	cfgRespPkt.type = CFG_REQ_TICK_PERIOD;
+	if(len > 1 || (len == 1 && pBuf[0] > CFG_TICK_PERIOD_MAX))
+	{
+		cfgRespPkt.errCode = CFG_RESP_PARAM_ERROR;
+		Ble_NusSendData((uint8_t *)&cfgRespPkt, CFG_RESP_HEADER_TYPE_ERR_LEN);
+		return;
+	}
+	
+	if(len == 1 && pBuf[0] != config.tick.period)
+	{
+		config.tick.period = pBuf[0];
+		Ble_UpdateTickPeriod();
+		app_timer_start(m_cfg_update_timer_id, APP_TIMER_TICKS(CFG_UPDATE_TIMEOUT), NULL);
+	}
+	cfgRespPkt.errCode = CFG_RESP_SUCCESS;
+	cfgRespPkt.para.tick.period = config.tick.period;
+	Ble_NusSendData((uint8_t *)&cfgRespPkt, sizeof(stRespTick_t) + CFG_RESP_HEADER_TYPE_ERR_LEN);
+}
+
 static void req_type_err(uint8_t type) 
 {		
 	cfgRespPkt.type = type;
@@ -226,6 +589,16 @@ static void cfg_req_loop(void *pContext)
 			break;
 		#endif
 		
+		case CFG_REQ_DIAG_GET:
+			KIT_LOG(TAG, "CFG_REQ_DIAG_GET.");
+			diag_get(req.para, req.paraLen);
+			break;
+			
+		case CFG_REQ_TICK_PERIOD:
+			KIT_LOG(TAG, "CFG_REQ_TICK_PERIOD.");
+			tick_period(req.para, req.paraLen);
+			break;
+		
 		default:
 			req_type_err((uint8_t)req.type);
 			KIT_LOG(TAG, "Unkown cmd 0x%02x.", req.type);
@@ -284,7 +657,17 @@ void Cfg_StorageLoad(void)
 	bool flag = false;
 	
 	//fstorage calling must after stack init.
-	Flash_Read(&config, CFG_STORE_ADDR, sizeof(config));
+	Store_Init();
+	
+	// start from what the old fixed layout left in page 0, records override it
+	memset(&config, 0, sizeof(config));
+	Store_Read(STORE_KEY_LEGACY_PAGE0, &config, sizeof(config));
+	if(Store_Read(STORE_KEY_CFG_BLE, &config.ble, sizeof(config.ble)) != sizeof(config.ble)
+		|| Store_Read(STORE_KEY_CFG_MOTION, &config.motion, sizeof(config.motion)) != sizeof(config.motion))
+	{
+		flag = true;
+	}
+	
 	if(config.ble.advNameInitFlg != CFG_INIT_FLG)
 	{
 		config.ble.advNameLen = strlen(BLE_DEFAULT_NAME);
@@ -293,6 +676,15 @@ void Cfg_StorageLoad(void)
 		flag = true;
 	}
 	
+	// added after the other records, a missing one alone gets its default
+	if(Store_Read(STORE_KEY_CFG_TICK, &config.tick, sizeof(config.tick)) != sizeof(config.tick)
+		|| config.tick.initFlg != CFG_INIT_FLG)
+	{
+		config.tick.period = CFG_TICK_PERIOD_DEFAULT;
+		config.tick.initFlg = CFG_INIT_FLG;
+		flag = true;
+	}
+	
 	if(config.motion.initFlg != CFG_INIT_FLG)
 	{
 		config.motion.data[0] = 1;
@@ -303,7 +695,8 @@ void Cfg_StorageLoad(void)
 
 	if(flag)
 	{
-		Flash_Write((uint32_t)CFG_STORE_ADDR, (void const *)(&config), sizeof(stCfgStorage_t));
+		cfg_save();
+		Store_Delete(STORE_KEY_LEGACY_PAGE0);
 	}
 }
 
@@ -312,7 +705,7 @@ void Cfg_SetAdvName(const uint8_t *data, uint16_t len)
 	memcpy(config.ble.advName, data, len);
 	//config.ble.advNameInitFlg = CFG_INIT_FLG;
 	config.ble.advNameLen = len;
-	app_timer_start(m_cfg_update_timer_id, CFG_UPDATE_TIMEOUT, NULL);
+	app_timer_start(m_cfg_update_timer_id, APP_TIMER_TICKS(CFG_UPDATE_TIMEOUT), NULL);
 }
 
 uint8_t* Cfg_GetAdvName(void)
@@ -335,6 +728,11 @@ uint8_t Cfg_GetMotionData1(void)
 	return config.motion.data[1];
 }
 
+uint8_t Cfg_GetTickPeriod(void)
+{
+	return config.tick.period;
+}
+
 void Cfg_Init(void)
 {
     ret_code_t err_code;
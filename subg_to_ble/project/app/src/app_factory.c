@@ -9,6 +9,7 @@
 #include "app_battery.h"
 #include "ocp.h"
 #include "boards.h"
+#include "app_store.h"
 #include "led.h"
 #include "motor.h"
 #include "app_battery.h"
@@ -18,7 +19,7 @@
 #define TAG "FAC"
 
 #define FCT_REQ_PARA_MAX_LEN	20
-#define FCT_REQ_QUEUE_SIZE		2// 2 = actually only one
+#define FCT_REQ_QUEUE_SIZE		1// power of 2
 #define FCT_REQ_LOOP_TIME_MS   	50
 
 #define FCT_RESP_SUCCESS 		0xaa
@@ -33,7 +34,6 @@
 #define FCT_TEST_FREQ_916   	916548000
 
 #define FCT_SN_INIT_FLG			0xAA55AA55
-#define FCT_SN_STORE_ADDR		FLASH_PAGE_1_ADDR
 #define FCT_SN_CODE_SIZE		4 
 
 APP_TIMER_DEF(fctReqLoopTimer);
@@ -115,6 +115,8 @@ static stFctRespPkt_t fctRespPkt =
 	.errCode = FCT_RESP_SENSOR_FAIL,
 	.para = {0}
 };
+static bool snBurnWait = false;// the SN burn response waits for the record to be programmed
+static volatile uint8_t snBurnErrCode = 0;// set by the store completion, 0 = not done yet
 
 static void yellow_led_on(void) 
 {	 
@@ -276,14 +278,25 @@ static void batt_level_get(void)
 	}
 }
 
+static bool sn_load(stSnStorage_t *pSnStorage)
+{
+	if(Store_Read(STORE_KEY_SN, pSnStorage, sizeof(stSnStorage_t)) == sizeof(stSnStorage_t))
+	{
+		return pSnStorage->initFlg == FCT_SN_INIT_FLG;
+	}
+	
+	// burned before the record store, the SN is still in the old page 1 layout
+	return Store_Read(STORE_KEY_LEGACY_PAGE1, pSnStorage, sizeof(stSnStorage_t)) >= sizeof(stSnStorage_t)
+		&& pSnStorage->initFlg == FCT_SN_INIT_FLG;
+}
+
 static void sn_burn(const uint8_t *pBuf, uint8_t len) 
 {	 
-	stSnStorage_t snStorage;
+	static stSnStorage_t snStorage;// read by the store when the record is programmed
 
-	Flash_Read(&snStorage, FCT_SN_STORE_ADDR, sizeof(snStorage));
 	fctRespPkt.type = FCT_REQ_SN_BURN;
 	
-	if(snStorage.initFlg == FCT_SN_INIT_FLG)
+	if(sn_load(&snStorage))
 	{
 		fctRespPkt.errCode = FCT_RESP_SENSOR_FAIL;
 	}
@@ -295,12 +308,48 @@ static void sn_burn(const uint8_t *pBuf, uint8_t len)
 	{
 		snStorage.initFlg = FCT_SN_INIT_FLG;
 		memcpy(snStorage.code, pBuf, len);
-		Flash_Write((uint32_t)FCT_SN_STORE_ADDR, &snStorage, sizeof(stSnStorage_t));
-		fctRespPkt.errCode = FCT_RESP_SUCCESS;
+		snBurnErrCode = 0;
+		snBurnWait = true;
+		if(Store_WriteAsync(STORE_KEY_SN, &snStorage, sizeof(stSnStorage_t)))
+		{
+			// answered by fct_req_loop() once the store reports the record
+			return;
+		}
+		snBurnWait = false;
+		fctRespPkt.errCode = FCT_RESP_SENSOR_FAIL;
 	}
 	Ble_NusSendData((uint8_t *)&fctRespPkt, FCT_RESP_HEADER_TYPE_ERR_LEN);
 }
 
+static void sn_burn_store_done(eStoreKey_t key, bool success)
+{
+	if(key == STORE_KEY_SN)
+	{
+		snBurnErrCode = success ? FCT_RESP_SUCCESS : FCT_RESP_SENSOR_FAIL;
+	}
+}
+
+/* Returns true while the SN record is still being programmed, later requests wait in the queue */
+static bool sn_burn_wait(void)
+{
+	if(!snBurnWait)
+	{
+		return false;
+	}
+	
+	if(snBurnErrCode == 0)
+	{
+		return true;
+	}
+	
+	snBurnWait = false;
+	fctRespPkt.type = FCT_REQ_SN_BURN;
+	fctRespPkt.errCode = snBurnErrCode;
+	Ble_NusSendData((uint8_t *)&fctRespPkt, FCT_RESP_HEADER_TYPE_ERR_LEN);
+	
+	return false;
+}
+
 static void version_get(void) 
 {	
 	fctRespPkt.type = FCT_REQ_VERSION_GET;
@@ -316,10 +365,8 @@ static void sn_get(void)
 {	
 	stSnStorage_t snStorage;
 	
-	Flash_Read(&snStorage, FCT_SN_STORE_ADDR, sizeof(snStorage));
-	
 	fctRespPkt.type = FCT_REQ_SN_GET;
-	if(snStorage.initFlg != FCT_SN_INIT_FLG)
+	if(!sn_load(&snStorage))
 	{
 		fctRespPkt.errCode = FCT_RESP_SENSOR_FAIL;
 		Ble_NusSendData((uint8_t *)&fctRespPkt, FCT_RESP_HEADER_TYPE_ERR_LEN);
@@ -343,7 +390,7 @@ static void fct_req_loop(void *pContext)
 {
 	stFctReqPkt_t req;
 	
-	if(!Kit_FifoStructOut(&fctReqQueue, (void *)&req, 1)) 
+	if(sn_burn_wait() || !Kit_FifoStructOut(&fctReqQueue, (void *)&req, 1)) 
 	{
 		return;
 	}
@@ -412,6 +459,7 @@ void Fct_Init(void)
 {
 	Kit_FifoStructCreate(&fctReqQueue, (void*)fctReqBuf, sizeof(fctReqBuf), sizeof(stFctReqPkt_t));
 	app_timer_create(&fctReqLoopTimer, APP_TIMER_MODE_REPEATED, fct_req_loop);
+	Store_SetDoneHandler(sn_burn_store_done);
 	KIT_LOG(TAG, "Init OK!");
 }
 
@@ -458,6 +506,7 @@ void Fct_StopLoop(void)
 	if(fctLoopStart)
 	{
 		fctLoopStart = false;
+		snBurnWait = false;
 		app_timer_stop(fctReqLoopTimer);
 		Idc_SetType(INDICATE_FAC_TEST_STOP);
 		if(Batt_IsLow())
@@ -479,4 +528,9 @@ void Fct_StopLoop(void)
 	}
 }
 
+uint32_t Fct_GetReqQueueMaxCnt(void)
+{
+	return Kit_FifoStructMaxCntGet(&fctReqQueue);
+}
+
 
@@ -0,0 +1,640 @@
+/**
+ *@file app_store.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief 
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+#include <stddef.h>
+
+#include "boards.h"
+#include "app_util_platform.h"
+#include "ocp.h"
+#include "kit_log.h"
+#include "kit_utils.h"
+#include "app_store.h"
+
+#define TAG "STORE"
+
+/*
+ * Records are appended to the active page: [key][len][crc16] then the data padded to a word.
+ * A newer record of a key replaces the older one, a zero length record deletes the key.
+ * When the active page is full the latest records are copied to the other page, and that
+ * page only becomes active once its header is written, so a power loss keeps the old page.
+ * At run time records are queued: each one is built in a RAM buffer when its turn comes and
+ * programmed by Flash_WriteAsync, the copy of a GC is chained the same way from flash events.
+ * The first boot formats page 1 and leaves the old layout of page 0 for the first GC to erase,
+ * the old page 1 is staged in the erased tail of page 0 before it is erased.
+ */
+#define STORE_PAGE_MAGIC		0x524F5453// "STOR"
+#define STORE_ERASED_WORD		0xFFFFFFFF
+#define STORE_ALIGN(len)		(((len) + 3) & ~3UL)
+#define STORE_CHUNK_SIZE		32
+#define STORE_LEGACY_SIZE		64// covers stCfgStorage_t and stSnStorage_t of the old layout
+#define STORE_STAGE_MAGIC		0x47415453// "STAG"
+#define STORE_STAGE_SLOT_NUM	8// one more slot is used by each format cut while staging
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t seq;
+}stStorePageHdr_t;
+
+typedef struct
+{
+	uint8_t  key;
+	uint8_t  len;
+	uint16_t crc;
+}stStoreRecHdr_t;
+
+/* Slots count down from the end of page 0, the magic is programmed last so a torn slot is never taken */
+typedef struct
+{
+	uint32_t data[STORE_LEGACY_SIZE / 4];
+	uint32_t crc;
+	uint32_t magic;
+}stStoreStage_t;
+
+#define STORE_PAGE_HDR_SIZE		sizeof(stStorePageHdr_t)
+#define STORE_REC_HDR_SIZE		sizeof(stStoreRecHdr_t)
+#define STORE_REC_SIZE(len)		(STORE_REC_HDR_SIZE + STORE_ALIGN(len))
+
+static uint32_t activePage = 0;// 0 = no valid page
+static uint32_t activeSeq = 0;
+static uint32_t writeOffset = FLASH_PAGE_SIZE;
+static uint16_t recOffset[STORE_KEY_NUM];// 0 = key not stored
+static uint32_t gcCnt = 0;
+
+typedef enum
+{
+	STORE_STATE_IDLE = 0,
+	STORE_STATE_WRITE,
+	STORE_STATE_GC_ERASE,
+	STORE_STATE_GC_COPY,
+	STORE_STATE_GC_HDR
+}eStoreState_t;
+
+typedef struct
+{
+	const void *pData;
+	uint32_t seq;// queue order, a key queued again moves behind the others
+	uint8_t len;
+}stStorePending_t;
+
+static volatile eStoreState_t storeState = STORE_STATE_IDLE;
+static stStorePending_t pending[STORE_KEY_NUM];
+static uint32_t pendingMask = 0;// keys waiting to be programmed
+static uint32_t pendingSeq = 0;
+static uint32_t recBuf[STORE_REC_SIZE(STORE_REC_MAX_LEN) / 4];// record being programmed
+static uint8_t opKey;
+static uint8_t opLen;
+static uint16_t opOffset;
+static bool gcDone = false;// a GC ran for the pending record, no further GC if it still does not fit
+static uint32_t gcPage;
+static uint16_t gcOffset;
+static uint8_t gcKey;
+static uint16_t gcRecOffset[STORE_KEY_NUM];
+static uint32_t failCnt = 0;
+static pfnStoreDone_t pfnStoreDone = NULL;
+
+static void store_run(void);
+static void store_flash_done(bool success, void *pContext);
+
+static void store_done(uint8_t key, bool success)
+{
+	if(pfnStoreDone != NULL)
+	{
+		pfnStoreDone((eStoreKey_t)key, success);
+	}
+}
+
+/* A failed GC leaves the queue stuck, every pending key is reported and dropped, the caller may queue it again */
+static void store_abort(void)
+{
+	uint32_t mask = pendingMask;
+	uint8_t key;
+	
+	pendingMask = 0;
+	gcDone = false;
+	storeState = STORE_STATE_IDLE;
+	for(key = 0; key < STORE_KEY_NUM; key++)
+	{
+		if((mask & (1UL << key)) != 0)
+		{
+			store_done(key, false);
+		}
+	}
+}
+
+static uint32_t other_page(uint32_t pageAddr)
+{
+	return (pageAddr == FLASH_PAGE_0_ADDR) ? FLASH_PAGE_1_ADDR : FLASH_PAGE_0_ADDR;
+}
+
+static bool page_hdr_get(uint32_t pageAddr, stStorePageHdr_t *pHdr)
+{
+	Flash_Read(pHdr, pageAddr, sizeof(stStorePageHdr_t));
+	
+	return pHdr->magic == STORE_PAGE_MAGIC;
+}
+
+static uint16_t rec_crc(uint32_t recAddr, const stStoreRecHdr_t *pHdr)
+{
+	uint32_t chunk[STORE_CHUNK_SIZE / 4];
+	uint32_t dataAddr = recAddr + STORE_REC_HDR_SIZE;
+	uint32_t left = pHdr->len;
+	uint32_t n;
+	uint16_t crc;
+	
+	crc = Kit_Crc16(&pHdr->key, 1, 0xFFFF);
+	crc = Kit_Crc16(&pHdr->len, 1, crc);
+	while(left > 0)
+	{
+		n = (left > STORE_CHUNK_SIZE) ? STORE_CHUNK_SIZE : left;
+		Flash_Read(chunk, dataAddr, n);
+		crc = Kit_Crc16((const uint8_t *)chunk, n, crc);
+		dataAddr += n;
+		left -= n;
+	}
+	
+	return crc;
+}
+
+static void page_scan(uint32_t pageAddr)
+{
+	stStoreRecHdr_t hdr;
+	uint32_t word;
+	uint32_t offset = STORE_PAGE_HDR_SIZE;
+	
+	memset(recOffset, 0, sizeof(recOffset));
+	
+	while(offset + STORE_REC_HDR_SIZE <= FLASH_PAGE_SIZE)
+	{
+		Flash_Read(&word, pageAddr + offset, sizeof(word));
+		if(word == STORE_ERASED_WORD)
+		{
+			break;
+		}
+		
+		memcpy(&hdr, &word, sizeof(hdr));
+		if(offset + STORE_REC_SIZE(hdr.len) > FLASH_PAGE_SIZE)
+		{
+			offset = FLASH_PAGE_SIZE;// torn header, nothing can be appended behind it
+			break;
+		}
+		
+		// a record torn by a power loss fails the crc and the previous one of its key stays valid
+		if(hdr.key < STORE_KEY_NUM && rec_crc(pageAddr + offset, &hdr) == hdr.crc)
+		{
+			recOffset[hdr.key] = (hdr.len > 0) ? offset : 0;
+		}
+		offset += STORE_REC_SIZE(hdr.len);
+	}
+	
+	writeOffset = offset;
+}
+
+/* The whole record in one program, words go out in order so the header still lands first */
+static uint32_t rec_build(eStoreKey_t key, const uint8_t *pData, uint8_t len)
+{
+	stStoreRecHdr_t hdr;
+	
+	hdr.key = key;
+	hdr.len = len;
+	hdr.crc = Kit_Crc16(&hdr.key, 1, 0xFFFF);
+	hdr.crc = Kit_Crc16(&hdr.len, 1, hdr.crc);
+	hdr.crc = Kit_Crc16(pData, len, hdr.crc);
+	
+	memset(recBuf, 0xFF, STORE_REC_SIZE(len));
+	memcpy(recBuf, &hdr, sizeof(hdr));
+	memcpy((uint8_t *)recBuf + STORE_REC_HDR_SIZE, pData, len);
+	
+	return STORE_REC_SIZE(len);
+}
+
+/* Blocking, from recBuf too since fstorage only takes word aligned data, for the boot format only */
+static void rec_program(uint32_t recAddr, eStoreKey_t key, const uint8_t *pData, uint8_t len)
+{
+	Flash_Program(recAddr, recBuf, rec_build(key, pData, len));
+}
+
+static bool rec_equal(uint32_t recAddr, const uint8_t *pData, uint8_t len)
+{
+	uint32_t chunk[STORE_CHUNK_SIZE / 4];
+	stStoreRecHdr_t hdr;
+	uint32_t n;
+	
+	Flash_Read(&hdr, recAddr, sizeof(hdr));
+	if(hdr.len != len)
+	{
+		return false;
+	}
+	
+	recAddr += STORE_REC_HDR_SIZE;
+	while(len > 0)
+	{
+		n = (len > STORE_CHUNK_SIZE) ? STORE_CHUNK_SIZE : len;
+		Flash_Read(chunk, recAddr, n);
+		if(memcmp(chunk, pData, n) != 0)
+		{
+			return false;
+		}
+		pData += n;
+		recAddr += n;
+		len -= n;
+	}
+	
+	return true;
+}
+
+static void store_gc_copy_next(void)
+{
+	stStorePageHdr_t pageHdr;
+	stStoreRecHdr_t hdr;
+	uint32_t size;
+	uint16_t offset;
+	
+	for(; gcKey < STORE_KEY_NUM; gcKey++)
+	{
+		gcRecOffset[gcKey] = 0;
+		if(recOffset[gcKey] == 0)
+		{
+			continue;
+		}
+		
+		Flash_Read(&hdr, activePage + recOffset[gcKey], sizeof(hdr));
+		size = STORE_REC_SIZE(hdr.len);
+		Flash_Read(recBuf, activePage + recOffset[gcKey], size);
+		offset = gcOffset;
+		gcRecOffset[gcKey++] = offset;
+		gcOffset += size;
+		storeState = STORE_STATE_GC_COPY;
+		if(!Flash_WriteAsync(gcPage + offset, recBuf, size, store_flash_done, NULL))
+		{
+			failCnt++;
+			store_abort();
+		}
+		return;
+	}
+	
+	pageHdr.magic = STORE_PAGE_MAGIC;
+	pageHdr.seq = activeSeq + 1;
+	memcpy(recBuf, &pageHdr, sizeof(pageHdr));
+	storeState = STORE_STATE_GC_HDR;
+	if(!Flash_WriteAsync(gcPage, recBuf, sizeof(pageHdr), store_flash_done, NULL))
+	{
+		failCnt++;
+		store_abort();
+	}
+}
+
+static void store_gc_start(void)
+{
+	gcPage = other_page(activePage);
+	gcOffset = STORE_PAGE_HDR_SIZE;
+	gcKey = 0;
+	storeState = STORE_STATE_GC_ERASE;
+	if(!Flash_EraseAsync(gcPage, store_flash_done, NULL))
+	{
+		failCnt++;
+		store_abort();
+	}
+}
+
+/* Called from the SoftDevice event context when the queued flash operation is done */
+static void store_flash_done(bool success, void *pContext)
+{
+	eStoreState_t state = storeState;
+	
+	if(!success)
+	{
+		failCnt++;
+		KIT_LOG(TAG, "Flash operation failed in state %d.", state);
+	}
+	
+	switch(state)
+	{
+		case STORE_STATE_WRITE:
+			if(success)
+			{
+				recOffset[opKey] = (opLen > 0) ? opOffset : 0;
+				store_done(opKey, true);
+			}
+			else
+			{
+				// the record may be torn, the next one starts over on a fresh page
+				writeOffset = FLASH_PAGE_SIZE;
+				store_done(opKey, false);
+			}
+			storeState = STORE_STATE_IDLE;
+			store_run();
+			break;
+			
+		case STORE_STATE_GC_ERASE:
+		case STORE_STATE_GC_COPY:
+			if(success)
+			{
+				store_gc_copy_next();
+			}
+			else
+			{
+				store_abort();
+			}
+			break;
+			
+		case STORE_STATE_GC_HDR:
+			if(success)
+			{
+				activePage = gcPage;
+				activeSeq++;
+				writeOffset = gcOffset;
+				memcpy(recOffset, gcRecOffset, sizeof(recOffset));
+				gcCnt++;
+				gcDone = true;
+				KIT_LOG(TAG, "GC to page 0x%x, %d bytes used.", activePage, writeOffset);
+				storeState = STORE_STATE_IDLE;
+				store_run();
+			}
+			else
+			{
+				// the old page stays active
+				store_abort();
+			}
+			break;
+			
+		default:
+			break;
+	}
+}
+
+static bool flash_is_erased(uint32_t addr, uint32_t len)
+{
+	uint32_t word;
+	
+	for(; len >= sizeof(word); len -= sizeof(word), addr += sizeof(word))
+	{
+		Flash_Read(&word, addr, sizeof(word));
+		if(word != STORE_ERASED_WORD)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+/* Copy the old page 1 to a stage slot, or take the copy of a format that was cut after staging */
+static bool legacy_page1_stage(uint32_t *pLegacy)
+{
+	static stStoreStage_t stage;// word aligned source for Flash_Program
+	uint32_t slotAddr;
+	uint8_t i;
+	
+	for(i = 0; i < STORE_STAGE_SLOT_NUM; i++)
+	{
+		slotAddr = FLASH_PAGE_0_ADDR + FLASH_PAGE_SIZE - (i + 1) * sizeof(stStoreStage_t);
+		Flash_Read(&stage, slotAddr, sizeof(stage));
+		if(stage.magic == STORE_STAGE_MAGIC && stage.crc == Kit_Crc16((const uint8_t *)stage.data, sizeof(stage.data), 0xFFFF))
+		{
+			break;// page 1 may be erased already, the staged copy is the original
+		}
+		
+		if(flash_is_erased(slotAddr, sizeof(stage)))
+		{
+			Flash_Read(stage.data, FLASH_PAGE_1_ADDR, sizeof(stage.data));
+			stage.crc = Kit_Crc16((const uint8_t *)stage.data, sizeof(stage.data), 0xFFFF);
+			Flash_Program(slotAddr, &stage, offsetof(stStoreStage_t, magic));
+			stage.magic = STORE_STAGE_MAGIC;
+			Flash_Program(slotAddr + offsetof(stStoreStage_t, magic), &stage.magic, sizeof(stage.magic));
+			break;
+		}
+		// torn by a cut while staging, page 1 was not erased yet
+	}
+	
+	if(i == STORE_STAGE_SLOT_NUM)
+	{
+		return false;
+	}
+	
+	memcpy(pLegacy, stage.data, sizeof(stage.data));
+	return true;
+}
+
+/*
+ * First boot on the record store: the fixed layouts of both pages are kept as records on page 1.
+ * Page 0 is only read, and page 1 becomes valid with its header written last, so a power loss 
+ * at any point leaves the old layout to format again from on the next boot.
+ */
+static void store_format(void)
+{
+	uint32_t legacy[STORE_LEGACY_SIZE / 4];
+	stStorePageHdr_t pageHdr;
+	uint32_t offset = STORE_PAGE_HDR_SIZE;
+	
+	if(!legacy_page1_stage(legacy))
+	{
+		KIT_LOG(TAG, "No stage slot left.");
+		Flash_Read(legacy, FLASH_PAGE_1_ADDR, sizeof(legacy));
+	}
+	Flash_ErasePage(FLASH_PAGE_1_ADDR);
+	
+	rec_program(FLASH_PAGE_1_ADDR + offset, STORE_KEY_LEGACY_PAGE1, (const uint8_t *)legacy, sizeof(legacy));
+	offset += STORE_REC_SIZE(sizeof(legacy));
+	Flash_Read(legacy, FLASH_PAGE_0_ADDR, sizeof(legacy));
+	rec_program(FLASH_PAGE_1_ADDR + offset, STORE_KEY_LEGACY_PAGE0, (const uint8_t *)legacy, sizeof(legacy));
+	
+	pageHdr.magic = STORE_PAGE_MAGIC;
+	pageHdr.seq = 1;
+	Flash_Program(FLASH_PAGE_1_ADDR, &pageHdr, sizeof(pageHdr));
+	
+	activePage = FLASH_PAGE_1_ADDR;
+	activeSeq = pageHdr.seq;
+	page_scan(activePage);
+	KIT_LOG(TAG, "Formatted.");
+}
+
+void Store_Init(void)
+{
+	stStorePageHdr_t hdr0;
+	stStorePageHdr_t hdr1;
+	bool valid0 = page_hdr_get(FLASH_PAGE_0_ADDR, &hdr0);
+	bool valid1 = page_hdr_get(FLASH_PAGE_1_ADDR, &hdr1);
+	
+	if(valid0 && (!valid1 || (int32_t)(hdr0.seq - hdr1.seq) > 0))
+	{
+		activePage = FLASH_PAGE_0_ADDR;
+		activeSeq = hdr0.seq;
+	}
+	else if(valid1)
+	{
+		activePage = FLASH_PAGE_1_ADDR;
+		activeSeq = hdr1.seq;
+	}
+	else
+	{
+		store_format();
+		return;
+	}
+	
+	page_scan(activePage);
+	KIT_LOG(TAG, "Page 0x%x, seq %d, %d bytes used.", activePage, activeSeq, writeOffset);
+}
+
+/* Returns the stored length, at most size bytes are copied, 0 if the key is not stored */
+uint16_t Store_Read(eStoreKey_t key, void *pData, uint16_t size)
+{
+	stStoreRecHdr_t hdr;
+	
+	if(activePage == 0 || key >= STORE_KEY_NUM || recOffset[key] == 0)
+	{
+		return 0;
+	}
+	
+	Flash_Read(&hdr, activePage + recOffset[key], sizeof(hdr));
+	Flash_Read(pData, activePage + recOffset[key] + STORE_REC_HDR_SIZE, (hdr.len < size) ? hdr.len : size);
+	
+	return hdr.len;
+}
+
+/* The pending key queued first, records land in the order they were requested */
+static uint8_t pending_first(void)
+{
+	uint8_t first = STORE_KEY_NUM;
+	uint8_t key;
+	
+	for(key = 0; key < STORE_KEY_NUM; key++)
+	{
+		if((pendingMask & (1UL << key)) != 0 
+			&& (first == STORE_KEY_NUM || (int32_t)(pending[key].seq - pending[first].seq) < 0))
+		{
+			first = key;
+		}
+	}
+	
+	return first;
+}
+
+/* Program the next pending record, or start a GC when it does not fit, one operation at a time */
+static void store_run(void)
+{
+	uint32_t bit;
+	uint32_t size;
+	uint8_t key;
+	uint8_t len;
+	
+	CRITICAL_REGION_ENTER();
+	while(storeState == STORE_STATE_IDLE && pendingMask != 0)
+	{
+		key = pending_first();
+		bit = 1UL << key;
+		len = pending[key].len;
+		
+		if((len == 0 && recOffset[key] == 0)
+			|| (len > 0 && recOffset[key] != 0 && rec_equal(activePage + recOffset[key], (const uint8_t *)pending[key].pData, len)))
+		{
+			pendingMask &= ~bit;
+			store_done(key, true);
+			continue;
+		}
+		
+		if(writeOffset + STORE_REC_SIZE(len) > FLASH_PAGE_SIZE)
+		{
+			if(gcDone)
+			{
+				// the live records leave no room even on a fresh page
+				KIT_LOG(TAG, "No room for key %d.", key);
+				pendingMask &= ~bit;
+				gcDone = false;
+				store_done(key, false);
+				continue;
+			}
+			store_gc_start();
+			break;
+		}
+		
+		// the data is sampled now, later changes of the same key are picked up by the next record
+		size = rec_build((eStoreKey_t)key, (const uint8_t *)pending[key].pData, len);
+		pendingMask &= ~bit;
+		opKey = key;
+		opLen = len;
+		opOffset = writeOffset;
+		writeOffset += size;
+		gcDone = false;
+		storeState = STORE_STATE_WRITE;
+		if(!Flash_WriteAsync(activePage + opOffset, recBuf, size, store_flash_done, NULL))
+		{
+			// nothing was queued, the flash queue is full so the others would not get in either
+			writeOffset = opOffset;
+			storeState = STORE_STATE_IDLE;
+			failCnt++;
+			store_done(key, false);
+			store_abort();
+			break;
+		}
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+/*
+ * Queue a record without waiting for flash, pData is read when the record is programmed and must stay valid.
+ * Records are programmed in the order they are queued, a key queued again before that is written once 
+ * with the latest data, in the place of its last request.
+ */
+bool Store_WriteAsync(eStoreKey_t key, const void *pData, uint16_t len)
+{
+	if(activePage == 0 || key >= STORE_KEY_NUM || len > STORE_REC_MAX_LEN)
+	{
+		return false;
+	}
+	
+	CRITICAL_REGION_ENTER();
+	pending[key].pData = pData;
+	pending[key].len = len;
+	pending[key].seq = pendingSeq++;
+	pendingMask |= (1UL << key);
+	CRITICAL_REGION_EXIT();
+	store_run();
+	
+	return true;
+}
+
+/* Always queued: a first record of the key may still be in flight, store_run() drops it when nothing is stored */
+bool Store_Delete(eStoreKey_t key)
+{
+	return Store_WriteAsync(key, NULL, 0);
+}
+
+bool Store_IsBusy(void)
+{
+	return storeState != STORE_STATE_IDLE || pendingMask != 0;
+}
+
+/* Called when a queued record is programmed, already stored, or dropped for lack of room or a flash failure, may be in SoftDevice event context */
+void Store_SetDoneHandler(pfnStoreDone_t pfnDone)
+{
+	pfnStoreDone = pfnDone;
+}
+
+uint32_t Store_GetFreeSize(void)
+{
+	return (activePage == 0) ? 0 : FLASH_PAGE_SIZE - writeOffset;
+}
+
+uint32_t Store_GetGcCnt(void)
+{
+	return gcCnt;
+}
+
+uint32_t Store_GetFailCnt(void)
+{
+	return failCnt;
+}
@@ -19,8 +19,14 @@
 #include "kit_delay.h"
 #include "kit_log.h"
 #include "ocp.h"
+#include "app_battery.h"
+#include "nrf_soc.h"
+#include "nrf_nvic.h"
+#include "app_error.h"
+#include "app_util_platform.h"
 
 #define RF_MODULE_FIFO_SIZE			66
+#define RF_MODULE_FIFO_THRESH		15// RegFifoThresh as rf69.c sets it, the FIFO level flag is above this
 #define WAIT_FIFO_NOT_FULL_TIMEOUT	100//ms
 #define TX_TIMEOUT				 	150
 
@@ -29,20 +35,91 @@
 
 #define TX_BUF_SIZE 				255
 
+#define TX_REFILL_MAX_LEN			(RF_MODULE_FIFO_SIZE - RF_MODULE_FIFO_THRESH - 1)// fits whenever the FIFO level is not over the threshold
+
+#define BLE_RADIO_NOTIFY_DISTANCE	NRF_RADIO_NOTIFICATION_DISTANCE_1740US// time to top the FIFO up before a BLE event
+
 #define TAG "SUB"
 
 static uint16_t rxPktCnt = 0;
 static uint16_t txPktCnt = 0;
 static int rxPktRssi = -140;
 static bool cmdIntFlag = false;
+static volatile bool subgBusy = false;// a tx or rx is in progress
+static uint32_t subgIdleStart = 0;// Timer_GetCnt() when the radio last went to sleep, 0 if it has not run yet
 static eSubgMode_t subgMode = SUBG_MODE_MINIMED_NAS;
 static uint8_t txBuf[TX_BUF_SIZE] = {0};
-static uint8_t txBufLen;
+static uint16_t txBufLen;
+static volatile bool bleRadioActive = false;// between the notification before a BLE radio event and the one after it
+static volatile bool bleRadioPrefill = false;// a BLE radio event is coming up
+static stSubgFifoStat_t fifoStat;
+
+typedef struct
+{
+	uint8_t *pBuf;
+	uint8_t cnt;
+}stSubgRxCopy_t;
 
 static uint8_t pktLen;
 uint16_t preambleWord;
 static uint16_t preambleExtendMs;
 
+/* The SoftDevice toggles the notification on both edges of every BLE radio event */
+void RADIO_NOTIFICATION_IRQHandler(void)
+{
+	bleRadioActive = !bleRadioActive;
+	if(bleRadioActive)
+	{
+		bleRadioPrefill = true;
+	}
+}
+
+static void ble_radio_notify_init(void)
+{
+	uint32_t err_code;
+	
+	err_code = sd_nvic_ClearPendingIRQ(RADIO_NOTIFICATION_IRQn);
+	APP_ERROR_CHECK(err_code);
+	err_code = sd_nvic_SetPriority(RADIO_NOTIFICATION_IRQn, APP_IRQ_PRIORITY_LOW);
+	APP_ERROR_CHECK(err_code);
+	err_code = sd_nvic_EnableIRQ(RADIO_NOTIFICATION_IRQn);
+	APP_ERROR_CHECK(err_code);
+	err_code = sd_radio_notification_cfg_set(NRF_RADIO_NOTIFICATION_TYPE_INT_ON_BOTH, BLE_RADIO_NOTIFY_DISTANCE);
+	APP_ERROR_CHECK(err_code);
+}
+
+/*
+ * Called with the first burst in the FIFO, before TX mode. A full FIFO lasts 13ms at 40kbps and 32ms at 16kbps,
+ * longer than the CPU time a BLE event takes, so a TX starting inside one goes ahead instead of waiting for it.
+ */
+static void ble_radio_tx_start(void)
+{
+	if(bleRadioActive)
+	{
+		fifoStat.bleOverlapCnt++;
+	}
+	bleRadioPrefill = false;
+}
+
+/* True once per upcoming BLE radio event, the caller tops the FIFO up until it is full */
+static bool ble_radio_prefill_take(void)
+{
+	bool prefill = bleRadioPrefill;
+	
+	if(prefill)
+	{
+		bleRadioPrefill = false;
+		fifoStat.blePrefillCnt++;
+	}
+	
+	return prefill;
+}
+
+static eRf69Dev_t rf_dev(void)
+{
+	return (subgMode == SUBG_MODE_OMNIPOD) ? RF69_DEV_FREQ433 : RF69_DEV_FREQ916N868;
+}
+
 static bool wait_fifo_not_full(eRf69Dev_t dev) 
 {
 	uint16_t cnt;
@@ -78,23 +155,54 @@ static void wait_tx_done(eRf69Dev_t dev)
 static void minimed_tx(void)
 {
 	uint16_t txCnt = 0;
+	uint16_t burst;
+	uint16_t waitCnt = 0;
 	uint8_t zeroByte = 0x00;
+	bool prefill;
 	
 	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
 	Rf69_ClearFifo(RF69_DEV_FREQ916N868);
 	
 	txCnt = (txBufLen < RF_MODULE_FIFO_SIZE) ? txBufLen : RF_MODULE_FIFO_SIZE;
 	Rf69_XmitBuf(RF69_DEV_FREQ916N868, txBuf, txCnt);
+	ble_radio_tx_start();
 	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_TX);
-		
+	Batt_StartLoadMeasure();
+	
+	// one level read per poll, a refill below the threshold is a single burst sized to fit
 	while(txCnt < txBufLen) 
 	{	
-		if(!wait_fifo_not_full(RF69_DEV_FREQ916N868)) 
+		prefill = ble_radio_prefill_take();
+		if(prefill || !Rf69_IsFifoOverThreshold(RF69_DEV_FREQ916N868))
+		{
+			if(Rf69_IsFifoEmpty(RF69_DEV_FREQ916N868))
+			{
+				fifoStat.txUnderrunCnt++;
+			}
+			
+			if(prefill || bleRadioActive)
+			{
+				// the level is unknown ahead of a BLE event and the SoftDevice may preempt inside one, byte by byte until full
+				while(txCnt < txBufLen && !Rf69_IsFifoFull(RF69_DEV_FREQ916N868))
+				{
+					Rf69_XmitByte(RF69_DEV_FREQ916N868, txBuf[txCnt]);
+					txCnt++;
+				}
+			}
+			else
+			{
+				// about 110us at 4MHz, no BLE event can start inside the 1.74ms its notification leads by
+				burst = (txBufLen - txCnt < TX_REFILL_MAX_LEN) ? txBufLen - txCnt : TX_REFILL_MAX_LEN;
+				Rf69_XmitBuf(RF69_DEV_FREQ916N868, &txBuf[txCnt], burst);
+				txCnt += burst;
+			}
+			waitCnt = 0;
+		}
+		else if(++waitCnt >= WAIT_FIFO_NOT_FULL_TIMEOUT)
 		{
 			return;
 		}
-		Rf69_XmitByte(RF69_DEV_FREQ916N868, txBuf[txCnt]);
-		txCnt++;
+		Kit_DelayMs(1);
 	}
 	
 	if(wait_fifo_not_full(RF69_DEV_FREQ916N868)) 
@@ -106,18 +214,28 @@ static void minimed_tx(void)
 	wait_tx_done(RF69_DEV_FREQ916N868);
 }
 
+// On-air frame is 0xa5 0x5a, the tx buffer, then 0xff; read it in place instead of building a copy.
+static uint8_t omnipod_tx_byte(uint16_t index)
+{
+	if(index < 2)
+	{
+		return (index == 0) ? 0xa5 : 0x5a;
+	}
+	
+	if(index < txBufLen + 2)
+	{
+		return txBuf[index - 2];
+	}
+	
+	return (index == txBufLen + 2) ? 0xff : 0x00;
+}
+
 static void omnipod_tx(void)
 {
 	bool flag = false;
 	uint8_t timeCnt = 0;
-	uint8_t txCnt = 0;
-	uint8_t txLen = 0;
-	uint8_t txBufTmp[255] = {0};
-	
-	txBufTmp[0] = 0xa5;
-	txBufTmp[1] = 0x5a;
-	memcpy(txBufTmp + 2, txBuf, txBufLen);
-	txBufTmp[txBufLen + 2] = 0xff;
+	uint16_t txCnt = 0;
+	uint16_t txLen = 0;
 	
 	txLen = txBufLen + 3;
 	
@@ -137,12 +255,15 @@ static void omnipod_tx(void)
 		}
 	}
 	
+	ble_radio_tx_start();
 	Rf69_SetMode(RF69_DEV_FREQ433, RF69_MODE_TX);
+	Batt_StartLoadMeasure();
 	timeCnt = Timer_GetCnt();
 	
 	while((Timer_GetCnt() - timeCnt) < preambleExtendMs) 
 	{
-		if(!Rf69_IsFifoOverThreshold(RF69_DEV_FREQ433))
+		// refills wait for the threshold, ahead of a BLE event the FIFO is filled up now
+		if(ble_radio_prefill_take() || !Rf69_IsFifoOverThreshold(RF69_DEV_FREQ433))
 		{
 			while(!Rf69_IsFifoFull(RF69_DEV_FREQ433))
 			{
@@ -163,8 +284,12 @@ static void omnipod_tx(void)
 	
 	while (txCnt < txLen) 
 	{
-		if(!Rf69_IsFifoOverThreshold(RF69_DEV_FREQ433))
+		if(ble_radio_prefill_take() || !Rf69_IsFifoOverThreshold(RF69_DEV_FREQ433))
 		{
+			if(Rf69_IsFifoEmpty(RF69_DEV_FREQ433))
+			{
+				fifoStat.txUnderrunCnt++;
+			}
 			while(!Rf69_IsFifoFull(RF69_DEV_FREQ433))
 			{
 				if((txCnt == 0) && flag)
@@ -172,7 +297,7 @@ static void omnipod_tx(void)
 					Rf69_XmitByte(RF69_DEV_FREQ433, 0x65);
 				}
 				
-				Rf69_XmitByte(RF69_DEV_FREQ433, txBufTmp[txCnt]);
+				Rf69_XmitByte(RF69_DEV_FREQ433, omnipod_tx_byte(txCnt));
 				txCnt++;
 			}
 		}
@@ -185,10 +310,11 @@ static void omnipod_tx(void)
 	}
 }
 
-static eSubgRxStatus_t minimed_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeout) 
+static eSubgRxStatus_t minimed_rx(pfnSubgRxByte_t pfnRxByte, void *pContext, uint8_t* pRxLen, uint32_t timeout) 
 {	
 	uint8_t rxCnt = 0;
 	uint8_t rxByteTmp = 0;
+	uint8_t heldByte = 0;
 	uint32_t timeStart = 0;
 	 		
 	Rf69_SetMode(RF69_DEV_FREQ916N868, RF69_MODE_STANDBY);
@@ -209,7 +335,13 @@ static eSubgRxStatus_t minimed_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeo
 				break;
 			}
 			
-			pBuf[rxCnt++] = rxByteTmp;
+			// Hand over one byte late, the last one may still turn out to be a glitch.
+			if (rxCnt > 0)
+			{
+				pfnRxByte(pContext, heldByte);
+			}
+			heldByte = rxByteTmp;
+			rxCnt++;
 		}
 		
 		if(rxCnt >= RX_PAYLAOD_LEN_MINIMED722)
@@ -232,12 +364,15 @@ static eSubgRxStatus_t minimed_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeo
 	if (rxCnt > 0) 
 	{
 		// Remove spurious final byte consisting of just one or two high bits.
-		uint8_t b = pBuf[rxCnt - 1];
-		if (b == 0x80 || b == 0xC0) 
+		if (heldByte == 0x80 || heldByte == 0xC0) 
 		{
-			KIT_LOG(TAG, "End-of-packet glitch 0x%02x.", b >> 6);
+			KIT_LOG(TAG, "End-of-packet glitch 0x%02x.", heldByte >> 6);
 			rxCnt--;
 		}
+		else
+		{
+			pfnRxByte(pContext, heldByte);
+		}
 	}
 	
 	if (rxCnt > 0) 
@@ -249,7 +384,7 @@ static eSubgRxStatus_t minimed_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeo
 	return SUBG_RX_OK;
 }
 
-static eSubgRxStatus_t omnipod_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeout, uint8_t usePktLen) 
+static eSubgRxStatus_t omnipod_rx(pfnSubgRxByte_t pfnRxByte, void *pContext, uint8_t* pRxLen, uint32_t timeout, uint8_t usePktLen) 
 {	
 	uint8_t rxCnt = 0;
 	uint8_t rxByteTmp = 0;
@@ -274,7 +409,8 @@ static eSubgRxStatus_t omnipod_rx(uint8_t *pBuf, uint8_t* pRxLen, uint32_t timeo
 				break;
 			}
 			
-			pBuf[rxCnt++] = rxByteTmp;
+			pfnRxByte(pContext, rxByteTmp);
+			rxCnt++;
 		}
 		
 		if(rxCnt >= RX_PAYLAOD_LEN_OMNIPOD)
@@ -333,6 +469,9 @@ static void rf_tx_start(void)
 
 static void rf_stop(void)
 {
+	subgBusy = false;
+	subgIdleStart = Timer_GetCnt();
+	
 	switch(subgMode)
 	{
 		case SUBG_MODE_OMNIPOD:
@@ -359,12 +498,31 @@ eSubgMode_t Subg_GetMode(void)
 	return subgMode;	
 }
 
+static void rx_copy_byte(void *pContext, uint8_t byte)
+{
+	stSubgRxCopy_t *pCopy = (stSubgRxCopy_t *)pContext;
+	
+	pCopy->pBuf[pCopy->cnt++] = byte;
+}
+
+uint8_t *Subg_GetTxBuf(uint16_t *pSize)
+{
+	*pSize = TX_BUF_SIZE;
+	return txBuf;
+}
+
 void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt) 
+{
+	memcpy(txBuf, pBuf, len);
+	Subg_SendTxBuf(len, repeatCnt, repeatIntvl, preambleExt);
+}
+
+void Subg_SendTxBuf(uint16_t len, uint8_t repeatCnt, uint16_t repeatIntvl, uint16_t preambleExt) 
 {
 	uint16_t sendCnt = 0;
 	uint16_t totalSendCnt = repeatCnt + 1;
 	
-	memcpy(txBuf, pBuf, len);
+	subgBusy = true;
 	txBufLen = len;
 	preambleExtendMs = preambleExt;
 	
@@ -418,24 +576,43 @@ void Subg_SendPkt(uint8_t *pBuf, uint16_t len, uint8_t repeatCnt, uint16_t repea
 }
 
 eSubgRxStatus_t Subg_GetPkt(uint8_t *pRxBuf, uint8_t *pRxLen, uint32_t timeout, uint8_t usePktLen) 
+{
+	stSubgRxCopy_t copy = 
+	{
+		.pBuf = pRxBuf,
+		.cnt = 0,
+	};
+	
+	return Subg_ListenPkt(rx_copy_byte, &copy, pRxLen, timeout, usePktLen);
+}
+
+eSubgRxStatus_t Subg_ListenPkt(pfnSubgRxByte_t pfnRxByte, void *pContext, uint8_t *pRxLen, uint32_t timeout, uint8_t usePktLen) 
 {
 	eSubgRxStatus_t result;
 	
+	subgBusy = true;
 	switch(subgMode)
 	{
 		case SUBG_MODE_OMNIPOD:
-			result = omnipod_rx(pRxBuf, pRxLen, timeout, usePktLen);
+			result = omnipod_rx(pfnRxByte, pContext, pRxLen, timeout, usePktLen);
 			break;
 			
 		case SUBG_MODE_MINIMED_NAS:
 		case SUBG_MODE_MINIMED_WWL:
-			result = minimed_rx(pRxBuf, pRxLen, timeout);
+			result = minimed_rx(pfnRxByte, pContext, pRxLen, timeout);
 			break;
 			
 		default:
 			result = SUBG_RX_TIMEOUT;
 			break;
 	}
+	
+	// the flag is gone once the radio sleeps
+	if(Rf69_IsFifoOverrun(rf_dev()))
+	{
+		fifoStat.rxOverrunCnt++;
+		KIT_LOG(TAG, "Rx fifo overrun!");
+	}
 	rf_stop();
 	
 	return result;
@@ -462,6 +639,24 @@ void Subg_SetFreq(uint32_t freqHz)
 	}
 }
 
+void Subg_SetFrf(uint32_t frf) 
+{
+	switch(subgMode)
+	{
+		case SUBG_MODE_OMNIPOD:
+			Rf69_SetFrf(RF69_DEV_FREQ433, frf);
+			break;
+			
+		case SUBG_MODE_MINIMED_NAS:
+		case SUBG_MODE_MINIMED_WWL:
+			Rf69_SetFrf(RF69_DEV_FREQ916N868, frf);
+			break;
+			
+		default:
+			break;
+	}
+}
+
 void Subg_CfgRf(void)
 {	
 	switch(subgMode)
@@ -487,6 +682,7 @@ void Subg_Init(void)
 {
 	Rf69_DevParaCfg(RF69_DEV_FREQ916N868, RF69_FREQ_916);
 	Rf69_DevParaCfg(RF69_DEV_FREQ433, RF69_FREQ_433);
+	ble_radio_notify_init();
 }
 
 int Subg_GetRssi(void) 
@@ -515,6 +711,12 @@ void Subg_SetPktLen(uint8_t len)
 	pktLen = len;
 }
 
+/* True when no tx or rx is running and the radio has been asleep for at least ms */
+bool Subg_IsIdleFor(uint32_t ms)
+{
+	return !subgBusy && (subgIdleStart == 0 || (Timer_GetCnt() - subgIdleStart) >= ms);
+}
+
 void Subg_SetIntFlg(void)
 {
 	cmdIntFlag = true;
@@ -525,6 +727,11 @@ void Subg_ClrIntFlg(void)
 	cmdIntFlag = false;
 }
 
+void Subg_GetFifoStat(stSubgFifoStat_t *pStat)
+{
+	*pStat = fifoStat;
+}
+
 /*void Subg_Test(void)
 {
 	uint8_t data[] = {0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55, 0xaa, 0x55};
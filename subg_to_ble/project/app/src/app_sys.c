@@ -15,9 +15,70 @@
  */
 #include "ocp.h"
 #include "kit_log.h"
+#include "app_util.h"
+#include "app_sys.h"
 
 #define TAG "SYS"
 
+#define SYS_STACK_PAINT_WORD		0xCDCDCDCD
+#define SYS_STACK_PAINT_MARGIN		64// keep clear of the live frames of the caller
+
+static uint32_t stackMaxUsed = 0;
+
+/* Fill the stack below the caller with a known word, the deepest overwrite is the high-water mark */
+static void sys_stack_paint(void)
+{
+	volatile uint32_t marker = 0;
+	uint32_t *pWord = (uint32_t *)STACK_BASE;
+	uint32_t *pEnd = (uint32_t *)((uint32_t)&marker - SYS_STACK_PAINT_MARGIN);
+	
+	while(pWord < pEnd)
+	{
+		*pWord++ = SYS_STACK_PAINT_WORD;
+	}
+}
+
+uint32_t Sys_GetStackUsedSinceMark(void)
+{
+	const uint32_t *pWord = (const uint32_t *)STACK_BASE;
+	
+	while(pWord < (const uint32_t *)STACK_TOP && *pWord == SYS_STACK_PAINT_WORD)
+	{
+		pWord++;
+	}
+	
+	return (uint32_t)STACK_TOP - (uint32_t)pWord;
+}
+
+static void sys_stack_scan(void)
+{
+	uint32_t used = Sys_GetStackUsedSinceMark();
+	
+	if(used > stackMaxUsed)
+	{
+		stackMaxUsed = used;
+	}
+}
+
+uint32_t Sys_GetStackMaxUsed(void)
+{
+	sys_stack_scan();
+	
+	return stackMaxUsed;
+}
+
+uint32_t Sys_GetStackSize(void)
+{
+	return (uint32_t)STACK_TOP - (uint32_t)STACK_BASE;
+}
+
+/* Keep the overall high-water mark, then repaint so Sys_GetStackUsedSinceMark() measures from here on */
+void Sys_StackMark(void)
+{
+	sys_stack_scan();
+	sys_stack_paint();
+}
+
 void Sys_Idle(void)
 {
 	Pwr_MgmtIdle();
@@ -25,6 +86,7 @@ void Sys_Idle(void)
 
 void Sys_Init(void)
 {
+	sys_stack_paint();
 	Log_Init();
 	Rtc_Init();
 	Pwr_MgmtInit();	
@@ -0,0 +1,82 @@
+/**
+ *@file bench_codec.c
+ *@brief Host benchmark of the sw codecs against the original implementations.
+ *
+ *Usage: bench_codec [rounds]. Results are host ns/byte, relative numbers only.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdlib.h>
+
+#include "test_util.h"
+#include "ref_codec.h"
+#include "4b6b.h"
+#include "manchester.h"
+
+#define PKT_LEN		100// a typical pump packet
+#define PKT_NUM		64
+
+typedef uint16_t (*pCodecFunc_t)(const uint8_t *src, uint8_t *dst, uint16_t len);
+
+static uint8_t raw[PKT_NUM][PKT_LEN];
+static uint8_t enc[PKT_NUM][PKT_LEN * 2];
+static uint8_t encMan[PKT_NUM][PKT_LEN * 2];
+static uint8_t out[PKT_LEN * 2];
+static volatile uint32_t sink;
+
+static uint16_t encode_manchester_len(const uint8_t *src, uint8_t *dst, uint16_t len)
+{
+	return encode_manchester(src, dst, len) ? len * 2 : 0;
+}
+
+static uint16_t ref_encode_manchester_len(const uint8_t *src, uint8_t *dst, uint16_t len)
+{
+	return ref_encode_manchester(src, dst, len) ? len * 2 : 0;
+}
+
+static void bench(const char *pName, pCodecFunc_t func, uint8_t *pSrc, uint16_t stride, uint16_t len, uint32_t rounds)
+{
+	uint64_t start = test_now_ns();
+	uint32_t r, i;
+	
+	for(r = 0; r < rounds; r++)
+	{
+		for(i = 0; i < PKT_NUM; i++)
+		{
+			sink += func(pSrc + i * stride, out, len);
+		}
+	}
+	printf("%-24s %8.2f ns/byte\n", pName, (double)(test_now_ns() - start) / ((double)rounds * PKT_NUM * len));
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 20000;
+	uint32_t seed = 1;
+	uint16_t encLen = 0;
+	uint32_t i, j;
+	
+	for(i = 0; i < PKT_NUM; i++)
+	{
+		for(j = 0; j < PKT_LEN; j++)
+		{
+			raw[i][j] = test_rand(&seed);
+		}
+		encLen = encode_4b6b(raw[i], enc[i], PKT_LEN);
+		encode_manchester(raw[i], encMan[i], PKT_LEN);
+	}
+	
+	bench("encode_4b6b ref", ref_encode_4b6b, raw[0], sizeof(raw[0]), PKT_LEN, rounds);
+	bench("encode_4b6b", encode_4b6b, raw[0], sizeof(raw[0]), PKT_LEN, rounds);
+	bench("decode_4b6b ref", ref_decode_4b6b, enc[0], sizeof(enc[0]), encLen, rounds);
+	bench("decode_4b6b", decode_4b6b, enc[0], sizeof(enc[0]), encLen, rounds);
+	bench("encode_manchester ref", ref_encode_manchester_len, raw[0], sizeof(raw[0]), PKT_LEN, rounds);
+	bench("encode_manchester", encode_manchester_len, raw[0], sizeof(raw[0]), PKT_LEN, rounds);
+	bench("decode_manchester ref", ref_decode_manchester, encMan[0], sizeof(encMan[0]), PKT_LEN * 2, rounds);
+	bench("decode_manchester", decode_manchester, encMan[0], sizeof(encMan[0]), PKT_LEN * 2, rounds);
+	
+	return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ *@file bench_fifo.c
+ *@brief Host throughput benchmark of Kit_Fifo/Kit_FifoStruct against the original implementation.
+ *
+ *Usage: bench_fifo [rounds]. Results are host ns per operation, relative numbers only.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "kit_fifo.h"
+#include "ref_kit_fifo.h"
+
+#define BYTE_BUF_SIZE	512
+#define CHUNK_LEN		20// a BLE notification worth
+#define BLOCK_SIZE		128// about a stApsReqPkt_t
+#define BLOCK_NUM		8
+
+static uint8_t byteBuf[BYTE_BUF_SIZE];
+static uint8_t blockBuf[BLOCK_SIZE * BLOCK_NUM];
+static uint8_t chunk[BLOCK_SIZE];
+static volatile uint32_t sink;
+
+static void report(const char *pName, uint64_t start, uint32_t ops)
+{
+	printf("%-28s %8.2f ns/op\n", pName, (double)(test_now_ns() - start) / ops);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000000;
+	stKitFifo_t fifo;
+	stRefFifo_t refFifo;
+	stKitFifoStruct_t fifoS;
+	stRefFifoStruct_t refFifoS;
+	uint64_t start;
+	uint32_t r;
+	
+	memset(chunk, 0x5A, sizeof(chunk));
+	
+	// Byte fifo: keep it half full so the length walk of the original costs what it does in use.
+	Ref_FifoCreate(&refFifo, byteBuf, sizeof(byteBuf));
+	Ref_FifoIn(&refFifo, byteBuf, BYTE_BUF_SIZE / 2);
+	start = test_now_ns();
+	for(r = 0; r < rounds; r++)
+	{
+		Ref_FifoIn(&refFifo, chunk, CHUNK_LEN);
+		sink += Ref_FifoLenGet(&refFifo);
+		Ref_FifoOut(&refFifo, chunk, CHUNK_LEN);
+	}
+	report("fifo in+len+out ref", start, rounds);
+	
+	Kit_FifoCreate(&fifo, byteBuf, sizeof(byteBuf));
+	Kit_FifoIn(&fifo, byteBuf, BYTE_BUF_SIZE / 2);
+	start = test_now_ns();
+	for(r = 0; r < rounds; r++)
+	{
+		Kit_FifoIn(&fifo, chunk, CHUNK_LEN);
+		sink += Kit_FifoLenGet(&fifo);
+		Kit_FifoOut(&fifo, chunk, CHUNK_LEN);
+	}
+	report("fifo in+len+out", start, rounds);
+	
+	// Block fifo, as the APS command queue.
+	Ref_FifoStructCreate(&refFifoS, blockBuf, sizeof(blockBuf), BLOCK_SIZE);
+	Ref_FifoStructIn(&refFifoS, chunk, BLOCK_NUM / 2);
+	start = test_now_ns();
+	for(r = 0; r < rounds; r++)
+	{
+		Ref_FifoStructIn(&refFifoS, chunk, 1);
+		sink += Ref_FifoStructCntGet(&refFifoS);
+		Ref_FifoStructOut(&refFifoS, chunk, 1);
+	}
+	report("fifo struct in+cnt+out ref", start, rounds);
+	
+	Kit_FifoStructCreate(&fifoS, blockBuf, sizeof(blockBuf), BLOCK_SIZE);
+	start = test_now_ns();
+	for(r = 0; r < rounds; r++)
+	{
+		Kit_FifoStructIn(&fifoS, chunk, 1);
+		sink += Kit_FifoStructCntGet(&fifoS);
+		Kit_FifoStructOut(&fifoS, chunk, 1);
+	}
+	report("fifo struct in+cnt+out", start, rounds);
+	
+	start = test_now_ns();
+	for(r = 0; r < rounds; r++)
+	{
+		uint8_t *pBlock = Kit_FifoStructReserve(&fifoS);
+		
+		pBlock[0] = (uint8_t)r;
+		Kit_FifoStructCommit(&fifoS);
+		sink += Kit_FifoStructCntGet(&fifoS);
+		pBlock = Kit_FifoStructPeek(&fifoS);
+		sink += pBlock[0];
+		Kit_FifoStructRelease(&fifoS);
+	}
+	report("fifo struct reserve/peek", start, rounds);
+	
+	return 0;
+}
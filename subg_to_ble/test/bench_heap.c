@@ -0,0 +1,145 @@
+/**
+ *@file bench_heap.c
+ *@brief Host benchmark of the Kit_Malloc pool allocator against the original table-scan heap.
+ *
+ *Usage: bench_heap [ops]. Latency is host ns per malloc/free, relative numbers only.
+ *Fragmentation runs both allocators with the same byte budget and reports the failed share.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_util.h"
+#include "kit_heap.h"
+#include "ref_kit_heap.h"
+
+#define LIVE_MAX		16
+
+typedef struct
+{
+	const char *pName;
+	void *(*alloc)(uint32_t size);
+	void (*release)(void *pAddr);
+}stHeapOps_t;
+
+typedef struct
+{
+	uint32_t allocCnt;
+	uint32_t failCnt;
+	uint64_t ns;
+}stHeapRun_t;
+
+// Mostly notification and response sized buffers, some full packets.
+static uint32_t pkt_size(uint32_t *pSeed)
+{
+	uint32_t r = test_rand(pSeed) % 100;
+	
+	if(r < 50)
+	{
+		return test_rand(pSeed) % 20 + 1;
+	}
+	if(r < 80)
+	{
+		return test_rand(pSeed) % 40 + 21;
+	}
+	if(r < 95)
+	{
+		return test_rand(pSeed) % 60 + 61;
+	}
+	return test_rand(pSeed) % 130 + 121;
+}
+
+static stHeapRun_t run(const stHeapOps_t *pOps, uint32_t ops, uint32_t liveMax)
+{
+	void *pLive[LIVE_MAX] = {NULL};
+	stHeapRun_t result = {0, 0, 0};
+	uint32_t seed = 17, i;
+	uint64_t start = test_now_ns();
+	
+	for(i = 0; i < ops; i++)
+	{
+		uint32_t slot = test_rand(&seed) % liveMax;
+		
+		if(pLive[slot] != NULL)
+		{
+			pOps->release(pLive[slot]);
+			pLive[slot] = NULL;
+		}
+		else
+		{
+			pLive[slot] = pOps->alloc(pkt_size(&seed));
+			result.allocCnt++;
+			if(pLive[slot] == NULL)
+			{
+				result.failCnt++;
+			}
+		}
+	}
+	result.ns = test_now_ns() - start;
+	for(i = 0; i < liveMax; i++)
+	{
+		pOps->release(pLive[i]);
+	}
+	return result;
+}
+
+// Harness cost alone, subtracted from the latency figures.
+static uint32_t nullBlock;
+
+static void *null_alloc(uint32_t size)
+{
+	(void)size;
+	return &nullBlock;
+}
+
+static void null_free(void *pAddr)
+{
+	(void)pAddr;
+}
+
+int main(int argc, char *argv[])
+{
+	static const stHeapOps_t nullOps = {"none", null_alloc, null_free};
+	static const stHeapOps_t refOps = {"ref", Ref_Malloc, Ref_Free};
+	static const stHeapOps_t kitOps = {"pool", Kit_Malloc, Kit_Free};
+	uint32_t ops = (argc > 1) ? strtoul(argv[1], NULL, 0) : 2000000;
+	uint32_t budget = 0, liveMax;
+	stKitHeapStat_t stat;
+	stHeapRun_t result;
+	uint8_t i;
+	
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		Kit_HeapStatGet(i, &stat);
+		budget += stat.blockSize * stat.blockCnt;
+	}
+	
+	// Latency, the original heap at its shipped 10 KB.
+	for(liveMax = 4; liveMax <= LIVE_MAX; liveMax *= 4)
+	{
+		uint64_t nullNs = run(&nullOps, ops, liveMax).ns;
+		
+		Ref_HeapInit(REF_HEAP_MAX_SIZE);
+		result = run(&refOps, ops, liveMax);
+		printf("live<=%-2u %-6s %8.2f ns/op\n", liveMax, refOps.pName, (double)(result.ns - nullNs) / ops);
+		result = run(&kitOps, ops, liveMax);
+		printf("live<=%-2u %-6s %8.2f ns/op\n", liveMax, kitOps.pName, (double)(result.ns - nullNs) / ops);
+	}
+	
+	// Fragmentation with the same byte budget, more live blocks than fit at once.
+	printf("budget %u bytes\n", budget);
+	for(liveMax = 4; liveMax <= LIVE_MAX; liveMax *= 2)
+	{
+		Ref_HeapInit(budget);
+		result = run(&refOps, ops, liveMax);
+		printf("live<=%-2u %-6s %6.2f%% failed\n", liveMax, refOps.pName, 100.0 * result.failCnt / result.allocCnt);
+		result = run(&kitOps, ops, liveMax);
+		printf("live<=%-2u %-6s %6.2f%% failed\n", liveMax, kitOps.pName, 100.0 * result.failCnt / result.allocCnt);
+	}
+	
+	return 0;
+}
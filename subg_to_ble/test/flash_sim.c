@@ -0,0 +1,291 @@
+/**
+ *@file flash_sim.c
+ *@brief Host NOR flash model behind the ocp Flash_* API, with power-loss injection.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "boards.h"
+#include "ocp.h"
+#include "flash_sim.h"
+#include "test_util.h"
+
+#define SIM_SIZE		(FLASH_PAGE_SIZE * FLASH_PAGE_NUM)
+#define SIM_OP_NUM		4// as FLASH_ASYNC_OP_NUM in ocp.c
+
+typedef struct
+{
+	bool erase;
+	uint32_t addr;
+	const void *pData;
+	uint32_t len;
+	pfnFlashDone_t pfnDone;
+	void *pContext;
+	bool fail;
+}stSimOp_t;
+
+static uint32_t mem[SIM_SIZE / 4];
+static stSimOp_t opQueue[SIM_OP_NUM];
+static uint32_t opHead = 0;
+static uint32_t opCnt = 0;
+static uint32_t errCnt = 0;
+static uint32_t cutAt = FLASH_SIM_NO_CUT;
+static uint32_t cutSeed = 0;
+static bool cut = false;
+static uint32_t asyncCnt = 0;
+static uint32_t failAt = FLASH_SIM_NO_CUT;
+static bool failAtQueue = false;
+
+static bool in_range(uint32_t addr, uint32_t len)
+{
+	return addr >= FLASH_START_ADDR && len <= SIM_SIZE && addr - FLASH_START_ADDR <= SIM_SIZE - len;
+}
+
+static void error(const char *pWhat, uint32_t addr)
+{
+	printf("flash sim: %s at 0x%x\n", pWhat, addr);
+	errCnt++;
+}
+
+// Counts the operation, false once the power is gone. The torn one returns false too.
+static bool power_tick(bool *pTorn)
+{
+	*pTorn = false;
+	if(cut)
+	{
+		return false;
+	}
+	if(opCnt++ == cutAt)
+	{
+		cut = true;
+		*pTorn = true;
+	}
+	return true;
+}
+
+static void sim_erase(uint32_t pageAddr)
+{
+	uint32_t *pPage;
+	uint32_t i;
+	bool torn;
+	
+	if((pageAddr - FLASH_START_ADDR) % FLASH_PAGE_SIZE || !in_range(pageAddr, FLASH_PAGE_SIZE))
+	{
+		error("bad erase", pageAddr);
+		return;
+	}
+	if(!power_tick(&torn))
+	{
+		return;
+	}
+	
+	pPage = &mem[(pageAddr - FLASH_START_ADDR) / 4];
+	for(i = 0; i < FLASH_PAGE_SIZE / 4; i++)
+	{
+		// a torn erase leaves a random share of the words as they were
+		if(!torn || (test_rand(&cutSeed) & 0x01))
+		{
+			pPage[i] = 0xFFFFFFFF;
+		}
+	}
+}
+
+static void sim_program(uint32_t addr, const void *pData, uint32_t len)
+{
+	const uint32_t *pSrc = (const uint32_t *)pData;
+	uint32_t i;
+	bool torn;
+	
+	if(((uintptr_t)pData & 0x03) || (addr & 0x03) || (len & 0x03) || len == 0 || !in_range(addr, len))
+	{
+		error("bad program", addr);
+		return;
+	}
+	
+	for(i = 0; i < len / 4; i++)
+	{
+		uint32_t *pWord = &mem[(addr - FLASH_START_ADDR) / 4 + i];
+		
+		if(!power_tick(&torn))
+		{
+			return;
+		}
+		if(*pWord != 0xFFFFFFFF)
+		{
+			error("program over data", addr + i * 4);
+		}
+		// a torn word only gets some of its zero bits
+		*pWord &= torn ? (pSrc[i] | test_rand(&cutSeed)) : pSrc[i];
+	}
+}
+
+void FlashSim_Reset(void)
+{
+	memset(mem, 0xFF, sizeof(mem));
+	opCnt = 0;
+	errCnt = 0;
+	FlashSim_PowerOn();
+}
+
+void FlashSim_PowerOn(void)
+{
+	memset(opQueue, 0, sizeof(opQueue));
+	opHead = 0;
+	cut = false;
+	cutAt = FLASH_SIM_NO_CUT;
+	failAt = FLASH_SIM_NO_CUT;
+}
+
+void FlashSim_CutAt(uint32_t opIndex, uint32_t seed)
+{
+	cutAt = (opIndex == FLASH_SIM_NO_CUT) ? FLASH_SIM_NO_CUT : opCnt + opIndex;
+	cutSeed = seed;
+}
+
+bool FlashSim_IsCut(void)
+{
+	return cut;
+}
+
+void FlashSim_FailAsync(uint32_t reqIndex, bool atQueue)
+{
+	failAt = (reqIndex == FLASH_SIM_NO_CUT) ? FLASH_SIM_NO_CUT : asyncCnt + reqIndex;
+	failAtQueue = atQueue;
+}
+
+uint32_t FlashSim_GetAsyncCnt(void)
+{
+	return asyncCnt;
+}
+
+uint32_t FlashSim_GetOpCnt(void)
+{
+	return opCnt;
+}
+
+uint32_t FlashSim_GetErrCnt(void)
+{
+	return errCnt;
+}
+
+void FlashSim_Load(uint32_t addr, const void *pData, uint32_t len)
+{
+	memcpy((uint8_t *)mem + (addr - FLASH_START_ADDR), pData, len);
+}
+
+bool FlashSim_Process(void)
+{
+	stSimOp_t op = opQueue[opHead];
+	
+	if(op.pfnDone == NULL)
+	{
+		return false;
+	}
+	memset(&opQueue[opHead], 0, sizeof(stSimOp_t));
+	opHead = (opHead + 1) % SIM_OP_NUM;
+	
+	if(op.fail)
+	{
+		if(!cut)
+		{
+			op.pfnDone(false, op.pContext);
+		}
+		return true;
+	}
+	if(op.erase)
+	{
+		sim_erase(op.addr);
+	}
+	else
+	{
+		sim_program(op.addr, op.pData, op.len);
+	}
+	// no event once the power is gone
+	if(!cut)
+	{
+		op.pfnDone(true, op.pContext);
+	}
+	return true;
+}
+
+void FlashSim_ProcessAll(void)
+{
+	while(FlashSim_Process())
+	{
+	}
+}
+
+static bool op_queue(bool erase, uint32_t addr, const void *pData, uint32_t len, pfnFlashDone_t pfnDone, void *pContext)
+{
+	uint32_t index = asyncCnt++;
+	uint32_t i;
+	
+	if(index == failAt && failAtQueue)
+	{
+		return false;
+	}
+	for(i = 0; i < SIM_OP_NUM; i++)
+	{
+		stSimOp_t *pOp = &opQueue[(opHead + i) % SIM_OP_NUM];
+		
+		if(pOp->pfnDone == NULL)
+		{
+			pOp->fail = (index == failAt);
+			pOp->erase = erase;
+			pOp->addr = addr;
+			pOp->pData = pData;
+			pOp->len = len;
+			pOp->pfnDone = pfnDone;
+			pOp->pContext = pContext;
+			return true;
+		}
+	}
+	return false;
+}
+
+void Flash_Read(void* pDest, const uint32_t srcAddr, uint32_t len)
+{
+	if(!in_range(srcAddr, len))
+	{
+		error("bad read", srcAddr);
+		memset(pDest, 0xFF, len);
+		return;
+	}
+	memcpy(pDest, (const uint8_t *)mem + (srcAddr - FLASH_START_ADDR), len);
+}
+
+void Flash_ErasePage(uint32_t pageAddr)
+{
+	sim_erase(pageAddr);
+}
+
+void Flash_Program(uint32_t addr, void const * pData, uint32_t len)
+{
+	sim_program(addr, pData, len);
+}
+
+void Flash_Write(uint32_t pageAddr, void const * pData, uint32_t len)
+{
+	Flash_ErasePage(pageAddr);
+	Flash_Program(pageAddr, pData, len);
+}
+
+bool Flash_EraseAsync(uint32_t pageAddr, pfnFlashDone_t pfnDone, void *pContext)
+{
+	return op_queue(true, pageAddr, NULL, FLASH_PAGE_SIZE, pfnDone, pContext);
+}
+
+bool Flash_WriteAsync(uint32_t addr, void const * pData, uint32_t len, pfnFlashDone_t pfnDone, void *pContext)
+{
+	return op_queue(false, addr, pData, len, pfnDone, pContext);
+}
+
+bool Flash_IsBusy(void)
+{
+	return opQueue[opHead].pfnDone != NULL;
+}
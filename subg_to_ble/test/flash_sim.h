@@ -0,0 +1,42 @@
+/**
+ *@file flash_sim.h
+ *@brief Host NOR flash model behind the ocp Flash_* API, with power-loss injection.
+ *
+ *Covers the FLASH_PAGE_NUM pages of boards.h. Programming only clears bits, an erase sets a 
+ *whole page. Async operations are queued and completed by FlashSim_Process(), as the SoftDevice 
+ *does from its event handler. Whatever nrf_fstorage would reject (unaligned source, address or
+ *length, out of range) and programming a word that is not erased is counted as an error.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __FLASH_SIM_H__
+#define __FLASH_SIM_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FLASH_SIM_NO_CUT	0xFFFFFFFF
+
+// All pages erased, no cut armed, counters cleared.
+void FlashSim_Reset(void);
+// Power comes back: queued async operations are lost, no cut or failure armed.
+void FlashSim_PowerOn(void);
+// Tear the operation with this index (word programs and page erases counted from now),
+// every later operation is dropped until FlashSim_PowerOn(). seed picks the torn bits.
+void FlashSim_CutAt(uint32_t opIndex, uint32_t seed);
+bool FlashSim_IsCut(void);
+uint32_t FlashSim_GetOpCnt(void);
+uint32_t FlashSim_GetErrCnt(void);
+// The async request with this index (counted from now) fails: refused when it is queued, or
+// left out with a failed event. FLASH_SIM_NO_CUT for none.
+void FlashSim_FailAsync(uint32_t reqIndex, bool atQueue);
+uint32_t FlashSim_GetAsyncCnt(void);
+// Complete the oldest queued async operation, false if none.
+bool FlashSim_Process(void);
+void FlashSim_ProcessAll(void);
+// Direct access to set up old layouts.
+void FlashSim_Load(uint32_t addr, const void *pData, uint32_t len);
+
+#endif /* __FLASH_SIM_H__ */
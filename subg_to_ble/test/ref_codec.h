@@ -0,0 +1,22 @@
+/**
+ *@file ref_codec.h
+ *@brief The original bit-by-bit 4b6b and Manchester codecs, kept as the reference for the host tests.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __REF_CODEC_H__
+#define __REF_CODEC_H__
+#include <stdint.h>
+#include <stdbool.h>
+
+uint16_t ref_encode_4b6b(const uint8_t *src, uint8_t *dst, uint16_t len);
+uint16_t ref_decode_4b6b(const uint8_t *src, uint8_t *dst, uint16_t len);
+uint8_t ref_decode_6b(uint8_t symbol);
+
+bool ref_encode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len);
+uint16_t ref_decode_manchester(const uint8_t *src, uint8_t *dst, uint16_t len);
+
+#endif /* __REF_CODEC_H__ */
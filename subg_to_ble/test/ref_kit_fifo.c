@@ -0,0 +1,163 @@
+/**
+ *@file ref_kit_fifo.c
+ *@brief The original byte-by-byte Kit_Fifo, kept as the reference for the host benchmark.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "ref_kit_fifo.h"
+
+uint32_t Ref_FifoCreate(stRefFifo_t *pFifo, uint8_t *pBuf, uint32_t bufSize)
+{
+    pFifo->bufSize = bufSize;
+    pFifo->pBuf = pBuf;
+    pFifo->pFront = pBuf;
+    pFifo->pTail = pBuf;
+
+    return 1;
+}
+
+uint32_t Ref_FifoIn(stRefFifo_t *pFifo, uint8_t *pData, uint32_t len)
+{
+    volatile uint8_t *pTail = NULL;
+    
+    uint32_t i = 0;
+
+    pTail = pFifo->pTail;
+    
+    for(i = 0; i < len; i++)
+    {
+        if(++pTail >= pFifo->pBuf + pFifo->bufSize)
+        {
+            pTail = pFifo->pBuf;
+        }
+        if(pTail == pFifo->pFront) 
+        {
+            break;
+        }
+        
+        *pFifo->pTail = *pData++;
+        pFifo->pTail = pTail;
+    }
+    
+    return i;
+}
+
+uint32_t Ref_FifoOut(stRefFifo_t *pFifo, uint8_t *pData, uint32_t len)
+{
+    uint32_t i = 0;
+
+    while((pFifo->pFront != pFifo->pTail) && (i < len) && (i < pFifo->bufSize))
+    {
+        pData[i++] = *pFifo->pFront++;
+        if(pFifo->pFront >= pFifo->pBuf + pFifo->bufSize) 
+        {
+            pFifo->pFront = pFifo->pBuf;
+        }
+    }
+
+    return i;
+}
+
+uint32_t Ref_FifoLenGet(stRefFifo_t *pFifo)
+{
+    volatile uint8_t *pFront = NULL;
+    uint32_t i = 0;
+
+    pFront = pFifo->pFront;
+
+    while((pFront != pFifo->pTail) && (i < pFifo->bufSize))
+    {
+        i++;
+        if(++pFront >= pFifo->pBuf + pFifo->bufSize) 
+        {
+            pFront = pFifo->pBuf;
+        }
+    }
+
+    return i;
+}
+
+uint32_t Ref_FifoStructCreate(stRefFifoStruct_t *pFifoS, void *pBuf, uint32_t bufSize, uint16_t blockSize)
+{
+    pFifoS->elemSize = blockSize;
+    pFifoS->sumCnt = bufSize / blockSize;
+    pFifoS->pBuf = pBuf;
+    pFifoS->front = 0;
+    pFifoS->tail = 0;
+	
+    return 1;
+}
+
+uint32_t Ref_FifoStructIn(stRefFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt)
+{
+    uint32_t i = blockCnt;
+    uint32_t mdwTail = 0;
+
+
+    mdwTail = pFifoS->tail;
+    for(i = 0; i < blockCnt; i++)
+    {
+        if(++mdwTail >= pFifoS->sumCnt)      
+        {
+            mdwTail = 0;
+        }
+        
+        if(mdwTail == pFifoS->front)   
+        {
+            break; 
+        }
+        
+        memcpy((uint8_t *)pFifoS->pBuf + pFifoS->tail * pFifoS->elemSize, pData, pFifoS->elemSize);
+
+        pData = (uint8_t *)pData + pFifoS->elemSize;
+
+        pFifoS->tail = mdwTail;
+    }
+    
+    return i;
+}
+
+uint32_t Ref_FifoStructOut(stRefFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt)
+{
+    uint32_t i = 0;
+
+    while((pFifoS->front != pFifoS->tail) && (i < pFifoS->sumCnt) && (i < blockCnt))
+    {
+        memcpy(pData, (uint8_t *)pFifoS->pBuf + pFifoS->front * pFifoS->elemSize, pFifoS->elemSize);
+
+        pData = (uint8_t *)pData + pFifoS->elemSize;
+		
+        i++;
+		
+        if(++pFifoS->front >= pFifoS->sumCnt) 
+        {
+            pFifoS->front = 0;
+        }
+    }
+
+    return i;
+}
+
+uint32_t Ref_FifoStructCntGet(stRefFifoStruct_t *pFifoS)
+{
+    uint32_t i = 0;
+    uint32_t mdwFront =0;
+
+    mdwFront = pFifoS->front;
+    while((mdwFront != pFifoS->tail) && (i < pFifoS->sumCnt))
+    {
+        i++;
+        if(++mdwFront >= pFifoS->sumCnt) 
+        {
+            mdwFront = 0;
+        }
+    }
+
+    return i;
+}
+
@@ -0,0 +1,41 @@
+/**
+ *@file ref_kit_fifo.h
+ *@brief The original byte-by-byte Kit_Fifo, kept as the reference for the host benchmark.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __REF_KIT_FIFO_H__
+#define __REF_KIT_FIFO_H__
+#include <stdint.h>
+
+typedef volatile struct 
+{
+	volatile uint32_t	bufSize;
+	volatile uint8_t	*pFront;
+	volatile uint8_t	*pTail;
+	volatile uint8_t	*pBuf;
+}stRefFifo_t;
+
+typedef volatile struct 
+{
+	volatile uint32_t	elemSize;
+	volatile uint32_t	sumCnt;
+	volatile uint32_t	front;
+	volatile uint32_t	tail;
+	volatile void		*pBuf;
+}stRefFifoStruct_t;
+
+uint32_t Ref_FifoCreate(stRefFifo_t *pFifo, uint8_t *pBuf, uint32_t bufSize);
+uint32_t Ref_FifoIn(stRefFifo_t *pFifo, uint8_t *pData, uint32_t len);
+uint32_t Ref_FifoOut(stRefFifo_t *pFifo, uint8_t *pData, uint32_t len);
+uint32_t Ref_FifoLenGet(stRefFifo_t *pFifo);
+
+uint32_t Ref_FifoStructCreate(stRefFifoStruct_t *pFifoS, void *pBuf, uint32_t bufSize, uint16_t blockSize);
+uint32_t Ref_FifoStructIn(stRefFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt);
+uint32_t Ref_FifoStructOut(stRefFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt);
+uint32_t Ref_FifoStructCntGet(stRefFifoStruct_t *pFifoS);
+
+#endif /* __REF_KIT_FIFO_H__ */
@@ -0,0 +1,122 @@
+/**
+ *@file ref_kit_heap.c
+ *@brief The original table-scan Kit_Malloc, kept as the reference for the host benchmark.
+ *
+ *The heap size is set at run time and addresses use uintptr_t so it runs on a 64-bit host,
+ *the allocation algorithm is unchanged.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ref_kit_heap.h"
+
+__attribute__((aligned(4))) static uint8_t heap[REF_HEAP_MAX_SIZE];
+static uint16_t heapAllocTable[REF_HEAP_MAX_SIZE / REF_HEAP_BLOCK_SIZE];
+static uint32_t heapSize = REF_HEAP_MAX_SIZE;
+static uint32_t heapTableSize = REF_HEAP_MAX_SIZE / REF_HEAP_BLOCK_SIZE;
+static bool heapReady = false;
+
+void Ref_HeapInit(uint32_t size)
+{
+	heapSize = (size > REF_HEAP_MAX_SIZE) ? REF_HEAP_MAX_SIZE : size;
+	heapTableSize = heapSize / REF_HEAP_BLOCK_SIZE;
+	heapReady = false;
+}
+
+/*memory usage(0~100)*/
+uint32_t Ref_MemUsage(void)  
+{  
+	uint32_t usage = 0;  
+	uint32_t i;
+	
+	if(!heapReady)
+	{
+		return 0;
+	}
+	
+	for(i = 0; i < heapTableSize; i++)  
+	{  
+		if(heapAllocTable[i])
+		{
+			usage++; 
+		}
+	} 
+	
+	return (usage * 100) / heapTableSize;  
+}  
+
+void *Ref_Malloc(uint32_t size)
+{  
+	int offset = 0;  
+	uint32_t blockNum;
+	uint32_t blockCnt = 0;
+	uint32_t i;  
+	
+	if(size == 0)
+	{
+		return NULL;
+	}
+	
+	if(!heapReady)
+	{
+		memset(heap, 0, heapSize);
+		memset(heapAllocTable, 0, sizeof(heapAllocTable));
+		heapReady = true;
+	}
+	
+	blockNum = ((size - 1) / REF_HEAP_BLOCK_SIZE) + 1;
+	
+	for(offset = heapTableSize - 1; offset >= 0; offset--)  
+	{     
+		if(!heapAllocTable[offset])
+		{
+			blockCnt++;
+		}
+		else 
+		{
+			blockCnt = 0;
+		}
+		
+		if(blockCnt == blockNum)
+		{
+			for(i = 0; i < blockNum; i++)
+			{  
+				heapAllocTable[offset + i] = blockNum;  
+			}  
+			return (void *)(heap + (offset * REF_HEAP_BLOCK_SIZE));  
+		}
+	}  
+	
+	return NULL;  
+}  
+
+void Ref_Free(void *pAddr)  
+{  
+	uintptr_t offset;
+	uint32_t blockId;
+	uint32_t blockNum;
+	uint32_t i;  
+	
+	if(pAddr == NULL || !heapReady)
+	{
+		return;  
+	}
+	
+	offset = (uintptr_t)pAddr - (uintptr_t)heap;     
+	if(offset < heapSize) 
+	{  
+		blockId = offset / REF_HEAP_BLOCK_SIZE;  
+		blockNum = heapAllocTable[blockId];	
+		
+		for(i = 0; i < blockNum; i++) 
+		{  
+			heapAllocTable[blockId + i] = 0;  
+		}  
+	}
+}  
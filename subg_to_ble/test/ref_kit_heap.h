@@ -0,0 +1,23 @@
+/**
+ *@file ref_kit_heap.h
+ *@brief The original table-scan Kit_Malloc, kept as the reference for the host benchmark.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __REF_KIT_HEAP_H__
+#define __REF_KIT_HEAP_H__
+#include <stdint.h>
+
+#define REF_HEAP_MAX_SIZE		(10 * 1024)// the original HEAP_SIZE
+#define REF_HEAP_BLOCK_SIZE		(32)
+
+// Reset the heap to heapSize bytes, at most REF_HEAP_MAX_SIZE.
+void Ref_HeapInit(uint32_t heapSize);
+void Ref_Free(void *pAddr);
+void *Ref_Malloc(uint32_t size);
+uint32_t Ref_MemUsage(void);
+
+#endif /* __REF_KIT_HEAP_H__ */
@@ -0,0 +1,11 @@
+/**
+ *@file app_util_platform.h
+ *@brief Host stand-in, the tests are single threaded so critical regions are empty.
+ */
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+
+#endif
@@ -0,0 +1,15 @@
+/**
+ *@file boards.h
+ *@brief Host stand-in for the board config, only the flash layout the store uses.
+ */
+#ifndef BOARDS_H
+#define BOARDS_H
+
+#define FLASH_PAGE_SIZE				4096
+#define FLASH_PAGE_NUM				2
+#define FLASH_BOOTLOADER_ADDRESS 	(0x00028000UL)
+#define FLASH_START_ADDR  			(FLASH_BOOTLOADER_ADDRESS - (FLASH_PAGE_SIZE * FLASH_PAGE_NUM))
+#define FLASH_PAGE_1_ADDR			FLASH_START_ADDR
+#define FLASH_PAGE_0_ADDR			(FLASH_PAGE_1_ADDR + FLASH_PAGE_SIZE)
+
+#endif
@@ -0,0 +1,10 @@
+/**
+ *@file nrf_log.h
+ *@brief Host stand-in for the SDK logger pulled in by kit_log.h, logging is off in the host build.
+ */
+#ifndef NRF_LOG_H__
+#define NRF_LOG_H__
+
+#define NRF_LOG_RAW_INFO(...)
+
+#endif
@@ -0,0 +1,171 @@
+/**
+ *@file test_4b6b.c
+ *@brief Host test of the table driven 4b6b codec against the original implementation.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "test_util.h"
+#include "ref_codec.h"
+#include "4b6b.h"
+#include "encrypt_stream.h"
+
+#define MAX_LEN		300
+
+static void test_symbols(void)
+{
+	uint16_t symbols;
+	
+	// Every pair of 6-bit symbols, valid or not.
+	for(symbols = 0; symbols < 0x1000; symbols++)
+	{
+		uint8_t a = ref_decode_6b(symbols >> 6), b = ref_decode_6b(symbols & 0x3F);
+		uint16_t out = decode_4b6b_symbols(symbols);
+		
+		if(a == 0xFF || b == 0xFF)
+		{
+			TEST_CHECK(out & DECODE_4B6B_INVALID);
+		}
+		else
+		{
+			TEST_CHECK_EQ(out, (a << 4) | b);
+		}
+	}
+}
+
+static void test_exhaustive_pairs(void)
+{
+	uint32_t pair;
+	uint8_t src[2], enc[3], refEnc[3], dec[2];
+	
+	for(pair = 0; pair < 0x10000; pair++)
+	{
+		src[0] = pair >> 8;
+		src[1] = pair & 0xFF;
+		TEST_CHECK_EQ(encode_4b6b(src, enc, 2), 3);
+		ref_encode_4b6b(src, refEnc, 2);
+		TEST_CHECK(memcmp(enc, refEnc, 3) == 0);
+		TEST_CHECK_EQ(decode_4b6b(enc, dec, 3), 2);
+		TEST_CHECK(memcmp(src, dec, 2) == 0);
+		
+		// Odd tail byte.
+		TEST_CHECK_EQ(encode_4b6b(src, enc, 1), 2);
+		ref_encode_4b6b(src, refEnc, 1);
+		TEST_CHECK(memcmp(enc, refEnc, 2) == 0);
+		TEST_CHECK_EQ(decode_4b6b(enc, dec, 2), 1);
+		TEST_CHECK_EQ(dec[0], src[0]);
+	}
+}
+
+static void test_lengths(void)
+{
+	uint8_t src[MAX_LEN], enc[MAX_LEN * 2], refEnc[MAX_LEN * 2], dec[MAX_LEN], refDec[MAX_LEN];
+	uint32_t seed = 1;
+	uint16_t len, i;
+	
+	// len 0 included, the unsigned loop bound used to misbehave there.
+	for(len = 0; len < MAX_LEN; len++)
+	{
+		uint16_t encLen, refLen;
+		
+		for(i = 0; i < len; i++)
+		{
+			src[i] = test_rand(&seed);
+		}
+		encLen = encode_4b6b(src, enc, len);
+		refLen = ref_encode_4b6b(src, refEnc, len);
+		TEST_CHECK_EQ(encLen, refLen);
+		TEST_CHECK_EQ(encLen, 3 * (len / 2) + 2 * (len % 2));
+		TEST_CHECK(memcmp(enc, refEnc, encLen) == 0);
+		TEST_CHECK_EQ(decode_4b6b(enc, dec, encLen), len);
+		TEST_CHECK(memcmp(src, dec, len) == 0);
+		
+		// Random input is mostly invalid, the result must still match the reference.
+		for(i = 0; i < len; i++)
+		{
+			enc[i] = test_rand(&seed);
+		}
+		refLen = ref_decode_4b6b(enc, refDec, len);
+		TEST_CHECK_EQ(decode_4b6b(enc, dec, len), refLen);
+		TEST_CHECK(memcmp(dec, refDec, refLen) == 0);
+	}
+}
+
+static void test_invalid(void)
+{
+	uint8_t src[4] = {0x12, 0x34, 0x56, 0x78}, enc[6], dec[4];
+	uint16_t i;
+	uint8_t bit;
+	
+	encode_4b6b(src, enc, sizeof(src));
+	// Flipping any single bit makes at least one symbol undefined or changes the data.
+	for(i = 0; i < sizeof(enc); i++)
+	{
+		for(bit = 0; bit < 8; bit++)
+		{
+			uint8_t bad[6], refDec[4];
+			uint16_t refLen;
+			
+			memcpy(bad, enc, sizeof(bad));
+			bad[i] ^= 1 << bit;
+			refLen = ref_decode_4b6b(bad, refDec, sizeof(bad));
+			TEST_CHECK_EQ(decode_4b6b(bad, dec, sizeof(bad)), refLen);
+		}
+	}
+	// A length of 3n + 1 is never produced by the encoder.
+	TEST_CHECK_EQ(decode_4b6b(enc, dec, 4), 0);
+}
+
+static void test_stream(void)
+{
+	uint8_t src[MAX_LEN], enc[MAX_LEN * 2], streamBuf[MAX_LEN * 2], dec[MAX_LEN];
+	stEncryptStream_t stream;
+	uint32_t seed = 7;
+	uint16_t len, i, encLen;
+	
+	for(len = 0; len < MAX_LEN; len += 13)
+	{
+		for(i = 0; i < len; i++)
+		{
+			src[i] = test_rand(&seed);
+		}
+		encLen = encode_4b6b(src, enc, len);
+		
+		// Pushed in random sized pieces.
+		encrypt_enc_init(&stream, ENCRYPT_4B6B, streamBuf, sizeof(streamBuf));
+		for(i = 0; i < len; )
+		{
+			uint16_t n = test_rand(&seed) % 8 + 1;
+			
+			n = (n > len - i) ? len - i : n;
+			encrypt_enc_push(&stream, src + i, n);
+			i += n;
+		}
+		TEST_CHECK_EQ(encrypt_enc_finish(&stream), encLen);
+		TEST_CHECK(memcmp(streamBuf, enc, encLen) == 0);
+		
+		// Decoded one byte at a time, as the receive loop does.
+		encrypt_dec_init(&stream, ENCRYPT_4B6B, dec, sizeof(dec));
+		for(i = 0; i < encLen; i++)
+		{
+			encrypt_dec_push(&stream, enc + i, 1);
+		}
+		TEST_CHECK_EQ(encrypt_dec_finish(&stream), len);
+		TEST_CHECK(memcmp(src, dec, len) == 0);
+	}
+}
+
+int main(void)
+{
+	test_symbols();
+	test_exhaustive_pairs();
+	test_lengths();
+	test_invalid();
+	test_stream();
+	
+	return TEST_RESULT();
+}
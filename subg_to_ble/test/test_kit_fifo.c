@@ -0,0 +1,298 @@
+/**
+ *@file test_kit_fifo.c
+ *@brief Host test of Kit_Fifo/Kit_FifoStruct, including a two thread SPSC stress test.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "test_util.h"
+#include "kit_fifo.h"
+
+#define STRESS_BYTES	(4UL * 1024 * 1024)
+#define STRESS_BLOCKS	(1UL * 1024 * 1024)
+
+typedef struct
+{
+	uint32_t seq;
+	uint8_t  data[28];
+}stBlock_t;
+
+static void block_fill(stBlock_t *pBlock, uint32_t seq)
+{
+	pBlock->seq = seq;
+	memset(pBlock->data, (uint8_t)(seq * 7), sizeof(pBlock->data));
+}
+
+static bool block_check(const stBlock_t *pBlock, uint32_t seq)
+{
+	uint8_t i;
+	
+	if(pBlock->seq != seq)
+	{
+		return false;
+	}
+	for(i = 0; i < sizeof(pBlock->data); i++)
+	{
+		if(pBlock->data[i] != (uint8_t)(seq * 7))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_fifo_basic(void)
+{
+	stKitFifo_t fifo;
+	uint8_t buf[16], in[40], out[40];
+	uint32_t i, round;
+	
+	for(i = 0; i < sizeof(in); i++)
+	{
+		in[i] = i;
+	}
+	Kit_FifoCreate(&fifo, buf, sizeof(buf));
+	TEST_CHECK_EQ(Kit_FifoLenGet(&fifo), 0);
+	TEST_CHECK_EQ(Kit_FifoOut(&fifo, out, 1), 0);
+	
+	// All of the buffer is usable, a longer write is cut.
+	TEST_CHECK_EQ(Kit_FifoIn(&fifo, in, sizeof(in)), 16);
+	TEST_CHECK_EQ(Kit_FifoLenGet(&fifo), 16);
+	TEST_CHECK_EQ(Kit_FifoIn(&fifo, in, 1), 0);
+	TEST_CHECK_EQ(Kit_FifoOut(&fifo, out, sizeof(out)), 16);
+	TEST_CHECK(memcmp(in, out, 16) == 0);
+	TEST_CHECK_EQ(Kit_FifoMaxLenGet(&fifo), 16);
+	
+	// Every wrap position.
+	for(round = 0; round < 40; round++)
+	{
+		uint32_t len = round % 15 + 1;
+		
+		TEST_CHECK_EQ(Kit_FifoIn(&fifo, in + round % 20, len), len);
+		TEST_CHECK_EQ(Kit_FifoLenGet(&fifo), len);
+		memset(out, 0, sizeof(out));
+		TEST_CHECK_EQ(Kit_FifoOut(&fifo, out, sizeof(out)), len);
+		TEST_CHECK(memcmp(in + round % 20, out, len) == 0);
+	}
+	TEST_CHECK_EQ(Kit_FifoLenGet(&fifo), 0);
+}
+
+static void test_fifo_struct_basic(void)
+{
+	stKitFifoStruct_t fifo;
+	stBlock_t buf[4], block, *pBlock;
+	uint32_t seq = 0, outSeq = 0, i;
+	
+	Kit_FifoStructCreate(&fifo, buf, sizeof(buf), sizeof(stBlock_t));
+	TEST_CHECK(Kit_FifoStructPeek(&fifo) == NULL);
+	
+	for(i = 0; i < 4; i++)
+	{
+		pBlock = Kit_FifoStructReserve(&fifo);
+		TEST_CHECK(pBlock != NULL);
+		if(pBlock)
+		{
+			block_fill(pBlock, seq++);
+			Kit_FifoStructCommit(&fifo);
+		}
+	}
+	TEST_CHECK(Kit_FifoStructReserve(&fifo) == NULL);
+	block_fill(&block, seq);
+	TEST_CHECK_EQ(Kit_FifoStructIn(&fifo, &block, 1), 0);
+	TEST_CHECK_EQ(Kit_FifoStructCntGet(&fifo), 4);
+	TEST_CHECK_EQ(Kit_FifoStructMaxCntGet(&fifo), 4);
+	
+	// Copy and zero-copy calls mix freely.
+	for(i = 0; i < 20; i++)
+	{
+		if(i & 0x01)
+		{
+			pBlock = Kit_FifoStructPeek(&fifo);
+			TEST_CHECK(pBlock != NULL && block_check(pBlock, outSeq));
+			Kit_FifoStructRelease(&fifo);
+		}
+		else
+		{
+			TEST_CHECK_EQ(Kit_FifoStructOut(&fifo, &block, 1), 1);
+			TEST_CHECK(block_check(&block, outSeq));
+		}
+		outSeq++;
+		block_fill(&block, seq++);
+		TEST_CHECK_EQ(Kit_FifoStructIn(&fifo, &block, 1), 1);
+	}
+	TEST_CHECK_EQ(Kit_FifoStructCntGet(&fifo), 4);
+}
+
+static stKitFifo_t stressFifo;
+static uint8_t stressBuf[256];
+static stKitFifoStruct_t stressFifoS;
+static stBlock_t stressBlocks[8];
+static volatile uint32_t stressErr;
+
+static void *byte_producer(void *pArg)
+{
+	uint8_t chunk[64];
+	uint32_t seed = 11, sent = 0;
+	
+	(void)pArg;
+	while(sent < STRESS_BYTES)
+	{
+		uint32_t len = test_rand(&seed) % sizeof(chunk) + 1, i, n;
+		
+		len = (len > STRESS_BYTES - sent) ? STRESS_BYTES - sent : len;
+		for(i = 0; i < len; i++)
+		{
+			chunk[i] = (uint8_t)((sent + i) % 251);
+		}
+		for(i = 0; i < len; i += n)
+		{
+			n = Kit_FifoIn(&stressFifo, chunk + i, len - i);
+			if(n == 0)
+			{
+				sched_yield();
+			}
+		}
+		sent += len;
+	}
+	return NULL;
+}
+
+static void *byte_consumer(void *pArg)
+{
+	uint8_t chunk[64];
+	uint32_t seed = 13, recv = 0;
+	
+	(void)pArg;
+	while(recv < STRESS_BYTES)
+	{
+		uint32_t n = Kit_FifoOut(&stressFifo, chunk, test_rand(&seed) % sizeof(chunk) + 1), i;
+		
+		if(n == 0)
+		{
+			sched_yield();
+			continue;
+		}
+		if(Kit_FifoLenGet(&stressFifo) > sizeof(stressBuf))
+		{
+			stressErr++;
+		}
+		for(i = 0; i < n; i++)
+		{
+			if(chunk[i] != (uint8_t)((recv + i) % 251))
+			{
+				stressErr++;
+			}
+		}
+		recv += n;
+	}
+	return NULL;
+}
+
+static void *block_producer(void *pArg)
+{
+	stBlock_t block;
+	uint32_t seq = 0;
+	
+	(void)pArg;
+	while(seq < STRESS_BLOCKS)
+	{
+		// Alternate zero-copy and copy, as Aps_PutCmd and the other queues do.
+		if(seq & 0x01)
+		{
+			stBlock_t *pBlock = Kit_FifoStructReserve(&stressFifoS);
+			
+			if(pBlock == NULL)
+			{
+				sched_yield();
+				continue;
+			}
+			block_fill(pBlock, seq);
+			Kit_FifoStructCommit(&stressFifoS);
+		}
+		else
+		{
+			block_fill(&block, seq);
+			if(Kit_FifoStructIn(&stressFifoS, &block, 1) == 0)
+			{
+				sched_yield();
+				continue;
+			}
+		}
+		seq++;
+	}
+	return NULL;
+}
+
+static void *block_consumer(void *pArg)
+{
+	stBlock_t block;
+	uint32_t seq = 0;
+	
+	(void)pArg;
+	while(seq < STRESS_BLOCKS)
+	{
+		if(seq % 3)
+		{
+			stBlock_t *pBlock = Kit_FifoStructPeek(&stressFifoS);
+			
+			if(pBlock == NULL)
+			{
+				sched_yield();
+				continue;
+			}
+			if(!block_check(pBlock, seq))
+			{
+				stressErr++;
+			}
+			Kit_FifoStructRelease(&stressFifoS);
+		}
+		else
+		{
+			if(Kit_FifoStructOut(&stressFifoS, &block, 1) == 0)
+			{
+				sched_yield();
+				continue;
+			}
+			if(!block_check(&block, seq))
+			{
+				stressErr++;
+			}
+		}
+		seq++;
+	}
+	return NULL;
+}
+
+static void stress(void *(*producer)(void *), void *(*consumer)(void *))
+{
+	pthread_t prod, cons;
+	
+	stressErr = 0;
+	pthread_create(&cons, NULL, consumer, NULL);
+	pthread_create(&prod, NULL, producer, NULL);
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+	TEST_CHECK_EQ(stressErr, 0);
+}
+
+int main(void)
+{
+	test_fifo_basic();
+	test_fifo_struct_basic();
+	
+	Kit_FifoCreate(&stressFifo, stressBuf, sizeof(stressBuf));
+	stress(byte_producer, byte_consumer);
+	TEST_CHECK_EQ(Kit_FifoLenGet(&stressFifo), 0);
+	
+	Kit_FifoStructCreate(&stressFifoS, stressBlocks, sizeof(stressBlocks), sizeof(stBlock_t));
+	stress(block_producer, block_consumer);
+	TEST_CHECK_EQ(Kit_FifoStructCntGet(&stressFifoS), 0);
+	
+	return TEST_RESULT();
+}
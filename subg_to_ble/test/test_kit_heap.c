@@ -0,0 +1,184 @@
+/**
+ *@file test_kit_heap.c
+ *@brief Host test of the Kit_Malloc pool allocator, built with and without HEAP_GUARD_SUPPORT.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "test_util.h"
+#include "kit_config.h"
+#include "kit_heap.h"
+
+#ifdef HEAP_GUARD_SUPPORT
+#define GUARD		4
+#else
+#define GUARD		0
+#endif
+
+static const uint16_t classCnt[KIT_HEAP_CLASS_NUM] = {HEAP_POOL_32_CNT, HEAP_POOL_64_CNT, HEAP_POOL_128_CNT, HEAP_POOL_256_CNT};
+
+static stKitHeapStat_t stat_get(uint8_t classId)
+{
+	stKitHeapStat_t stat;
+	
+	memset(&stat, 0, sizeof(stat));
+	Kit_HeapStatGet(classId, &stat);
+	return stat;
+}
+
+static void test_classes(void)
+{
+	static const uint32_t sizes[KIT_HEAP_CLASS_NUM][2] = {{1, 32}, {33, 64}, {65, 128}, {129, 256}};
+	uint8_t i, j;
+	
+	TEST_CHECK(Kit_Malloc(0) == NULL);
+	TEST_CHECK(Kit_Malloc(256 - GUARD + 1) == NULL);
+	TEST_CHECK_EQ(Kit_HeapStatGet(KIT_HEAP_CLASS_NUM, NULL), 0);
+	
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		for(j = 0; j < 2; j++)
+		{
+			uint32_t size = sizes[i][j] - ((j == 1) ? GUARD : 0);
+			void *pAddr = Kit_Malloc(size);
+			
+			TEST_CHECK(pAddr != NULL);
+			TEST_CHECK(((uintptr_t)pAddr & 0x03) == 0);
+			TEST_CHECK_EQ(stat_get(i).usedCnt, 1);
+			memset(pAddr, 0x11, size);
+			Kit_Free(pAddr);
+			TEST_CHECK_EQ(stat_get(i).usedCnt, 0);
+		}
+		TEST_CHECK_EQ(stat_get(i).blockSize, 32 << i);
+		TEST_CHECK_EQ(stat_get(i).blockCnt, classCnt[i]);
+		TEST_CHECK_EQ(stat_get(i).guardErrCnt, 0);
+	}
+	TEST_CHECK_EQ(Kit_MemUsage(), 0);
+}
+
+static void test_exhaust(void)
+{
+	void *pAddr[HEAP_POOL_32_CNT + HEAP_POOL_64_CNT + HEAP_POOL_128_CNT + HEAP_POOL_256_CNT];
+	uint32_t i, cnt = 0;
+	stKitHeapStat_t stat;
+	
+	// Small blocks fall through to the larger classes once their own is used up.
+	while(cnt < sizeof(pAddr) / sizeof(pAddr[0]))
+	{
+		pAddr[cnt] = Kit_Malloc(8);
+		TEST_CHECK(pAddr[cnt] != NULL);
+		memset(pAddr[cnt], (uint8_t)cnt, 8);
+		cnt++;
+	}
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		TEST_CHECK_EQ(stat_get(i).usedCnt, classCnt[i]);
+	}
+	TEST_CHECK_EQ(Kit_MemUsage(), 100);
+	
+	// The failure is charged to the class that fits.
+	stat = stat_get(0);
+	TEST_CHECK(Kit_Malloc(8) == NULL);
+	TEST_CHECK_EQ(stat_get(0).failCnt, stat.failCnt + 1);
+	
+	// No block was handed out twice.
+	for(i = 0; i < cnt; i++)
+	{
+		uint8_t j;
+		
+		for(j = 0; j < 8; j++)
+		{
+			TEST_CHECK_EQ(((uint8_t *)pAddr[i])[j], (uint8_t)i);
+		}
+	}
+	
+	// A freed block is reused first.
+	Kit_Free(pAddr[3]);
+	TEST_CHECK(Kit_Malloc(8) == pAddr[3]);
+	
+	for(i = 0; i < cnt; i++)
+	{
+		Kit_Free(pAddr[i]);
+	}
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		TEST_CHECK_EQ(stat_get(i).usedCnt, 0);
+		TEST_CHECK_EQ(stat_get(i).maxUsedCnt, classCnt[i]);
+	}
+}
+
+static void test_realloc(void)
+{
+	uint8_t *pAddr = Kit_Realloc(NULL, 20), *pNew;
+	uint8_t i;
+	
+	TEST_CHECK(pAddr != NULL);
+	for(i = 0; i < 20; i++)
+	{
+		pAddr[i] = i;
+	}
+	// Still fits, stays in place.
+	TEST_CHECK(Kit_Realloc(pAddr, 24) == pAddr);
+	
+	// Grows into the next class, the content moves along.
+	pNew = Kit_Realloc(pAddr, 100);
+	TEST_CHECK(pNew != NULL && pNew != pAddr);
+	for(i = 0; pNew && i < 20; i++)
+	{
+		TEST_CHECK_EQ(pNew[i], i);
+	}
+	TEST_CHECK_EQ(stat_get(0).usedCnt, 0);
+	TEST_CHECK_EQ(stat_get(2).usedCnt, 1);
+	Kit_Free(pNew);
+	
+	// Not a heap address: ignored.
+	Kit_Free(&i);
+	Kit_Free(NULL);
+	TEST_CHECK(Kit_Realloc(&i, 8) == NULL);
+	TEST_CHECK_EQ(Kit_MemUsage(), 0);
+}
+
+#ifdef HEAP_GUARD_SUPPORT
+static void test_guard(void)
+{
+	uint8_t *pAddr = Kit_Malloc(10);
+	uint16_t errCnt = stat_get(0).guardErrCnt;
+	
+	// Fill pattern, then an overrun past the requested size is caught on free.
+	TEST_CHECK(pAddr != NULL);
+	TEST_CHECK_EQ(pAddr[0], 0xCD);
+	pAddr[10] = 0;
+	Kit_Free(pAddr);
+	TEST_CHECK_EQ(stat_get(0).guardErrCnt, errCnt + 1);
+	TEST_CHECK_EQ(stat_get(0).usedCnt, 1);// rejected, the block stays out of the pool
+	
+	// Double free.
+	pAddr = Kit_Malloc(10);
+	Kit_Free(pAddr);
+	Kit_Free(pAddr);
+	TEST_CHECK_EQ(stat_get(0).guardErrCnt, errCnt + 2);
+	
+	// Pointer into the middle of a block.
+	pAddr = Kit_Malloc(10);
+	Kit_Free(pAddr + 4);
+	TEST_CHECK_EQ(stat_get(0).guardErrCnt, errCnt + 3);
+	Kit_Free(pAddr);
+	TEST_CHECK_EQ(stat_get(0).guardErrCnt, errCnt + 3);
+}
+#endif
+
+int main(void)
+{
+	test_classes();
+	test_exhaust();
+	test_realloc();
+#ifdef HEAP_GUARD_SUPPORT
+	test_guard();
+#endif
+	
+	return TEST_RESULT();
+}
@@ -0,0 +1,158 @@
+/**
+ *@file test_kit_queue.c
+ *@brief Host test of the intrusive Kit_Queue list, its node pool and the copying queue.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "test_util.h"
+#include "kit_queue.h"
+#include "kit_heap.h"
+
+#define ITEM_NUM	300// more than the old uint8_t count could hold
+
+typedef struct
+{
+	uint32_t value;
+	stKitQueueNode_t node;
+}stItem_t;
+
+typedef struct
+{
+	stKitQueueNode_t node;
+	uint16_t value;
+}stPoolItem_t;
+
+static uint32_t item_value(stKitQueueNode_t *pNode)
+{
+	return pNode ? KIT_QUEUE_ENTRY(pNode, stItem_t, node)->value : 0xFFFFFFFF;
+}
+
+static void test_list(void)
+{
+	static stItem_t items[ITEM_NUM];
+	stKitQueueList_t list;
+	uint32_t i;
+	
+	Kit_QueueListInit(&list);
+	TEST_CHECK(Kit_QueuePopFront(&list) == NULL);
+	TEST_CHECK(Kit_QueuePopBack(&list) == NULL);
+	
+	for(i = 0; i < ITEM_NUM; i++)
+	{
+		items[i].value = i;
+		Kit_QueuePushBack(&list, &items[i].node);
+	}
+	TEST_CHECK_EQ(list.cnt, ITEM_NUM);
+	TEST_CHECK_EQ(item_value(Kit_QueuePeekFront(&list)), 0);
+	TEST_CHECK_EQ(item_value(Kit_QueuePeekBack(&list)), ITEM_NUM - 1);
+	
+	// Unlink from the middle, both ends and back to front.
+	Kit_QueueUnlink(&list, &items[150].node);
+	Kit_QueueUnlink(&list, &items[0].node);
+	Kit_QueueUnlink(&list, &items[ITEM_NUM - 1].node);
+	TEST_CHECK_EQ(list.cnt, ITEM_NUM - 3);
+	Kit_QueuePushFront(&list, &items[150].node);
+	TEST_CHECK_EQ(item_value(Kit_QueuePopFront(&list)), 150);
+	TEST_CHECK_EQ(item_value(Kit_QueuePopBack(&list)), ITEM_NUM - 2);
+	
+	for(i = 1; i < ITEM_NUM - 2; i++)
+	{
+		if(i == 150)
+		{
+			continue;
+		}
+		TEST_CHECK_EQ(item_value(Kit_QueuePopFront(&list)), i);
+	}
+	TEST_CHECK_EQ(list.cnt, 0);
+	TEST_CHECK(list.pHead == NULL && list.pTail == NULL);
+	
+	// A single node is both head and tail.
+	Kit_QueuePushFront(&list, &items[7].node);
+	TEST_CHECK(Kit_QueuePeekFront(&list) == Kit_QueuePeekBack(&list));
+	TEST_CHECK_EQ(item_value(Kit_QueuePopBack(&list)), 7);
+	TEST_CHECK(list.pHead == NULL && list.pTail == NULL);
+}
+
+static void test_pool(void)
+{
+	static stPoolItem_t poolBuf[4];
+	stKitQueuePool_t pool;
+	stKitQueueList_t list;
+	stKitQueueNode_t *pNode;
+	uint16_t i;
+	
+	Kit_QueuePoolInit(&pool, poolBuf, sizeof(stPoolItem_t), 4);
+	Kit_QueueListInit(&list);
+	
+	for(i = 0; i < 4; i++)
+	{
+		pNode = Kit_QueuePoolGet(&pool);
+		TEST_CHECK(pNode != NULL);
+		if(pNode)
+		{
+			TEST_CHECK((uint8_t *)pNode >= (uint8_t *)poolBuf && (uint8_t *)pNode < (uint8_t *)(poolBuf + 4));
+			((stPoolItem_t *)pNode)->value = i;
+			Kit_QueuePushBack(&list, pNode);
+		}
+	}
+	TEST_CHECK(Kit_QueuePoolGet(&pool) == NULL);
+	TEST_CHECK_EQ(pool.usedCnt, 4);
+	
+	for(i = 0; i < 4; i++)
+	{
+		pNode = Kit_QueuePopFront(&list);
+		TEST_CHECK(pNode != NULL && ((stPoolItem_t *)pNode)->value == i);
+		Kit_QueuePoolPut(&pool, pNode);
+	}
+	Kit_QueuePoolPut(&pool, NULL);
+	TEST_CHECK_EQ(pool.usedCnt, 0);
+	TEST_CHECK_EQ(pool.maxUsedCnt, 4);
+	TEST_CHECK(Kit_QueuePoolGet(&pool) != NULL);
+}
+
+static void test_copy_queue(void)
+{
+	void *pQueue = Kit_QueueCreate(sizeof(uint32_t));
+	uint32_t value, i;
+	
+	TEST_CHECK(Kit_QueueCreate(0) == NULL);
+	TEST_CHECK(pQueue != NULL);
+	TEST_CHECK_EQ(Kit_QueueTakeFirst(pQueue, &value), -1);
+	
+	for(i = 0; i < 5; i++)
+	{
+		TEST_CHECK_EQ(Kit_QueueAppend(pQueue, &i), 0);
+	}
+	TEST_CHECK_EQ(Kit_QueueCount(pQueue), 5);
+	TEST_CHECK_EQ(Kit_QueueAt(pQueue, 3, &value), 0);
+	TEST_CHECK_EQ(value, 3);
+	TEST_CHECK_EQ(Kit_QueueAt(pQueue, 5, &value), -1);
+	TEST_CHECK_EQ(Kit_QueueAt(pQueue, -1, &value), -1);
+	TEST_CHECK_EQ(Kit_QueueRemove(pQueue, 1), 0);
+	TEST_CHECK_EQ(Kit_QueueTakeFirst(pQueue, &value), 0);
+	TEST_CHECK_EQ(value, 0);
+	TEST_CHECK_EQ(Kit_QueueTakeFirst(pQueue, &value), 0);
+	TEST_CHECK_EQ(value, 2);
+	TEST_CHECK_EQ(Kit_QueueCount(pQueue), 2);
+	
+	// Destroy frees the remaining items and the queue itself.
+	Kit_QueueDestroy(&pQueue);
+	TEST_CHECK(pQueue == NULL);
+	TEST_CHECK_EQ(Kit_MemUsage(), 0);
+	TEST_CHECK_EQ(Kit_QueueAppend(NULL, &value), -1);
+	TEST_CHECK_EQ(Kit_QueueCount(NULL), 0);
+}
+
+int main(void)
+{
+	test_list();
+	test_pool();
+	test_copy_queue();
+	
+	return TEST_RESULT();
+}
@@ -0,0 +1,183 @@
+/**
+ *@file test_manchester.c
+ *@brief Host test of the table driven Manchester codec against the original implementation.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <string.h>
+
+#include "test_util.h"
+#include "ref_codec.h"
+#include "manchester.h"
+#include "encrypt_stream.h"
+
+#define MAX_LEN		200
+
+// An encoded byte is valid if each of its 4 symbols is 01 or 10.
+static bool symbols_valid(uint8_t in)
+{
+	uint8_t j;
+	
+	for(j = 0; j < 8; j += 2)
+	{
+		uint8_t sym = (in >> j) & 0x03;
+		
+		if(sym == 0x00 || sym == 0x03)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void test_encode(void)
+{
+	uint16_t byte;
+	uint8_t src, enc[2], refEnc[2];
+	
+	for(byte = 0; byte < 256; byte++)
+	{
+		src = byte;
+		encode_manchester(&src, enc, 1);
+		ref_encode_manchester(&src, refEnc, 1);
+		TEST_CHECK(memcmp(enc, refEnc, 2) == 0);
+		TEST_CHECK_EQ(encode_manchester_byte(src), (refEnc[0] << 8) | refEnc[1]);
+	}
+}
+
+static void test_exhaustive_pairs(void)
+{
+	uint32_t pair;
+	uint8_t enc[2], dec = 0, refDec = 0;
+	
+	// Every possible received pair, valid or not.
+	for(pair = 0; pair < 0x10000; pair++)
+	{
+		uint16_t errOffset, refLen, len;
+		
+		enc[0] = pair >> 8;
+		enc[1] = pair & 0xFF;
+		refLen = ref_decode_manchester(enc, &refDec, 2);
+		len = decode_manchester_ex(enc, &dec, 2, &errOffset);
+		TEST_CHECK_EQ(len, refLen);
+		if(refLen)
+		{
+			TEST_CHECK_EQ(dec, refDec);
+			TEST_CHECK_EQ(errOffset, 2);
+		}
+		else
+		{
+			TEST_CHECK_EQ(errOffset, symbols_valid(enc[0]) ? 1 : 0);
+		}
+		TEST_CHECK_EQ(decode_manchester(enc, &dec, 2), refLen);
+	}
+}
+
+static void test_lengths(void)
+{
+	uint8_t src[MAX_LEN], enc[MAX_LEN * 2 + 1], refEnc[MAX_LEN * 2 + 1], dec[MAX_LEN], refDec[MAX_LEN];
+	uint32_t seed = 3;
+	uint16_t len, i;
+	
+	for(len = 0; len < MAX_LEN; len++)
+	{
+		uint16_t errOffset, refLen, decLen, expErr;
+		
+		for(i = 0; i < len; i++)
+		{
+			src[i] = test_rand(&seed);
+		}
+		encode_manchester(src, enc, len);
+		ref_encode_manchester(src, refEnc, len);
+		TEST_CHECK(memcmp(enc, refEnc, len * 2) == 0);
+		TEST_CHECK_EQ(decode_manchester_ex(enc, dec, len * 2, &errOffset), len);
+		TEST_CHECK_EQ(errOffset, len * 2);
+		TEST_CHECK(memcmp(src, dec, len) == 0);
+		
+		// A trailing odd byte is ignored.
+		enc[len * 2] = 0x00;
+		TEST_CHECK_EQ(decode_manchester(enc, dec, len * 2 + 1), len);
+		
+		if(len == 0)
+		{
+			continue;
+		}
+		// One corrupted byte, as a receiver sees at the end of a packet.
+		expErr = test_rand(&seed) % (len * 2);
+		enc[expErr] &= ~(0x03 << ((test_rand(&seed) % 4) * 2));// symbol 00
+		refLen = ref_decode_manchester(enc, refDec, len * 2);
+		decLen = decode_manchester_ex(enc, dec, len * 2, &errOffset);
+		TEST_CHECK_EQ(decLen, refLen);
+		TEST_CHECK_EQ(decLen, expErr / 2);
+		TEST_CHECK_EQ(errOffset, expErr);
+		TEST_CHECK(memcmp(dec, refDec, decLen) == 0);
+	}
+}
+
+static void test_stream(void)
+{
+	uint8_t src[MAX_LEN], enc[MAX_LEN * 2], dec[MAX_LEN], streamDec[MAX_LEN];
+	stManchesterDec_t dec1;
+	stEncryptStream_t stream;
+	uint32_t seed = 5;
+	uint16_t len, i;
+	
+	for(len = 1; len < MAX_LEN; len += 7)
+	{
+		uint16_t errOffset, decLen, outLen = 0;
+		
+		for(i = 0; i < len; i++)
+		{
+			src[i] = test_rand(&seed);
+		}
+		encode_manchester(src, enc, len);
+		if(len & 0x01)
+		{
+			enc[test_rand(&seed) % (len * 2)] = 0xFF;
+		}
+		decLen = decode_manchester_ex(enc, dec, len * 2, &errOffset);
+		
+		// Streaming decoder stops at the same offset with the same output.
+		manchester_dec_init(&dec1);
+		for(i = 0; i < len * 2; i++)
+		{
+			eManchesterDecResult_t res = manchester_dec_push(&dec1, enc[i], &streamDec[outLen]);
+			
+			if(res == MANCHESTER_DEC_BYTE)
+			{
+				outLen++;
+			}
+			else if(res == MANCHESTER_DEC_INVALID)
+			{
+				break;
+			}
+		}
+		TEST_CHECK_EQ(outLen, decLen);
+		TEST_CHECK(memcmp(dec, streamDec, decLen) == 0);
+		TEST_CHECK_EQ(dec1.errOffset, (errOffset == len * 2) ? MANCHESTER_NO_ERR : errOffset);
+		// Once invalid, the rest is ignored.
+		TEST_CHECK(errOffset == len * 2 || manchester_dec_push(&dec1, 0xA5, &streamDec[0]) == MANCHESTER_DEC_INVALID);
+		
+		// And so does the stream codec used by the receive loop.
+		encrypt_dec_init(&stream, ENCRYPT_MANCHESTER, streamDec, sizeof(streamDec));
+		for(i = 0; i < len * 2; i++)
+		{
+			encrypt_dec_push(&stream, enc + i, 1);
+		}
+		TEST_CHECK_EQ(encrypt_dec_finish(&stream), decLen);
+		TEST_CHECK(memcmp(dec, streamDec, decLen) == 0);
+	}
+}
+
+int main(void)
+{
+	test_encode();
+	test_exhaustive_pairs();
+	test_lengths();
+	test_stream();
+	
+	return TEST_RESULT();
+}
@@ -0,0 +1,514 @@
+/**
+ *@file test_store.c
+ *@brief Host test of the app_store record store on the NOR flash model, with power cuts.
+ *
+ *app_store.c is built into this file so a reboot can reset its state.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include "app_store.c"
+
+#include "test_util.h"
+#include "flash_sim.h"
+
+#define VER_MAX			4096
+#define KEY_FIRST		STORE_KEY_CFG_BLE
+
+typedef struct
+{
+	uint32_t committed;// every version before this one was replaced for sure
+	uint32_t last;
+	uint8_t  len[VER_MAX];// stored length of each version, 0 = deleted
+	uint8_t  buf[STORE_REC_MAX_LEN];// handed to Store_WriteAsync, must stay valid
+}stKeyModel_t;
+
+static stKeyModel_t model[STORE_KEY_NUM];
+static uint8_t legacy0[STORE_LEGACY_SIZE];
+static uint8_t legacy1[STORE_LEGACY_SIZE];
+
+/* Power comes back with a cut armed at cutOp of this boot, FLASH_SIM_NO_CUT for none */
+static void store_boot(uint32_t cutOp, uint32_t seed)
+{
+	FlashSim_PowerOn();
+	FlashSim_CutAt(cutOp, seed);
+	activePage = 0;
+	activeSeq = 0;
+	writeOffset = FLASH_PAGE_SIZE;
+	memset(recOffset, 0, sizeof(recOffset));
+	storeState = STORE_STATE_IDLE;
+	memset(pending, 0, sizeof(pending));
+	pendingMask = 0;
+	gcDone = false;
+	pfnStoreDone = NULL;
+	Store_Init();
+}
+
+static void store_reboot(void)
+{
+	store_boot(FLASH_SIM_NO_CUT, 0);
+}
+
+/* ------------------------------------------------------------------ format */
+
+static void legacy_load(void)
+{
+	uint32_t i;
+	
+	FlashSim_Reset();
+	for(i = 0; i < STORE_LEGACY_SIZE; i++)
+	{
+		legacy0[i] = 0x10 + i;
+		legacy1[i] = 0xA0 ^ i;
+	}
+	// the old layout only ever wrote the start of each page
+	FlashSim_Load(FLASH_PAGE_0_ADDR, legacy0, 40);
+	FlashSim_Load(FLASH_PAGE_1_ADDR, legacy1, 24);
+	memset(legacy0 + 40, 0xFF, sizeof(legacy0) - 40);
+	memset(legacy1 + 24, 0xFF, sizeof(legacy1) - 24);
+}
+
+static bool legacy_check(void)
+{
+	uint8_t buf[STORE_LEGACY_SIZE];
+	
+	return Store_Read(STORE_KEY_LEGACY_PAGE0, buf, sizeof(buf)) == STORE_LEGACY_SIZE && memcmp(buf, legacy0, sizeof(buf)) == 0
+		&& Store_Read(STORE_KEY_LEGACY_PAGE1, buf, sizeof(buf)) == STORE_LEGACY_SIZE && memcmp(buf, legacy1, sizeof(buf)) == 0;
+}
+
+static void test_format(void)
+{
+	uint8_t buf[STORE_LEGACY_SIZE];
+	uint32_t formatOps, cut1, cut2;
+	
+	legacy_load();
+	store_reboot();
+	formatOps = FlashSim_GetOpCnt();
+	TEST_CHECK(legacy_check());
+	TEST_CHECK_EQ(activePage, FLASH_PAGE_1_ADDR);
+	TEST_CHECK_EQ(FlashSim_GetErrCnt(), 0);
+	
+	// The old config stays readable in place until the first GC.
+	Flash_Read(buf, FLASH_PAGE_0_ADDR, 40);
+	TEST_CHECK(memcmp(buf, legacy0, 40) == 0);
+	
+	// A second boot finds the store.
+	store_reboot();
+	TEST_CHECK_EQ(FlashSim_GetOpCnt(), formatOps);
+	TEST_CHECK(legacy_check());
+	
+	// Power cut at every operation of the format, then once more at every operation of the retry.
+	for(cut1 = 0; cut1 < formatOps; cut1++)
+	{
+		for(cut2 = 0; cut2 <= formatOps; cut2++)
+		{
+			legacy_load();
+			store_boot(cut1, cut1 * 977 + cut2);
+			TEST_CHECK(FlashSim_IsCut());
+			store_boot(cut2, cut2 * 131 + cut1);
+			store_reboot();
+			if(!legacy_check())
+			{
+				printf("format cut at %u then %u lost the old layout\n", cut1, cut2);
+				testFailCnt++;
+			}
+		}
+	}
+	TEST_CHECK_EQ(FlashSim_GetErrCnt(), 0);
+}
+
+/* ---------------------------------------------------------------- records */
+
+static uint8_t ver_len(uint8_t key, uint32_t ver)
+{
+	return 8 + (ver * 7 + key * 5) % (STORE_REC_MAX_LEN - 8 + 1);
+}
+
+static void ver_fill(uint8_t *pBuf, uint8_t key, uint32_t ver, uint8_t len)
+{
+	uint8_t i;
+	
+	memcpy(pBuf, &ver, sizeof(ver));
+	pBuf[4] = key;
+	for(i = 5; i < len; i++)
+	{
+		pBuf[i] = (uint8_t)(ver * 31 + key + i);
+	}
+}
+
+static void model_reset(void)
+{
+	uint8_t key;
+	
+	memset(model, 0, sizeof(model));
+	for(key = 0; key < STORE_KEY_NUM; key++)
+	{
+		model[key].len[0] = 0;// version 0: not stored
+	}
+}
+
+static void model_commit(void)
+{
+	uint8_t key;
+	
+	for(key = KEY_FIRST; key < STORE_KEY_NUM; key++)
+	{
+		model[key].committed = model[key].last;
+	}
+}
+
+/* The stored version must be one issued since the last time the store was idle */
+static bool model_check_key(uint8_t key, uint32_t *pVer)
+{
+	stKeyModel_t *pKey = &model[key];
+	uint8_t buf[STORE_REC_MAX_LEN];
+	uint16_t len = Store_Read((eStoreKey_t)key, buf, sizeof(buf));
+	uint32_t ver;
+	uint8_t i;
+	
+	if(len == 0)
+	{
+		for(ver = pKey->committed; ver <= pKey->last; ver++)
+		{
+			if(pKey->len[ver] == 0)
+			{
+				*pVer = ver;
+				return true;
+			}
+		}
+		printf("key %d lost, versions %u..%u\n", key, pKey->committed, pKey->last);
+		return false;
+	}
+	
+	memcpy(&ver, buf, sizeof(ver));
+	if(ver < pKey->committed || ver > pKey->last || pKey->len[ver] != len || buf[4] != key)
+	{
+		printf("key %d read version %u len %d, versions %u..%u\n", key, ver, len, pKey->committed, pKey->last);
+		return false;
+	}
+	for(i = 5; i < len; i++)
+	{
+		if(buf[i] != (uint8_t)(ver * 31 + key + i))
+		{
+			printf("key %d version %u corrupted\n", key, ver);
+			return false;
+		}
+	}
+	*pVer = ver;
+	return true;
+}
+
+static bool model_check(void)
+{
+	bool ok = true;
+	uint32_t ver;
+	uint8_t key;
+	
+	for(key = KEY_FIRST; key < STORE_KEY_NUM; key++)
+	{
+		if(!model_check_key(key, &ver))
+		{
+			ok = false;
+			continue;
+		}
+		// continue from what survived
+		model[key].committed = ver;
+		model[key].last = ver;
+	}
+	return ok;
+}
+
+/* Random async writes and deletes, flash events interleaved, until steps are done or the power is cut */
+static void workload(uint32_t *pSeed, uint32_t steps)
+{
+	uint32_t step;
+	
+	for(step = 0; step < steps && !FlashSim_IsCut(); step++)
+	{
+		uint8_t key = KEY_FIRST + test_rand(pSeed) % (STORE_KEY_NUM - KEY_FIRST);
+		stKeyModel_t *pKey = &model[key];
+		uint32_t ver = pKey->last + 1, n;
+		
+		if(ver >= VER_MAX)
+		{
+			break;
+		}
+		if(test_rand(pSeed) % 10 == 0)
+		{
+			pKey->len[ver] = 0;
+			pKey->last = ver;
+			Store_Delete((eStoreKey_t)key);
+		}
+		else
+		{
+			pKey->len[ver] = ver_len(key, ver);
+			ver_fill(pKey->buf, key, ver, pKey->len[ver]);
+			pKey->last = ver;
+			Store_WriteAsync((eStoreKey_t)key, pKey->buf, pKey->len[ver]);
+		}
+		
+		for(n = test_rand(pSeed) % 4; n > 0; n--)
+		{
+			FlashSim_Process();
+		}
+		if(test_rand(pSeed) % 8 == 0)
+		{
+			FlashSim_ProcessAll();
+			if(!FlashSim_IsCut() && !Store_IsBusy())
+			{
+				model_commit();
+			}
+		}
+	}
+	FlashSim_ProcessAll();
+	if(!FlashSim_IsCut() && !Store_IsBusy())
+	{
+		model_commit();
+	}
+}
+
+static void test_records(void)
+{
+	uint32_t seed = 1, ops, cut, round;
+	uint32_t gcStart;
+	
+	// Without cuts: every write lands, GC runs a few times.
+	FlashSim_Reset();
+	store_reboot();
+	model_reset();
+	gcStart = gcCnt;
+	workload(&seed, 2000);
+	TEST_CHECK(gcCnt - gcStart >= 3);
+	TEST_CHECK_EQ(failCnt, 0);
+	TEST_CHECK(model_check());
+	store_reboot();
+	TEST_CHECK(model_check());
+	
+	// One cut at every operation of a shorter run, which still includes GCs.
+	FlashSim_Reset();
+	store_reboot();
+	model_reset();
+	seed = 2;
+	ops = FlashSim_GetOpCnt();
+	workload(&seed, 600);
+	ops = FlashSim_GetOpCnt() - ops;
+	for(cut = 0; cut < ops; cut++)
+	{
+		FlashSim_Reset();
+		store_reboot();
+		model_reset();
+		seed = 2;
+		FlashSim_CutAt(cut, cut);
+		workload(&seed, 600);
+		store_reboot();
+		if(!model_check())
+		{
+			printf("cut at %u of %u\n", cut, ops);
+			testFailCnt++;
+		}
+	}
+	
+	// Many random cuts in a row, the store carries on after each reboot.
+	FlashSim_Reset();
+	store_reboot();
+	model_reset();
+	seed = 3;
+	for(round = 0; round < 2000; round++)
+	{
+		FlashSim_CutAt(test_rand(&seed) % 400, round);
+		workload(&seed, 300);
+		store_reboot();
+		if(!model_check())
+		{
+			printf("random cut round %u\n", round);
+			testFailCnt++;
+			break;
+		}
+	}
+	TEST_CHECK_EQ(FlashSim_GetErrCnt(), 0);
+}
+
+/* A delete queued behind a write of a key that is not stored yet must still win */
+static void test_delete_pending(void)
+{
+	static uint8_t data[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+	uint8_t buf[8];
+	
+	FlashSim_Reset();
+	store_reboot();
+	Store_WriteAsync(STORE_KEY_SN, data, sizeof(data));
+	Store_Delete(STORE_KEY_SN);
+	FlashSim_ProcessAll();
+	TEST_CHECK_EQ(Store_Read(STORE_KEY_SN, buf, sizeof(buf)), 0);
+	store_reboot();
+	TEST_CHECK_EQ(Store_Read(STORE_KEY_SN, buf, sizeof(buf)), 0);
+}
+
+/* Records land in request order, a key queued again moves behind the others */
+static void order_queue(void)
+{
+	static uint8_t data[4][8];
+	uint8_t i;
+	
+	for(i = 0; i < 4; i++)
+	{
+		memset(data[i], i, sizeof(data[i]));
+	}
+	Store_WriteAsync(STORE_KEY_CFG_TICK, data[0], sizeof(data[0]));// programmed at once
+	Store_WriteAsync(STORE_KEY_RADIO_CAL, data[1], sizeof(data[1]));
+	Store_WriteAsync(STORE_KEY_SN, data[2], sizeof(data[2]));
+	Store_WriteAsync(STORE_KEY_CFG_BLE, data[3], sizeof(data[3]));
+	Store_WriteAsync(STORE_KEY_RADIO_CAL, data[1], sizeof(data[1]));
+	FlashSim_ProcessAll();
+}
+
+static void test_order(void)
+{
+	static const eStoreKey_t order[4] = {STORE_KEY_CFG_TICK, STORE_KEY_SN, STORE_KEY_CFG_BLE, STORE_KEY_RADIO_CAL};
+	uint32_t ops, cut;
+	uint8_t buf[8];
+	uint8_t i;
+	
+	FlashSim_Reset();
+	store_reboot();
+	ops = FlashSim_GetOpCnt();
+	order_queue();
+	ops = FlashSim_GetOpCnt() - ops;
+	
+	for(cut = 0; cut <= ops; cut++)
+	{
+		FlashSim_Reset();
+		store_reboot();
+		FlashSim_CutAt(cut, cut);
+		order_queue();
+		store_reboot();
+		for(i = 1; i < 4; i++)
+		{
+			if(Store_Read(order[i], buf, sizeof(buf)) != 0 && Store_Read(order[i - 1], buf, sizeof(buf)) == 0)
+			{
+				printf("cut at %u: key %d stored before key %d\n", cut, order[i], order[i - 1]);
+				testFailCnt++;
+			}
+		}
+	}
+}
+
+static eStoreKey_t doneKey[8];
+static bool doneOk[8];
+static uint8_t doneCnt;
+
+static void done_record(eStoreKey_t key, bool success)
+{
+	if(doneCnt < 8)
+	{
+		doneKey[doneCnt] = key;
+		doneOk[doneCnt] = success;
+	}
+	doneCnt++;
+}
+
+/* Every queued key is reported once it is on flash, in the order it lands */
+static void test_done(void)
+{
+	static const eStoreKey_t order[4] = {STORE_KEY_CFG_TICK, STORE_KEY_SN, STORE_KEY_CFG_BLE, STORE_KEY_RADIO_CAL};
+	uint8_t i;
+	
+	FlashSim_Reset();
+	store_reboot();
+	doneCnt = 0;
+	Store_SetDoneHandler(done_record);
+	order_queue();
+	TEST_CHECK_EQ(doneCnt, 4);
+	for(i = 0; i < 4 && i < doneCnt; i++)
+	{
+		TEST_CHECK_EQ(doneKey[i], order[i]);
+		TEST_CHECK(doneOk[i]);
+	}
+	
+	// nothing to program, each request is reported as it is queued
+	doneCnt = 0;
+	order_queue();
+	TEST_CHECK_EQ(doneCnt, 5);
+	TEST_CHECK(!Store_IsBusy());
+	Store_SetDoneHandler(NULL);
+}
+
+static uint32_t failDoneCnt;
+static uint32_t failFailCnt;
+
+static void done_count(eStoreKey_t key, bool success)
+{
+	failDoneCnt++;
+	failFailCnt += success ? 0 : 1;
+}
+
+/* Enough writes of full records to run a GC, each one settled before the next is queued */
+static uint32_t fail_workload(void)
+{
+	static uint8_t data[3][STORE_REC_MAX_LEN];
+	uint32_t i;
+	
+	for(i = 0; i < 90; i++)
+	{
+		memset(data[i % 3], (uint8_t)i, sizeof(data[0]));
+		Store_WriteAsync((eStoreKey_t)(KEY_FIRST + i % 3), data[i % 3], sizeof(data[0]));
+		FlashSim_ProcessAll();
+	}
+	return i;
+}
+
+/* A refused or failed flash operation reports its keys, nothing stays queued and the store goes on */
+static void test_fail(void)
+{
+	static uint8_t data[8] = {8, 7, 6, 5, 4, 3, 2, 1};
+	uint8_t buf[8];
+	uint32_t reqs, req, atQueue;
+	uint32_t gcStart;
+	
+	FlashSim_Reset();
+	store_reboot();
+	gcStart = gcCnt;
+	reqs = FlashSim_GetAsyncCnt();
+	fail_workload();
+	reqs = FlashSim_GetAsyncCnt() - reqs;
+	TEST_CHECK(gcCnt > gcStart);
+	
+	for(atQueue = 0; atQueue < 2; atQueue++)
+	{
+		for(req = 0; req < reqs; req++)
+		{
+			FlashSim_Reset();
+			store_reboot();
+			failDoneCnt = 0;
+			failFailCnt = 0;
+			Store_SetDoneHandler(done_count);
+			FlashSim_FailAsync(req, atQueue != 0);
+			if(fail_workload() != failDoneCnt || failFailCnt == 0 || Store_IsBusy())
+			{
+				printf("fail request %u at %s: %u done, %u failed\n", req, atQueue ? "queue" : "event", failDoneCnt, failFailCnt);
+				testFailCnt++;
+			}
+			
+			Store_WriteAsync(STORE_KEY_SN, data, sizeof(data));
+			FlashSim_ProcessAll();
+			store_reboot();
+			TEST_CHECK_EQ(Store_Read(STORE_KEY_SN, buf, sizeof(buf)), sizeof(data));
+			TEST_CHECK(memcmp(buf, data, sizeof(data)) == 0);
+		}
+	}
+	TEST_CHECK_EQ(FlashSim_GetErrCnt(), 0);
+}
+
+int main(void)
+{
+	test_format();
+	test_records();
+	test_delete_pending();
+	test_order();
+	test_done();
+	test_fail();
+	
+	return TEST_RESULT();
+}
@@ -0,0 +1,53 @@
+/**
+ *@file test_util.h
+ *@brief Minimal check and timing helpers for the host tests and benchmarks.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+static int testFailCnt __attribute__((unused)) = 0;
+
+#define TEST_CHECK(cond) do { \
+	if(!(cond)) \
+	{ \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		testFailCnt++; \
+	} \
+} while(0)
+
+#define TEST_CHECK_EQ(a, b) do { \
+	long long _a = (long long)(a), _b = (long long)(b); \
+	if(_a != _b) \
+	{ \
+		printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		testFailCnt++; \
+	} \
+} while(0)
+
+#define TEST_RESULT()	(testFailCnt ? (printf("%d check(s) failed\n", testFailCnt), 1) : (printf("OK\n"), 0))
+
+static inline uint64_t test_now_ns(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Deterministic data for tests and benchmarks.
+static inline uint32_t test_rand(uint32_t *pSeed)
+{
+	*pSeed = *pSeed * 1103515245UL + 12345UL;
+	return *pSeed >> 8;
+}
+
+#endif /* __TEST_UTIL_H__ */
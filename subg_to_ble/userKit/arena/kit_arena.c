@@ -0,0 +1,70 @@
+/**
+ *@file kit_arena.c
+ *@author Ribin Huang (you@domain.com)
+ *@brief 
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#include <stddef.h>
+
+#include "kit_arena.h"
+#include "kit_assert.h"
+
+#define ARENA_ALIGN		4
+
+void Kit_ArenaInit(stKitArena_t *pArena, void *pBuf, uint32_t size)
+{
+	KIT_ASSERT(pArena);
+	KIT_ASSERT(pBuf);
+	
+	pArena->pBuf = (uint8_t *)pBuf;
+	pArena->size = size;
+	pArena->used = 0;
+	pArena->maxUsed = 0;
+	pArena->failCnt = 0;
+}
+
+void *Kit_ArenaAlloc(stKitArena_t *pArena, uint32_t size)
+{
+	void *pAddr;
+	
+	KIT_ASSERT(pArena);
+	
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if(size > pArena->size - pArena->used)
+	{
+		pArena->failCnt++;
+		return NULL;
+	}
+	
+	pAddr = pArena->pBuf + pArena->used;
+	pArena->used += size;
+	if(pArena->used > pArena->maxUsed)
+	{
+		pArena->maxUsed = pArena->used;
+	}
+	
+	return pAddr;
+}
+
+void Kit_ArenaReset(stKitArena_t *pArena)
+{
+	KIT_ASSERT(pArena);
+	
+	pArena->used = 0;
+}
+
+uint32_t Kit_ArenaMaxUsed(stKitArena_t *pArena)
+{
+	KIT_ASSERT(pArena);
+	
+	return pArena->maxUsed;
+}
@@ -0,0 +1,44 @@
+/**
+ *@file kit_arena.h
+ *@author Ribin Huang (you@domain.com)
+ *@brief 
+ *@version 1.0
+ *@date 2021-01-05
+ *
+ *Copyright (c) 2019 - 2020 Fractal Auto Technology Co.,Ltd.
+ *All right reserved.
+ *
+ *This program is free software; you can redistribute it and/or modify
+ *it under the terms of the GNU General Public License version 2 as
+ *published by the Free Software Foundation.
+ *
+ */
+#ifndef __KIT_ARENA_H__
+#define __KIT_ARENA_H__
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bump allocator over a caller buffer, everything is freed at once by reset */
+typedef struct
+{
+	uint8_t		*pBuf;
+	uint32_t	size;
+	uint32_t	used;
+	uint32_t	maxUsed;
+	uint32_t	failCnt;
+}stKitArena_t;
+
+void Kit_ArenaInit(stKitArena_t *pArena, void *pBuf, uint32_t size);
+void *Kit_ArenaAlloc(stKitArena_t *pArena, uint32_t size);
+void Kit_ArenaReset(stKitArena_t *pArena);
+uint32_t Kit_ArenaMaxUsed(stKitArena_t *pArena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -18,95 +18,136 @@
 #include "kit_fifo.h"
 #include "kit_assert.h"
 
+/* Data must be visible before the index that publishes it, and read before
+ * the index that frees it. */
+#if defined(__CC_ARM)
+#define KIT_FIFO_BARRIER()      __dmb(0xF)
+#elif defined(__GNUC__)
+#define KIT_FIFO_BARRIER()      __sync_synchronize()
+#else
+#define KIT_FIFO_BARRIER()
+#endif
+
+static uint32_t floor_power_of_two(uint32_t value)
+{
+    while(value & (value - 1))
+    {
+        value &= value - 1;
+    }
+    
+    return value;
+}
+
+static void ring_copy_in(uint8_t *pBuf, uint32_t bufSize, uint32_t offset, const uint8_t *pData, uint32_t len)
+{
+    uint32_t firstLen = bufSize - offset;
+    
+    if(firstLen >= len)
+    {
+        memcpy(pBuf + offset, pData, len);
+    }
+    else
+    {
+        memcpy(pBuf + offset, pData, firstLen);
+        memcpy(pBuf, pData + firstLen, len - firstLen);
+    }
+}
+
+static void ring_copy_out(const uint8_t *pBuf, uint32_t bufSize, uint32_t offset, uint8_t *pData, uint32_t len)
+{
+    uint32_t firstLen = bufSize - offset;
+    
+    if(firstLen >= len)
+    {
+        memcpy(pData, pBuf + offset, len);
+    }
+    else
+    {
+        memcpy(pData, pBuf + offset, firstLen);
+        memcpy(pData + firstLen, pBuf, len - firstLen);
+    }
+}
+
 uint32_t Kit_FifoCreate(stKitFifo_t *pFifo, uint8_t *pBuf, uint32_t bufSize)
 {
     KIT_ASSERT(pFifo);
     KIT_ASSERT(pBuf);
     KIT_ASSERT(bufSize);
+    KIT_ASSERT((bufSize & (bufSize - 1)) == 0);
 
-    pFifo->bufSize = bufSize;
+    pFifo->bufSize = floor_power_of_two(bufSize);
+    pFifo->mask = pFifo->bufSize - 1;
     pFifo->pBuf = pBuf;
-    pFifo->pFront = pBuf;
-    pFifo->pTail = pBuf;
+    pFifo->head = 0;
+    pFifo->tail = 0;
+    pFifo->maxLen = 0;
 
     return 1;
 }
 
 uint32_t Kit_FifoIn(stKitFifo_t *pFifo, uint8_t *pData, uint32_t len)
 {
-    volatile uint8_t *pTail = NULL;
-    
-    uint32_t i = 0;
+    uint32_t head;
+    uint32_t freeLen;
     
     KIT_ASSERT(pData);
     KIT_ASSERT(pFifo);
     KIT_ASSERT(pFifo->pBuf);
-    KIT_ASSERT(pFifo->pFront);
-    KIT_ASSERT(pFifo->pTail);
 
-    pTail = pFifo->pTail;
+    head = pFifo->head;
+    freeLen = pFifo->bufSize - (head - pFifo->tail);
+    if(len > freeLen)
+    {
+        len = freeLen;
+    }
     
-    for(i = 0; i < len; i++)
+    ring_copy_in(pFifo->pBuf, pFifo->bufSize, head & pFifo->mask, pData, len);
+    KIT_FIFO_BARRIER();
+    pFifo->head = head + len;
+    if(pFifo->bufSize - freeLen + len > pFifo->maxLen)
     {
-        if(++pTail >= pFifo->pBuf + pFifo->bufSize)
-        {
-            pTail = pFifo->pBuf;
-        }
-        if(pTail == pFifo->pFront) 
-        {
-            break;
-        }
-        
-        *pFifo->pTail = *pData++;
-        pFifo->pTail = pTail;
+        pFifo->maxLen = pFifo->bufSize - freeLen + len;
     }
     
-    return i;
+    return len;
 }
 
 uint32_t Kit_FifoOut(stKitFifo_t *pFifo, uint8_t *pData, uint32_t len)
 {
-    uint32_t i = 0;
+    uint32_t tail;
+    uint32_t usedLen;
     
     KIT_ASSERT(pData);
     KIT_ASSERT(pFifo);
     KIT_ASSERT(pFifo->pBuf);
-    KIT_ASSERT(pFifo->pFront);
-    KIT_ASSERT(pFifo->pTail);
 
-    while((pFifo->pFront != pFifo->pTail) && (i < len) && (i < pFifo->bufSize))
+    tail = pFifo->tail;
+    usedLen = pFifo->head - tail;
+    KIT_FIFO_BARRIER();
+    if(len > usedLen)
     {
-        pData[i++] = *pFifo->pFront++;
-        if(pFifo->pFront >= pFifo->pBuf + pFifo->bufSize) 
-        {
-            pFifo->pFront = pFifo->pBuf;
-        }
+        len = usedLen;
     }
+    
+    ring_copy_out(pFifo->pBuf, pFifo->bufSize, tail & pFifo->mask, pData, len);
+    KIT_FIFO_BARRIER();
+    pFifo->tail = tail + len;
 
-    return i;
+    return len;
 }
 
 uint32_t Kit_FifoLenGet(stKitFifo_t *pFifo)
 {
-    volatile uint8_t *pFront = NULL;
-    uint32_t i = 0;
-    
     KIT_ASSERT(pFifo);
-    KIT_ASSERT(pFifo->pFront);
-    KIT_ASSERT(pFifo->pTail);
 
-    pFront = pFifo->pFront;
+    return pFifo->head - pFifo->tail;
+}
 
-    while((pFront != pFifo->pTail) && (i < pFifo->bufSize))
-    {
-        i++;
-        if(++pFront >= pFifo->pBuf + pFifo->bufSize) 
-        {
-            pFront = pFifo->pBuf;
-        }
-    }
+uint32_t Kit_FifoMaxLenGet(stKitFifo_t *pFifo)
+{
+    KIT_ASSERT(pFifo);
 
-    return i;
+    return pFifo->maxLen;
 }
 
 uint32_t Kit_FifoStructCreate(stKitFifoStruct_t *pFifoS, void *pBuf, uint32_t bufSize, uint16_t blockSize)
@@ -115,90 +156,138 @@ uint32_t Kit_FifoStructCreate(stKitFifoStruct_t *pFifoS, void *pBuf, uint32_t bu
     KIT_ASSERT(pBuf);
     KIT_ASSERT(bufSize);
     KIT_ASSERT(blockSize);
+    KIT_ASSERT(((bufSize / blockSize) & (bufSize / blockSize - 1)) == 0);
 
     pFifoS->elemSize = blockSize;
-    pFifoS->sumCnt = bufSize / blockSize;
-    pFifoS->pBuf = pBuf;
-    pFifoS->front = 0;
+    pFifoS->sumCnt = floor_power_of_two(bufSize / blockSize);
+    pFifoS->mask = pFifoS->sumCnt - 1;
+    pFifoS->pBuf = (uint8_t *)pBuf;
+    pFifoS->head = 0;
     pFifoS->tail = 0;
-	
+    pFifoS->maxCnt = 0;
+
     return 1;
 }
 
 uint32_t Kit_FifoStructIn(stKitFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt)
 {
-    uint32_t i = blockCnt;
-    uint32_t mdwTail = 0;
+    uint32_t head;
+    uint32_t freeCnt;
+    
     KIT_ASSERT(pFifoS);
     KIT_ASSERT(pFifoS->pBuf);
     KIT_ASSERT(pData);
 
-    mdwTail = pFifoS->tail;
-    for(i = 0; i < blockCnt; i++)
+    head = pFifoS->head;
+    freeCnt = pFifoS->sumCnt - (head - pFifoS->tail);
+    if(blockCnt > freeCnt)
     {
-        if(++mdwTail >= pFifoS->sumCnt)      
-        {
-            mdwTail = 0;
-        }
-        
-        if(mdwTail == pFifoS->front)   
-        {
-            break; 
-        }
-        
-        memcpy((uint8_t *)pFifoS->pBuf + pFifoS->tail * pFifoS->elemSize, pData, pFifoS->elemSize);
-
-        pData = (uint8_t *)pData + pFifoS->elemSize;
-
-        pFifoS->tail = mdwTail;
+        blockCnt = freeCnt;
     }
     
-    return i;
+    ring_copy_in(pFifoS->pBuf, pFifoS->sumCnt * pFifoS->elemSize, (head & pFifoS->mask) * pFifoS->elemSize, 
+        (const uint8_t *)pData, blockCnt * pFifoS->elemSize);
+    KIT_FIFO_BARRIER();
+    pFifoS->head = head + blockCnt;
+    if(pFifoS->sumCnt - freeCnt + blockCnt > pFifoS->maxCnt)
+    {
+        pFifoS->maxCnt = pFifoS->sumCnt - freeCnt + blockCnt;
+    }
+    
+    return blockCnt;
 }
 
 uint32_t Kit_FifoStructOut(stKitFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt)
 {
-    uint32_t i = 0;
+    uint32_t tail;
+    uint32_t usedCnt;
     
     KIT_ASSERT(pFifoS);
     KIT_ASSERT(pFifoS->pBuf);
     KIT_ASSERT(pData);
 
-    while((pFifoS->front != pFifoS->tail) && (i < pFifoS->sumCnt) && (i < blockCnt))
+    tail = pFifoS->tail;
+    usedCnt = pFifoS->head - tail;
+    KIT_FIFO_BARRIER();
+    if(blockCnt > usedCnt)
     {
-        memcpy(pData, (uint8_t *)pFifoS->pBuf + pFifoS->front * pFifoS->elemSize, pFifoS->elemSize);
-
-        pData = (uint8_t *)pData + pFifoS->elemSize;
-		
-        i++;
-		
-        if(++pFifoS->front >= pFifoS->sumCnt) 
-        {
-            pFifoS->front = 0;
-        }
+        blockCnt = usedCnt;
     }
+    
+    ring_copy_out(pFifoS->pBuf, pFifoS->sumCnt * pFifoS->elemSize, (tail & pFifoS->mask) * pFifoS->elemSize, 
+        (uint8_t *)pData, blockCnt * pFifoS->elemSize);
+    KIT_FIFO_BARRIER();
+    pFifoS->tail = tail + blockCnt;
 
-    return i;
+    return blockCnt;
 }
 
 uint32_t Kit_FifoStructCntGet(stKitFifoStruct_t *pFifoS)
 {
-    uint32_t i = 0;
-    uint32_t mdwFront =0;
+    KIT_ASSERT(pFifoS);
+
+    return pFifoS->head - pFifoS->tail;
+}
+
+uint32_t Kit_FifoStructMaxCntGet(stKitFifoStruct_t *pFifoS)
+{
+    KIT_ASSERT(pFifoS);
+
+    return pFifoS->maxCnt;
+}
+
+void *Kit_FifoStructReserve(stKitFifoStruct_t *pFifoS)
+{
+    uint32_t head;
     
     KIT_ASSERT(pFifoS);
     KIT_ASSERT(pFifoS->pBuf);
 
-    mdwFront = pFifoS->front;
-    while((mdwFront != pFifoS->tail) && (i < pFifoS->sumCnt))
+    head = pFifoS->head;
+    if(head - pFifoS->tail >= pFifoS->sumCnt)
     {
-        i++;
-        if(++mdwFront >= pFifoS->sumCnt) 
-        {
-            mdwFront = 0;
-        }
+        return NULL;
     }
+    
+    return pFifoS->pBuf + (head & pFifoS->mask) * pFifoS->elemSize;
+}
 
-    return i;
+void Kit_FifoStructCommit(stKitFifoStruct_t *pFifoS)
+{
+    uint32_t cnt;
+    
+    KIT_ASSERT(pFifoS);
+
+    KIT_FIFO_BARRIER();
+    pFifoS->head = pFifoS->head + 1;
+    cnt = pFifoS->head - pFifoS->tail;
+    if(cnt > pFifoS->maxCnt)
+    {
+        pFifoS->maxCnt = cnt;
+    }
 }
 
+void *Kit_FifoStructPeek(stKitFifoStruct_t *pFifoS)
+{
+    uint32_t tail;
+    
+    KIT_ASSERT(pFifoS);
+    KIT_ASSERT(pFifoS->pBuf);
+
+    tail = pFifoS->tail;
+    if(pFifoS->head == tail)
+    {
+        return NULL;
+    }
+    KIT_FIFO_BARRIER();
+    
+    return pFifoS->pBuf + (tail & pFifoS->mask) * pFifoS->elemSize;
+}
+
+void Kit_FifoStructRelease(stKitFifoStruct_t *pFifoS)
+{
+    KIT_ASSERT(pFifoS);
+
+    KIT_FIFO_BARRIER();
+    pFifoS->tail = pFifoS->tail + 1;
+}
@@ -21,32 +21,50 @@
 extern "C" {
 #endif
 
-typedef volatile struct 
+/*
+ * Single producer / single consumer ring. The producer only moves head, the
+ * consumer only moves tail, both run freely and wrap with the power-of-2 mask,
+ * so in and out can run in different interrupt levels without locking.
+ */
+typedef struct 
 {
-	volatile uint32_t	bufSize;
-	volatile uint8_t	*pFront;
-	volatile uint8_t	*pTail;
-	volatile uint8_t	*pBuf;
+	uint32_t			bufSize;
+	uint32_t			mask;
+	volatile uint32_t	head;
+	volatile uint32_t	tail;
+	uint32_t			maxLen;		// deepest fill seen by the producer
+	uint8_t				*pBuf;
 }stKitFifo_t;
 
-typedef volatile struct 
+typedef struct 
 {
-	volatile uint32_t	elemSize;
-	volatile uint32_t	sumCnt;
-	volatile uint32_t	front;
+	uint32_t			elemSize;
+	uint32_t			sumCnt;
+	uint32_t			mask;
+	volatile uint32_t	head;
 	volatile uint32_t	tail;
-	volatile void		*pBuf;
+	uint32_t			maxCnt;		// deepest fill seen by the producer
+	uint8_t				*pBuf;
 }stKitFifoStruct_t;
 
 uint32_t Kit_FifoCreate(stKitFifo_t *pFifo, uint8_t *pBuf, uint32_t bufSize);
 uint32_t Kit_FifoIn(stKitFifo_t *pFifo, uint8_t *pData, uint32_t len);
 uint32_t Kit_FifoOut(stKitFifo_t *pFifo, uint8_t *pData, uint32_t len);
 uint32_t Kit_FifoLenGet(stKitFifo_t *pFifo);
+uint32_t Kit_FifoMaxLenGet(stKitFifo_t *pFifo);
 
 uint32_t Kit_FifoStructCreate(stKitFifoStruct_t *pFifoS, void *pBuf, uint32_t bufSize, uint16_t blockSize);
 uint32_t Kit_FifoStructIn(stKitFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt);
 uint32_t Kit_FifoStructOut(stKitFifoStruct_t *pFifoS, void *pData, uint32_t blockCnt);
 uint32_t Kit_FifoStructCntGet(stKitFifoStruct_t *pFifoS);
+uint32_t Kit_FifoStructMaxCntGet(stKitFifoStruct_t *pFifoS);
+
+/* Zero-copy access: fill the reserved block in place then commit it (producer),
+ * use the peeked block in place then release it (consumer). NULL if full/empty. */
+void *Kit_FifoStructReserve(stKitFifoStruct_t *pFifoS);
+void Kit_FifoStructCommit(stKitFifoStruct_t *pFifoS);
+void *Kit_FifoStructPeek(stKitFifoStruct_t *pFifoS);
+void Kit_FifoStructRelease(stKitFifoStruct_t *pFifoS);
 
 #ifdef __cplusplus
 }
@@ -14,131 +14,297 @@
  *
  */
 #include <stdint.h>
-#include <stbool.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
 
 #include "kit_config.h"
+#include "kit_heap.h"
+#include "kit_assert.h"
 
-__attribute__((aligned(4))) static uint8_t heap[HEAP_SIZE];
-static uint16_t heapAllocTable[HEAP_ALLOC_TABLE_SIZE];
-static volatile bool heapReady = false;
+#ifdef HEAP_GUARD_SUPPORT
+#define HEAP_GUARD_SIZE			4
+#define HEAP_GUARD_WORD			0xA5C35A3CUL
+#define HEAP_FILL_ALLOC			0xCD
+#define HEAP_FILL_FREE			0xDD
+#else
+#define HEAP_GUARD_SIZE			0
+#endif
+
+#define HEAP_POOL_SIZE(blockSize, cnt)	((blockSize) * (cnt))
+
+typedef struct stHeapFreeBlock
+{
+	struct stHeapFreeBlock *pNext;
+}stHeapFreeBlock_t;
+
+typedef struct
+{
+	uint8_t				*pBase;
+	uint8_t				*pEnd;
+	stHeapFreeBlock_t	*pFreeList;		
+	uint16_t			blockSize;
+	uint16_t			blockCnt;
+	uint16_t			bumpCnt;		// blocks handed out at least once, the rest are untouched
+	uint16_t			usedCnt;
+	uint16_t			maxUsedCnt;
+	uint16_t			failCnt;
+	uint16_t			guardErrCnt;
+#ifdef HEAP_GUARD_SUPPORT
+	uint16_t			*pReqSize;		// requested size of each block, 0 = free
+#endif
+}stHeapPool_t;
+
+__attribute__((aligned(4))) static uint8_t heapPool32[HEAP_POOL_SIZE(32, HEAP_POOL_32_CNT)];
+__attribute__((aligned(4))) static uint8_t heapPool64[HEAP_POOL_SIZE(64, HEAP_POOL_64_CNT)];
+__attribute__((aligned(4))) static uint8_t heapPool128[HEAP_POOL_SIZE(128, HEAP_POOL_128_CNT)];
+__attribute__((aligned(4))) static uint8_t heapPool256[HEAP_POOL_SIZE(256, HEAP_POOL_256_CNT)];
+
+#ifdef HEAP_GUARD_SUPPORT
+static uint16_t heapReqSize32[HEAP_POOL_32_CNT];
+static uint16_t heapReqSize64[HEAP_POOL_64_CNT];
+static uint16_t heapReqSize128[HEAP_POOL_128_CNT];
+static uint16_t heapReqSize256[HEAP_POOL_256_CNT];
+#define HEAP_POOL_INIT(blockSize, cnt)	{heapPool##blockSize, heapPool##blockSize + sizeof(heapPool##blockSize), NULL, blockSize, cnt, 0, 0, 0, 0, 0, heapReqSize##blockSize}
+#else
+#define HEAP_POOL_INIT(blockSize, cnt)	{heapPool##blockSize, heapPool##blockSize + sizeof(heapPool##blockSize), NULL, blockSize, cnt, 0, 0, 0, 0, 0}
+#endif
+
+/* Ordered by block size, the smallest fitting class is tried first */
+static stHeapPool_t heapPools[KIT_HEAP_CLASS_NUM] = 
+{
+	HEAP_POOL_INIT(32, HEAP_POOL_32_CNT),
+	HEAP_POOL_INIT(64, HEAP_POOL_64_CNT),
+	HEAP_POOL_INIT(128, HEAP_POOL_128_CNT),
+	HEAP_POOL_INIT(256, HEAP_POOL_256_CNT),
+};
+
+static stHeapPool_t *pool_of_addr(const void *pAddr)
+{
+	uint32_t i;
+	
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		if((const uint8_t *)pAddr >= heapPools[i].pBase && (const uint8_t *)pAddr < heapPools[i].pEnd)
+		{
+			return &heapPools[i];
+		}
+	}
+	
+	return NULL;
+}
+
+static void *pool_alloc(stHeapPool_t *pPool)
+{
+	uint8_t *pBlock;
+	
+	if(pPool->pFreeList != NULL)
+	{
+		pBlock = (uint8_t *)pPool->pFreeList;
+		pPool->pFreeList = pPool->pFreeList->pNext;
+	}
+	else if(pPool->bumpCnt < pPool->blockCnt)
+	{
+		pBlock = pPool->pBase + pPool->bumpCnt * pPool->blockSize;
+		pPool->bumpCnt++;
+	}
+	else
+	{
+		return NULL;
+	}
+	
+	if(++pPool->usedCnt > pPool->maxUsedCnt)
+	{
+		pPool->maxUsedCnt = pPool->usedCnt;
+	}
+	
+	return pBlock;
+}
+
+#ifdef HEAP_GUARD_SUPPORT
+static uint32_t block_index(const stHeapPool_t *pPool, const void *pAddr)
+{
+	return ((const uint8_t *)pAddr - pPool->pBase) / pPool->blockSize;
+}
+
+static void guard_set(stHeapPool_t *pPool, void *pAddr, uint32_t size)
+{
+	uint32_t guard = HEAP_GUARD_WORD;
+	
+	pPool->pReqSize[block_index(pPool, pAddr)] = size;
+	memset(pAddr, HEAP_FILL_ALLOC, size);
+	memcpy((uint8_t *)pAddr + size, &guard, HEAP_GUARD_SIZE);
+}
+
+static bool guard_check(stHeapPool_t *pPool, void *pAddr)
+{
+	uint32_t guard;
+	uint32_t size = pPool->pReqSize[block_index(pPool, pAddr)];
+	
+	if(size == 0 || ((uint8_t *)pAddr - pPool->pBase) % pPool->blockSize)
+	{
+		return false;	// double free or not a block start
+	}
+	
+	memcpy(&guard, (uint8_t *)pAddr + size, HEAP_GUARD_SIZE);
+	
+	return guard == HEAP_GUARD_WORD;
+}
+#endif
 
 /*memory usage(0~100)*/
 uint32_t Kit_MemUsage(void)  
 {  
-    uint32_t usage = 0;  
-    uint32_t i;
-	
-    if(!heapReady)
-    {
-        return 0;
-    }
+	uint32_t usedSize = 0;
+	uint32_t sumSize = 0;
+	uint32_t i;
 	
-    for(i = 0; i < HEAP_ALLOC_TABLE_SIZE; i++)  
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)  
 	{  
-		if(heapAllocTable[i])
-		{
-			usage++; 
-		}
-    } 
+		usedSize += heapPools[i].usedCnt * heapPools[i].blockSize;
+		sumSize += heapPools[i].blockCnt * heapPools[i].blockSize;
+	} 
 	
-    return (usage * 100) / HEAP_ALLOC_TABLE_SIZE;  
+	return sumSize ? (usedSize * 100) / sumSize : 0;  
 }  
 
+uint32_t Kit_HeapStatGet(uint8_t classId, stKitHeapStat_t *pStat)
+{
+	const stHeapPool_t *pPool;
+	
+	if(classId >= KIT_HEAP_CLASS_NUM || pStat == NULL)
+	{
+		return 0;
+	}
+	
+	pPool = &heapPools[classId];
+	pStat->blockSize = pPool->blockSize;
+	pStat->blockCnt = pPool->blockCnt;
+	pStat->usedCnt = pPool->usedCnt;
+	pStat->maxUsedCnt = pPool->maxUsedCnt;
+	pStat->failCnt = pPool->failCnt;
+	pStat->guardErrCnt = pPool->guardErrCnt;
+	
+	return 1;
+}
+
 void *Kit_Malloc(uint32_t size)
 {  
-	int offset = 0;  
-    uint32_t blockNum;
-	uint32_t blockCnt = 0;
-    uint32_t i;  
-	
-    if(size == 0)
-    {
-        return NULL;
-    }
-	
-    if(!heapReady)
-    {
-        memset(heap, 0, HEAP_SIZE);
-        memset(heapAllocTable, 0, HEAP_ALLOC_TABLE_SIZE);
-        heapReady = true;
-    }
-	
-    blockNum = ((size - 1) / HEAP_BLOCK_SIZE) + 1;
-    	
-    for(offset = HEAP_ALLOC_TABLE_SIZE - 1; offset >= 0; offset--)  
-    {     
-		if(!heapAllocTable[offset])
+	stHeapPool_t *pFitPool = NULL;
+	void *pAddr = NULL;
+	uint32_t i;  
+	
+	if(size == 0)
+	{
+		return NULL;
+	}
+	
+	/* Fall through to a larger class when the fitting one is exhausted */
+	for(i = 0; i < KIT_HEAP_CLASS_NUM; i++)
+	{
+		if(size + HEAP_GUARD_SIZE > heapPools[i].blockSize)
 		{
-			 blockCnt++;
+			continue;
 		}
-		else 
+		
+		if(pFitPool == NULL)
 		{
-			blockCnt = 0;
+			pFitPool = &heapPools[i];
 		}
 		
-		if(blockCnt == blockNum)
+		pAddr = pool_alloc(&heapPools[i]);
+		if(pAddr != NULL)
 		{
-            for(i = 0; i < blockNum; i++)
-            {  
-                heapAllocTable[offset + i] = blockNum;  
-            }  
-            return (void*)((uint32_t)heap + (offset * HEAP_BLOCK_SIZE));  
+#ifdef HEAP_GUARD_SUPPORT
+			guard_set(&heapPools[i], pAddr, size);
+#endif
+			return pAddr;
 		}
-    }  
+	}
+	
+	if(pFitPool != NULL)
+	{
+		pFitPool->failCnt++;
+	}
 	
-    return NULL;  
+	return NULL;  
 }  
 
 void Kit_Free(void *pAddr)  
 {  
-    int offset;
-    uint32_t blockId;
-    uint32_t blockNum;
-    uint32_t i;  
+	stHeapPool_t *pPool;
+	stHeapFreeBlock_t *pBlock;
 	
 	if(pAddr == NULL)
 	{
 		return;  
 	}
 	
-    if (!heapReady)
-    {
-        return;
-    }
-	
-	offset = (uint32_t)pAddr - (uint32_t)heap;     
+	pPool = pool_of_addr(pAddr);
+	if(pPool == NULL)
+	{
+		return;
+	}
 	
-    if(offset < HEAP_SIZE) 
-    {  
-        blockId = offset / HEAP_BLOCK_SIZE;  
-        blockNum = heapAllocTable[blockId];	
-        
-        for(i = 0; i < blockNum; i++) 
-        {  
-            heapAllocTable[blockId + i] = 0;  
-        }  
-    }
-	else 
-    {
-    	return;  
+#ifdef HEAP_GUARD_SUPPORT
+	if(!guard_check(pPool, pAddr))
+	{
+		pPool->guardErrCnt++;
+		KIT_ASSERT(0);
+		return;
 	}
+	pPool->pReqSize[block_index(pPool, pAddr)] = 0;
+	memset(pAddr, HEAP_FILL_FREE, pPool->blockSize);
+#endif
+	
+	pBlock = (stHeapFreeBlock_t *)pAddr;
+	pBlock->pNext = pPool->pFreeList;
+	pPool->pFreeList = pBlock;
+	pPool->usedCnt--;
 }  
 
 void *Kit_Realloc(void *pOldAddr, uint32_t size)  
 {  
-    void *pNewAddr;
+	stHeapPool_t *pPool;
+	uint32_t oldSize;
+	void *pNewAddr;
 	
-    pNewAddr = Kit_Malloc(size);
+	if(pOldAddr == NULL)
+	{
+		return Kit_Malloc(size);
+	}
 	
-    if(pNewAddr)
-    {  									   
-		memcpy(pNewAddr, pOldAddr, size);   
-		Kit_Free(pOldAddr);
+	pPool = pool_of_addr(pOldAddr);
+	if(pPool == NULL)
+	{
+		return NULL;
+	}
+	
+#ifdef HEAP_GUARD_SUPPORT
+	oldSize = pPool->pReqSize[block_index(pPool, pOldAddr)];
+#else
+	oldSize = pPool->blockSize;
+#endif
+	
+	if(size + HEAP_GUARD_SIZE <= pPool->blockSize)
+	{
+#ifdef HEAP_GUARD_SUPPORT
+		uint32_t guard = HEAP_GUARD_WORD;
 		
-		return pNewAddr;
-    }  
+		pPool->pReqSize[block_index(pPool, pOldAddr)] = size;
+		memcpy((uint8_t *)pOldAddr + size, &guard, HEAP_GUARD_SIZE);
+#endif
+		return pOldAddr;	// still fits in its block
+	}
 	
-	return NULL;
+	pNewAddr = Kit_Malloc(size);
+	if(pNewAddr)
+	{  									   
+		memcpy(pNewAddr, pOldAddr, oldSize < size ? oldSize : size);   
+		Kit_Free(pOldAddr);
+	}  
+	
+	return pNewAddr;
 }
 
 
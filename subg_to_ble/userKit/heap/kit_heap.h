@@ -21,10 +21,23 @@
 extern "C" {
 #endif
 
+#define KIT_HEAP_CLASS_NUM		4
+
+typedef struct
+{
+	uint16_t	blockSize;
+	uint16_t	blockCnt;
+	uint16_t	usedCnt;
+	uint16_t	maxUsedCnt;
+	uint16_t	failCnt;
+	uint16_t	guardErrCnt;
+}stKitHeapStat_t;
+
 void Kit_Free(void *pAddr);
 void *Kit_Malloc(uint32_t size);
 void *Kit_Realloc(void *pAddr, uint32_t size);
 uint32_t Kit_MemUsage(void);
+uint32_t Kit_HeapStatGet(uint8_t classId, stKitHeapStat_t *pStat);
 
 #ifdef __cplusplus
 }
@@ -16,20 +16,189 @@
 #include <string.h>
 
 #include "kit_heap.h"
-
-typedef struct
-{
-	struct stQueueItem_t *pNext;
-	void *pData;
-}stQueueItem_t;
+#include "kit_queue.h"
 
 typedef struct
 {	
-	stQueueItem_t *pHead;
+	stKitQueueList_t list;
 	uint16_t itemSize;
-	uint8_t cnt;
 }stQueue_t;
 
+#define QUEUE_ITEM_DATA(pNode)		((void *)((stKitQueueNode_t *)(pNode) + 1))
+
+void Kit_QueueListInit(stKitQueueList_t *pList)
+{
+	pList->pHead = NULL;
+	pList->pTail = NULL;
+	pList->cnt = 0;
+}
+
+void Kit_QueuePushBack(stKitQueueList_t *pList, stKitQueueNode_t *pNode)
+{
+	pNode->pNext = NULL;
+	pNode->pPrev = pList->pTail;
+	
+	if(pList->pTail != NULL)
+	{
+		pList->pTail->pNext = pNode;
+	}
+	else
+	{
+		pList->pHead = pNode;
+	}
+	pList->pTail = pNode;
+	pList->cnt++;
+}
+
+void Kit_QueuePushFront(stKitQueueList_t *pList, stKitQueueNode_t *pNode)
+{
+	pNode->pPrev = NULL;
+	pNode->pNext = pList->pHead;
+	
+	if(pList->pHead != NULL)
+	{
+		pList->pHead->pPrev = pNode;
+	}
+	else
+	{
+		pList->pTail = pNode;
+	}
+	pList->pHead = pNode;
+	pList->cnt++;
+}
+
+void Kit_QueueUnlink(stKitQueueList_t *pList, stKitQueueNode_t *pNode)
+{
+	if(pNode->pPrev != NULL)
+	{
+		pNode->pPrev->pNext = pNode->pNext;
+	}
+	else
+	{
+		pList->pHead = pNode->pNext;
+	}
+	
+	if(pNode->pNext != NULL)
+	{
+		pNode->pNext->pPrev = pNode->pPrev;
+	}
+	else
+	{
+		pList->pTail = pNode->pPrev;
+	}
+	
+	pNode->pNext = NULL;
+	pNode->pPrev = NULL;
+	pList->cnt--;
+}
+
+stKitQueueNode_t *Kit_QueuePopFront(stKitQueueList_t *pList)
+{
+	stKitQueueNode_t *pNode = pList->pHead;
+	
+	if(pNode != NULL)
+	{
+		Kit_QueueUnlink(pList, pNode);
+	}
+	
+	return pNode;
+}
+
+stKitQueueNode_t *Kit_QueuePopBack(stKitQueueList_t *pList)
+{
+	stKitQueueNode_t *pNode = pList->pTail;
+	
+	if(pNode != NULL)
+	{
+		Kit_QueueUnlink(pList, pNode);
+	}
+	
+	return pNode;
+}
+
+stKitQueueNode_t *Kit_QueuePeekFront(stKitQueueList_t *pList)
+{
+	return pList->pHead;
+}
+
+stKitQueueNode_t *Kit_QueuePeekBack(stKitQueueList_t *pList)
+{
+	return pList->pTail;
+}
+
+void Kit_QueuePoolInit(stKitQueuePool_t *pPool, void *pBuf, uint16_t nodeSize, uint16_t nodeCnt)
+{
+	uint8_t *pNodeBuf = (uint8_t *)pBuf;
+	stKitQueueNode_t *pNode;
+	uint16_t i;
+	
+	/* keep every node pointer aligned */
+	nodeSize = (nodeSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	
+	pPool->pFree = NULL;
+	pPool->nodeSize = nodeSize;
+	pPool->nodeCnt = nodeCnt;
+	pPool->usedCnt = 0;
+	pPool->maxUsedCnt = 0;
+	
+	for(i = nodeCnt; i > 0; i--)
+	{
+		pNode = (stKitQueueNode_t *)(pNodeBuf + (i - 1) * nodeSize);
+		pNode->pNext = pPool->pFree;
+		pPool->pFree = pNode;
+	}
+}
+
+stKitQueueNode_t *Kit_QueuePoolGet(stKitQueuePool_t *pPool)
+{
+	stKitQueueNode_t *pNode = pPool->pFree;
+	
+	if(pNode == NULL)
+	{
+		return NULL;
+	}
+	
+	pPool->pFree = pNode->pNext;
+	pNode->pNext = NULL;
+	pNode->pPrev = NULL;
+	if(++pPool->usedCnt > pPool->maxUsedCnt)
+	{
+		pPool->maxUsedCnt = pPool->usedCnt;
+	}
+	
+	return pNode;
+}
+
+void Kit_QueuePoolPut(stKitQueuePool_t *pPool, stKitQueueNode_t *pNode)
+{
+	if(pNode == NULL)
+	{
+		return;
+	}
+	
+	pNode->pNext = pPool->pFree;
+	pPool->pFree = pNode;
+	pPool->usedCnt--;
+}
+
+static stKitQueueNode_t *queue_node_at(stQueue_t *pQueueTmp, int index)
+{
+	stKitQueueNode_t *pNode;
+	
+	if(index < 0 || (uint32_t)index >= pQueueTmp->list.cnt)
+	{
+		return NULL;
+	}
+	
+	pNode = pQueueTmp->list.pHead;
+	while(index-- > 0)
+	{
+		pNode = pNode->pNext;
+	}
+	
+	return pNode;
+}
+
 void *Kit_QueueCreate(uint16_t itemSize)
 {
 	if(itemSize == 0)
@@ -44,9 +213,8 @@ void *Kit_QueueCreate(uint16_t itemSize)
 		return NULL;
 	}
 
-	pQueueTmp->pHead = NULL;
+	Kit_QueueListInit(&pQueueTmp->list);
 	pQueueTmp->itemSize = itemSize;
-	pQueueTmp->cnt = 0;
 
 	return pQueueTmp;
 }
@@ -75,33 +243,14 @@ int Kit_QueueAppend(void *pQueue, void *pItem)
 		return -1;
 	}
 
-	stQueueItem_t *pNewItem = (stQueueItem_t *)Kit_Malloc(sizeof(stQueueItem_t));
+	stKitQueueNode_t *pNewItem = (stKitQueueNode_t *)Kit_Malloc(sizeof(stKitQueueNode_t) + pQueueTmp->itemSize);
 	if (pNewItem == NULL)
 	{
 		return -1;
 	}
 	
-	pNewItem->pNext = NULL;
-
-	pNewItem->pData = Kit_Malloc(pQueueTmp->itemSize);
-	
-	if (pNewItem->pData == NULL)
-	{
-		Kit_Free(pNewItem);
-		return -1;
-	}
-	
-	memcpy(pNewItem->pData, pItem, pQueueTmp->itemSize);
-
-	stQueueItem_t **ppQueueTmp = &pQueueTmp->pHead;
-	
-	while (*ppQueueTmp != NULL)
-	{
-		ppQueueTmp = &((*ppQueueTmp)->pNext);
-	} 		
-	*ppQueueTmp = pNewItem;
-
-	pQueueTmp->cnt++;
+	memcpy(QUEUE_ITEM_DATA(pNewItem), pItem, pQueueTmp->itemSize);
+	Kit_QueuePushBack(&pQueueTmp->list, pNewItem);
 
 	return 0;
 }
@@ -115,17 +264,13 @@ int Kit_QueueTakeFirst(void *pQueue, void *pItem)
 		return -1;
 	}
 
-	stQueueItem_t *pFirstItem = pQueueTmp->pHead;
+	stKitQueueNode_t *pFirstItem = Kit_QueuePopFront(&pQueueTmp->list);
 	if (pFirstItem == NULL)
 	{
 		return -1;
 	}
 
-	pQueueTmp->pHead = pQueueTmp->pHead->pNext;
-	pQueueTmp->cnt--;
-
-	memcpy(pItem, pFirstItem->pData, pQueueTmp->itemSize);
-	Kit_Free(pFirstItem->pData);
+	memcpy(pItem, QUEUE_ITEM_DATA(pFirstItem), pQueueTmp->itemSize);
 	Kit_Free(pFirstItem);
 
 	return 0;
@@ -140,27 +285,13 @@ int Kit_QueueAt(void *pQueue, int index, void *pItem)
 		return -1;
 	}
 
-	if (pQueueTmp->cnt <= index)
-	{
-		return -1;
-	}
-
-	stQueueItem_t *pIndexItem = pQueueTmp->pHead;
+	stKitQueueNode_t *pIndexItem = queue_node_at(pQueueTmp, index);
 	if (pIndexItem == NULL)
 	{
 		return -1;
 	}
 
-	for (int i = 0; i < index; i++)
-	{
-		pIndexItem = pIndexItem->pNext;
-		if (pIndexItem == NULL)
-		{
-			return -1;
-		}
-	}
-
-	memcpy(pItem, pIndexItem->pData, pQueueTmp->itemSize);
+	memcpy(pItem, QUEUE_ITEM_DATA(pIndexItem), pQueueTmp->itemSize);
 
 	return 0;
 }
@@ -174,52 +305,13 @@ int Kit_QueueRemove(void *pQueue, int index)
 		return -1;
 	}
 
-	if (pQueueTmp->cnt <= index)
+	stKitQueueNode_t *pDeleteItem = queue_node_at(pQueueTmp, index);
+	if (pDeleteItem == NULL)
 	{
 		return -1;
 	}
 
-	stQueueItem_t *pDeleteItem;
-	
-	if (index == 0)
-	{
-		pDeleteItem = pQueueTmp->pHead;
-		if (pDeleteItem == NULL)
-		{
-			return -1;
-		}
-
-		pQueueTmp->pHead = pQueueTmp->pHead->pNext;
-		pQueueTmp->cnt--;
-	}
-	else
-	{
-		stQueueItem_t *pIndexItem = pQueueTmp->pHead;
-		if (pIndexItem == NULL)
-		{
-			return -1;
-		}
-
-		for (int i = 0; i < index - 1; i++)
-		{
-			pIndexItem = pIndexItem->pNext;
-			if (pIndexItem == NULL)
-			{
-				return -1;
-			}
-		}
-
-		pDeleteItem = pIndexItem->pNext;
-		if (pDeleteItem == NULL)
-		{
-			return -1;
-		}
-
-		pIndexItem->pNext = pIndexItem->pNext->pNext;
-		pQueueTmp->cnt--;
-	}
-
-	Kit_Free(pDeleteItem->pData);
+	Kit_QueueUnlink(&pQueueTmp->list, pDeleteItem);
 	Kit_Free(pDeleteItem);
 	
 	return 0;
@@ -234,9 +326,7 @@ uint32_t Kit_QueueCount(void *pQueue)
 		return 0;
 	}
 
-	int mdwCnt = pQueueTmp->cnt;
-
-	return mdwCnt;
+	return pQueueTmp->list.cnt;
 }
 
 void Kit_QueueClear(void *pQueue)
@@ -248,17 +338,10 @@ void Kit_QueueClear(void *pQueue)
 		return;
 	}
 
-	stQueueItem_t *pFirstItem;
+	stKitQueueNode_t *pFirstItem;
 	
-	while (pQueueTmp->pHead != NULL)
+	while ((pFirstItem = Kit_QueuePopFront(&pQueueTmp->list)) != NULL)
 	{
-		pFirstItem = pQueueTmp->pHead;
-		pQueueTmp->pHead = pQueueTmp->pHead->pNext;
-		Kit_Free(pFirstItem->pData);
 		Kit_Free(pFirstItem);
 	}
-
-	pQueueTmp->cnt = 0;
 }
-
-
@@ -16,11 +16,53 @@
 #ifndef __KIT_QUEUE_H__
 #define __KIT_QUEUE_H__
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Get the struct holding an embedded stKitQueueNode_t */
+#define KIT_QUEUE_ENTRY(pNode, type, member)	((type *)((uint8_t *)(pNode) - offsetof(type, member)))
+
+typedef struct stKitQueueNode
+{
+	struct stKitQueueNode *pNext;
+	struct stKitQueueNode *pPrev;
+}stKitQueueNode_t;
+
+/* Intrusive list, the caller owns the nodes and the payload around them */
+typedef struct
+{
+	stKitQueueNode_t *pHead;
+	stKitQueueNode_t *pTail;
+	uint32_t cnt;
+}stKitQueueList_t;
+
+/* Fixed node pool, nodeSize includes the stKitQueueNode_t at the start of each node */
+typedef struct
+{
+	stKitQueueNode_t *pFree;
+	uint16_t nodeSize;
+	uint16_t nodeCnt;
+	uint16_t usedCnt;
+	uint16_t maxUsedCnt;
+}stKitQueuePool_t;
+
+void Kit_QueueListInit(stKitQueueList_t *pList);
+void Kit_QueuePushBack(stKitQueueList_t *pList, stKitQueueNode_t *pNode);
+void Kit_QueuePushFront(stKitQueueList_t *pList, stKitQueueNode_t *pNode);
+stKitQueueNode_t *Kit_QueuePopFront(stKitQueueList_t *pList);
+stKitQueueNode_t *Kit_QueuePopBack(stKitQueueList_t *pList);
+void Kit_QueueUnlink(stKitQueueList_t *pList, stKitQueueNode_t *pNode);
+stKitQueueNode_t *Kit_QueuePeekFront(stKitQueueList_t *pList);
+stKitQueueNode_t *Kit_QueuePeekBack(stKitQueueList_t *pList);
+
+void Kit_QueuePoolInit(stKitQueuePool_t *pPool, void *pBuf, uint16_t nodeSize, uint16_t nodeCnt);
+stKitQueueNode_t *Kit_QueuePoolGet(stKitQueuePool_t *pPool);
+void Kit_QueuePoolPut(stKitQueuePool_t *pPool, stKitQueueNode_t *pNode);
+
+/* Copying queue, node and item copy live in one Kit_Malloc block */
 void *Kit_QueueCreate(uint16_t itemSize);
 void Kit_QueueDestroy(void **ppQueue);
 int Kit_QueueAppend(void *pQueue, void *pItem);
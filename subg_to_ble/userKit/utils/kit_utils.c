@@ -203,6 +203,24 @@ uint16_t Kit_CheckSum16(uint8_t *pBuf, uint8_t len)
 	return ((~sum) + 1);
 }
 
+/* CRC-16/CCITT-FALSE, pass the previous result as crc to continue over several buffers (0xFFFF to start) */
+uint16_t Kit_Crc16(const uint8_t *pBuf, uint32_t len, uint16_t crc)
+{
+	uint8_t i;
+	
+	while(len > 0) 
+	{
+		crc ^= (uint16_t)(*pBuf++) << 8;
+		for(i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+		}
+		len--;
+	}
+	
+	return crc;
+}
+
 uint8_t Kit_CheckSum8(uint8_t *pBuf, uint8_t len)
 {
    uint8_t sum = 0;
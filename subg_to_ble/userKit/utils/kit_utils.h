@@ -29,6 +29,7 @@ int Kit_StrToInt(char *pStr);
 void Kit_HexToStr(uint8_t *pHex, uint8_t *pStr, uint16_t hexLen);
 void Kit_StrToHex(uint8_t *pStr, uint8_t *pHex, uint16_t strLen);
 uint16_t Kit_CheckSum16(uint8_t *pBuf, uint8_t len);
+uint16_t Kit_Crc16(const uint8_t *pBuf, uint32_t len, uint16_t crc);
 uint8_t Kit_CheckSum8(uint8_t *pBuf, uint8_t len);
 bool Kit_InsertSeparatorEveryTwoChar(uint8_t *pDestStr, uint8_t *pSrcStr, char sepChar, uint32_t len);
 void Kit_BitNegate(uint8_t *pSrc, uint8_t *pDest, uint32_t len);